@@ -1,8 +1,32 @@
 #ifndef WATERLILY_ARCHIVER_COMRPESSOR_H
 #define WATERLILY_ARCHIVER_COMRPESSOR_H
 
+#include <stdint.h>
+#define __need_size_t
+#include <stddef.h>
+
 #define WATERLILY_ARCHIVE_FILENAME "assets.waterlily"
 
+typedef struct waterlily_archive_buffer
+{
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} waterlily_archive_buffer_t;
+
+void waterlily_appendArchive(waterlily_archive_buffer_t *buffer,
+                             const void *data, size_t size);
+void waterlily_appendArchiveU8(waterlily_archive_buffer_t *buffer,
+                               uint8_t value);
+void waterlily_appendArchiveU16(waterlily_archive_buffer_t *buffer,
+                                uint16_t value);
+void waterlily_appendArchiveU32(waterlily_archive_buffer_t *buffer,
+                                uint32_t value);
+size_t waterlily_beginArchiveSection(waterlily_archive_buffer_t *buffer,
+                                     uint8_t id);
+void waterlily_endArchiveSection(waterlily_archive_buffer_t *buffer,
+                                 size_t section);
+
 void waterlily_flattenAssets(void);
 void waterlily_compressAssets(void);
 
@@ -0,0 +1,13 @@
+#ifndef WATERLILY_ARCHIVER_FONTS_H
+#define WATERLILY_ARCHIVER_FONTS_H
+
+#include <archiver/compressor.h>
+
+#define WATERLILY_FONT_ATLAS_WIDTH 256
+#define WATERLILY_FONT_ATLAS_PADDING 1
+#define WATERLILY_MAX_FONT_GLYPHS 4096
+#define WATERLILY_MAX_FONT_KERNINGS 4096
+
+void waterlily_bakeFonts(waterlily_archive_buffer_t *buffer);
+
+#endif // WATERLILY_ARCHIVER_FONTS_H
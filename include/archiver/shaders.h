@@ -1,7 +1,8 @@
 #ifndef WATERLILY_ARCHIVER_SHADERS_H
 #define WATERLILY_ARCHIVER_SHADERS_H
 
-void placeholder3(void);
+#include <archiver/compressor.h>
 
-#endif // WATERLILY_ARCHIVER_SHADERS_H
+void waterlily_bakeShaders(waterlily_archive_buffer_t *buffer);
 
+#endif // WATERLILY_ARCHIVER_SHADERS_H
@@ -0,0 +1,11 @@
+#ifndef WATERLILY_ARCHIVER_TILES_H
+#define WATERLILY_ARCHIVER_TILES_H
+
+#include <archiver/compressor.h>
+
+#define WATERLILY_MAX_TILE_ANIMATIONS 1024
+#define WATERLILY_MAX_TILE_FRAMES 255
+
+void waterlily_bakeTileAnimations(waterlily_archive_buffer_t *buffer);
+
+#endif // WATERLILY_ARCHIVER_TILES_H
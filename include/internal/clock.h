@@ -0,0 +1,38 @@
+#ifndef WATERLILY_INTERNAL_CLOCK_H
+#define WATERLILY_INTERNAL_CLOCK_H
+
+#include <stdint.h>
+
+#define WATERLILY_TICK_RATE 60
+#define WATERLILY_TICK_NS (1000000000ULL / WATERLILY_TICK_RATE)
+// The most ticks a single frame may run. Past this the clock drops time
+// instead of trying to catch up, otherwise a slow tick only makes the next
+// frame slower.
+#define WATERLILY_MAX_FRAME_TICKS 5
+// How often a throttled clock wakes the loop, and so how often a background
+// window draws. Four ticks a wake leaves a whole tick of slack under the
+// catch-up limit for jitter and leftover time.
+#define WATERLILY_BACKGROUND_RATE (WATERLILY_TICK_RATE / 4)
+#define WATERLILY_BACKGROUND_NS (1000000000ULL / WATERLILY_BACKGROUND_RATE)
+
+struct waterlily_clock_context
+{
+    int timer;
+    bool throttled;
+    uint64_t last;
+    // Time that has passed but not yet been simulated, always under a tick
+    // once the clock has advanced.
+    uint64_t accumulator;
+    uint64_t ticks;
+    float alpha;
+};
+
+struct waterlily_clock_context *waterlily_createClockContext(void);
+
+uint32_t waterlily_advanceClock(void);
+void waterlily_throttleClock(bool throttled);
+uint64_t waterlily_getClockTime(void);
+uint64_t waterlily_getClockTicks(void);
+float waterlily_getClockAlpha(void);
+
+#endif // WATERLILY_INTERNAL_CLOCK_H
@@ -1,14 +1,33 @@
 #ifndef WATERLILY_INTERNAL_CONFIG_H
 #define WATERLILY_INTERNAL_CONFIG_H
 
+#include <stdint.h>
+
 struct waterlily_configuration
 {
     char *title;
     char *author;
     char *version;
+    // A device index or part of its name, overriding the automatic pick.
+    char *device;
+    // Whether to slow down while the window isn't focused.
+    bool throttle;
+    // The fraction of the output's resolution to render at.
+    float scale;
     struct
     {
         bool displayFPS : 1;
+        // Render without a compositor, only allowed while replaying input or
+        // benchmarking particles, since either ends the run.
+        bool headless : 1;
+        // Frames per statistics window to log, or zero not to.
+        uint32_t stats;
+        // Particles to keep alive in a benchmark run, or zero for none.
+        uint32_t particles;
+        const char *record;
+        const char *replay;
+        // Where to write a trace of the run, if anywhere.
+        const char *trace;
     } arguments;
 };
 
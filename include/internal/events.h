@@ -0,0 +1,55 @@
+#ifndef WATERLILY_INTERNAL_EVENTS_H
+#define WATERLILY_INTERNAL_EVENTS_H
+
+#include <stdint.h>
+
+#define WATERLILY_MAX_EVENT_SOURCES 32
+
+typedef enum waterlily_event_type : uint8_t
+{
+    // Any readable descriptor, the callback does the reading itself.
+    WATERLILY_EVENT_FILE,
+    // A timerfd the loop owns, the callback gets the expiration count.
+    WATERLILY_EVENT_TIMER,
+    // An eventfd the loop owns, the callback gets how often it was signalled.
+    WATERLILY_EVENT_SIGNAL,
+} waterlily_event_type_t;
+
+typedef void (*waterlily_event_callback_t)(uint64_t count, void *data);
+
+struct waterlily_event_source
+{
+    int descriptor;
+    waterlily_event_type_t type;
+    bool used;
+    // Bumped whenever the slot is taken, and stored in its epoll events next
+    // to the slot's index. An event from before a slot was freed or reused
+    // doesn't match anymore and is skipped.
+    uint32_t generation;
+    waterlily_event_callback_t callback;
+    void *data;
+};
+
+struct waterlily_event_context
+{
+    int epoll;
+    struct waterlily_event_source sources[WATERLILY_MAX_EVENT_SOURCES];
+};
+
+struct waterlily_event_context *waterlily_createEventContext(void);
+void waterlily_destroyEventContext(void);
+
+void waterlily_watchEvents(int descriptor, waterlily_event_callback_t callback,
+                           void *data);
+int waterlily_createEventTimer(uint64_t interval,
+                               waterlily_event_callback_t callback,
+                               void *data);
+void waterlily_setEventTimer(int timer, uint64_t delay, uint64_t interval);
+int waterlily_createEventSignal(waterlily_event_callback_t callback,
+                                void *data);
+void waterlily_signalEvent(int signal);
+void waterlily_unwatchEvents(int descriptor);
+
+void waterlily_waitEvents(int timeout);
+
+#endif // WATERLILY_INTERNAL_EVENTS_H
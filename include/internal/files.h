@@ -10,6 +10,13 @@
 
 #define WATERLILY_ASSET_DIRECTORY "./rss/"
 #define WATERLILY_SHADER_DIRECTORY "shaders/"
+#define WATERLILY_FONT_DIRECTORY "fonts/"
+#define WATERLILY_TILE_DIRECTORY "tiles/"
+
+#define WATERLILY_ASSET_ARCHIVE_ID 0x0
+#define WATERLILY_SHADER_SECTION_ID 0x0
+#define WATERLILY_FONT_SECTION_ID 0x1
+#define WATERLILY_TILE_ANIMATION_SECTION_ID 0x2
 
 typedef struct waterlily_file
 {
@@ -21,7 +28,10 @@ typedef struct waterlily_file
         WATERLILY_FRAGMENT_SHADER_FILE,
         WATERLILY_VERTEX_SHADER_FILE,
         WATERLILY_SHADER_FILE,
-        WATERLILY_ARCHIVE_FILE
+        WATERLILY_ARCHIVE_FILE,
+        WATERLILY_FONT_FILE,
+        WATERLILY_KERNING_FILE,
+        WATERLILY_ANIMATION_FILE,
     } type;
     union
     {
@@ -39,12 +49,18 @@ typedef struct waterlily_file
                     WATERLILY_CONFIG_TITLE_KEY,
                     WATERLILY_CONFIG_AUTHOR_KEY,
                     WATERLILY_CONFIG_VERSION_KEY,
+                    WATERLILY_CONFIG_DEVICE_KEY,
+                    WATERLILY_CONFIG_THROTTLE_KEY,
+                    WATERLILY_CONFIG_SCALE_KEY,
                 } key;
                 union
                 {
                     char *title;
                     char *author;
                     char *version;
+                    char *device;
+                    bool throttle;
+                    float scale;
                 } value;
             } pairs[WATERLILY_MAX_CONFIG_PAIRS];
             size_t pairCount;
@@ -68,7 +84,9 @@ typedef struct waterlily_file
                     {
                         enum
                         {
-                            WATERLILY_SHADER_SECTION
+                            WATERLILY_SHADER_SECTION,
+                            WATERLILY_FONT_SECTION,
+                            WATERLILY_TILE_ANIMATION_SECTION,
                         } type;
                         size_t count;
                         union
@@ -79,10 +97,51 @@ typedef struct waterlily_file
                                 {
                                     WATERLILY_VERTEX_SHADER,
                                     WATERLILY_FRAGMENT_SHADER,
+                                    WATERLILY_COMPUTE_SHADER,
                                 } type;
+                                char *name;
                                 uint32_t *code;
                                 size_t size;
                             } *shaders;
+                            struct waterlily_archive_font_section
+                            {
+                                char *name;
+                                uint16_t width;
+                                uint16_t height;
+                                uint16_t lineHeight;
+                                int16_t ascent;
+                                struct waterlily_archive_glyph
+                                {
+                                    uint32_t codepoint;
+                                    uint16_t x;
+                                    uint16_t y;
+                                    uint8_t width;
+                                    uint8_t height;
+                                    int8_t xOffset;
+                                    int8_t yOffset;
+                                    uint8_t advance;
+                                } *glyphs;
+                                size_t glyphCount;
+                                struct waterlily_archive_kerning
+                                {
+                                    uint32_t first;
+                                    uint32_t second;
+                                    int8_t amount;
+                                } *kernings;
+                                size_t kerningCount;
+                                uint8_t *pixels;
+                            } *font;
+                            struct waterlily_archive_tile_animation
+                            {
+                                char *name;
+                                struct waterlily_archive_tile_frame
+                                {
+                                    int16_t x;
+                                    int16_t y;
+                                    uint16_t duration;
+                                } *frames;
+                                size_t frameCount;
+                            } *animations;
                         };
                     } *sections;
                     size_t sectionCount;
@@ -96,5 +155,8 @@ void waterlily_readFile(waterlily_file_t *file);
 void waterlily_writeFile(waterlily_file_t *file, bool append);
 void waterlily_closeFile(waterlily_file_t *file);
 
+const struct waterlily_archive_shader_section *
+waterlily_findArchiveShader(const waterlily_file_t *archive, const char *name);
+
 #endif // WATERLILY_INTERNAL_FILES_H
 
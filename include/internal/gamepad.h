@@ -0,0 +1,75 @@
+#ifndef WATERLILY_INTERNAL_GAMEPAD_H
+#define WATERLILY_INTERNAL_GAMEPAD_H
+
+#include <stdint.h>
+
+// Eight pads of 32 buttons fill the input layer's gamepad slots.
+#define WATERLILY_MAX_GAMEPADS 8
+#define WATERLILY_GAMEPAD_DIRECTORY "/dev/input"
+// How many evdev events are read per call while draining a pad.
+#define WATERLILY_GAMEPAD_BATCH 64
+
+typedef enum waterlily_gamepad_button : uint8_t
+{
+    WATERLILY_GAMEPAD_SOUTH,
+    WATERLILY_GAMEPAD_EAST,
+    WATERLILY_GAMEPAD_NORTH,
+    WATERLILY_GAMEPAD_WEST,
+    WATERLILY_GAMEPAD_LEFT_SHOULDER,
+    WATERLILY_GAMEPAD_RIGHT_SHOULDER,
+    WATERLILY_GAMEPAD_LEFT_TRIGGER,
+    WATERLILY_GAMEPAD_RIGHT_TRIGGER,
+    WATERLILY_GAMEPAD_SELECT,
+    WATERLILY_GAMEPAD_START,
+    WATERLILY_GAMEPAD_MODE,
+    WATERLILY_GAMEPAD_LEFT_STICK,
+    WATERLILY_GAMEPAD_RIGHT_STICK,
+    WATERLILY_GAMEPAD_UP,
+    WATERLILY_GAMEPAD_DOWN,
+    WATERLILY_GAMEPAD_LEFT,
+    WATERLILY_GAMEPAD_RIGHT,
+    WATERLILY_GAMEPAD_BUTTONS,
+} waterlily_gamepad_button_t;
+
+typedef enum waterlily_gamepad_axis : uint8_t
+{
+    // Sticks go from -1 to 1, triggers from 0 to 1.
+    WATERLILY_GAMEPAD_LEFT_X,
+    WATERLILY_GAMEPAD_LEFT_Y,
+    WATERLILY_GAMEPAD_RIGHT_X,
+    WATERLILY_GAMEPAD_RIGHT_Y,
+    WATERLILY_GAMEPAD_LEFT_Z,
+    WATERLILY_GAMEPAD_RIGHT_Z,
+    WATERLILY_GAMEPAD_AXES,
+} waterlily_gamepad_axis_t;
+
+struct waterlily_gamepad
+{
+    int descriptor;
+    // The N in /dev/input/eventN, so hotplug events can find the pad.
+    uint32_t number;
+    bool used;
+    // Set after the kernel dropped events, until the pad is resynced.
+    bool dropped;
+    uint32_t buttons;
+    struct
+    {
+        int32_t minimum;
+        int32_t maximum;
+    } ranges[WATERLILY_GAMEPAD_AXES];
+    float axes[WATERLILY_GAMEPAD_AXES];
+};
+
+struct waterlily_gamepad_context
+{
+    int inotify;
+    struct waterlily_gamepad pads[WATERLILY_MAX_GAMEPADS];
+};
+
+struct waterlily_gamepad_context *waterlily_createGamepadContext(void);
+void waterlily_destroyGamepadContext(void);
+
+bool waterlily_isGamepadConnected(uint32_t pad);
+float waterlily_getGamepadAxis(uint32_t pad, waterlily_gamepad_axis_t axis);
+
+#endif // WATERLILY_INTERNAL_GAMEPAD_H
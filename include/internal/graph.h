@@ -0,0 +1,153 @@
+#ifndef WATERLILY_INTERNAL_GRAPH_H
+#define WATERLILY_INTERNAL_GRAPH_H
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#define WATERLILY_GRAPH_MAX_PASSES 16
+#define WATERLILY_GRAPH_MAX_RESOURCES 16
+#define WATERLILY_GRAPH_MAX_PASS_ACCESSES 8
+
+typedef enum waterlily_graph_pass_type : uint8_t
+{
+    WATERLILY_GRAPH_PASS_GRAPHICS,
+    WATERLILY_GRAPH_PASS_COMPUTE,
+} waterlily_graph_pass_type_t;
+
+typedef enum waterlily_graph_usage : uint8_t
+{
+    WATERLILY_GRAPH_USAGE_COLOR_ATTACHMENT,
+    WATERLILY_GRAPH_USAGE_SAMPLED,
+    WATERLILY_GRAPH_USAGE_STORAGE_READ,
+    WATERLILY_GRAPH_USAGE_STORAGE_WRITE,
+    WATERLILY_GRAPH_USAGE_INDIRECT,
+    WATERLILY_GRAPH_USAGE_VERTEX,
+    WATERLILY_GRAPH_USAGE_TRANSFER_SOURCE,
+    WATERLILY_GRAPH_USAGE_TRANSFER_DESTINATION,
+} waterlily_graph_usage_t;
+
+typedef void (*waterlily_graph_record_t)(VkCommandBuffer buffer, void *data);
+
+typedef struct waterlily_graph_state
+{
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+} waterlily_graph_state_t;
+
+struct waterlily_graph_resource
+{
+    const char *name;
+    enum
+    {
+        WATERLILY_GRAPH_IMAGE,
+        WATERLILY_GRAPH_BUFFER,
+    } type;
+    bool imported;
+    bool output;
+    union
+    {
+        struct
+        {
+            VkImage handle;
+            VkImageView view;
+            VkFormat format;
+            VkExtent2D extent;
+            // Transient images are sized relative to the swapchain extent.
+            float scale;
+            VkImageUsageFlags usage;
+        } image;
+        struct
+        {
+            VkBuffer handle;
+            VkDeviceSize size;
+        } buffer;
+    };
+    waterlily_graph_state_t initial;
+    waterlily_graph_state_t final;
+    uint32_t firstPass;
+    uint32_t lastPass;
+    VkDeviceSize offset;
+};
+
+struct waterlily_graph_access
+{
+    uint32_t resource;
+    waterlily_graph_usage_t usage;
+};
+
+struct waterlily_graph_pass
+{
+    const char *name;
+    waterlily_graph_pass_type_t type;
+    waterlily_graph_record_t record;
+    void *data;
+    bool culled;
+    bool clears;
+    VkClearColorValue clearColor;
+    struct waterlily_graph_access accesses[WATERLILY_GRAPH_MAX_PASS_ACCESSES];
+    size_t accessCount;
+    struct
+    {
+        VkImageMemoryBarrier2 images[WATERLILY_GRAPH_MAX_PASS_ACCESSES];
+        uint32_t imageResources[WATERLILY_GRAPH_MAX_PASS_ACCESSES];
+        size_t imageCount;
+        VkMemoryBarrier2 memory;
+    } barriers;
+    struct
+    {
+        uint32_t resource;
+        VkAttachmentLoadOp loadOp;
+    } colorAttachment;
+    bool rendering;
+};
+
+struct waterlily_graph_context
+{
+    VkPhysicalDevice physical;
+    VkDevice logical;
+    VkExtent2D extent;
+    struct waterlily_graph_pass passes[WATERLILY_GRAPH_MAX_PASSES];
+    size_t passCount;
+    struct waterlily_graph_resource resources[WATERLILY_GRAPH_MAX_RESOURCES];
+    size_t resourceCount;
+    struct
+    {
+        VkImageMemoryBarrier2 images[WATERLILY_GRAPH_MAX_RESOURCES];
+        uint32_t imageResources[WATERLILY_GRAPH_MAX_RESOURCES];
+        size_t imageCount;
+    } finalBarriers;
+    VkDeviceMemory transientMemory;
+    VkDeviceSize transientSize;
+    bool compiled;
+};
+
+struct waterlily_graph_context *waterlily_createGraph(VkPhysicalDevice physical,
+                                                     VkDevice logical);
+void waterlily_destroyGraph(void);
+
+uint32_t waterlily_addGraphImage(const char *name, VkFormat format,
+                                 float scale);
+uint32_t waterlily_importGraphImage(const char *name, VkFormat format,
+                                    waterlily_graph_state_t initial,
+                                    waterlily_graph_state_t final);
+uint32_t waterlily_importGraphBuffer(const char *name, VkBuffer buffer,
+                                     VkDeviceSize size);
+void waterlily_bindGraphImage(uint32_t resource, VkImage image,
+                              VkImageView view, VkExtent2D extent);
+void waterlily_markGraphOutput(uint32_t resource);
+VkImage waterlily_getGraphImage(uint32_t resource);
+VkImageView waterlily_getGraphImageView(uint32_t resource);
+VkExtent2D waterlily_getGraphImageExtent(uint32_t resource);
+
+uint32_t waterlily_addGraphPass(const char *name,
+                                waterlily_graph_pass_type_t type,
+                                waterlily_graph_record_t record, void *data);
+void waterlily_useGraphResource(uint32_t pass, uint32_t resource,
+                                waterlily_graph_usage_t usage);
+void waterlily_clearGraphAttachment(uint32_t pass, VkClearColorValue color);
+
+void waterlily_compileGraph(VkExtent2D extent);
+void waterlily_executeGraph(VkCommandBuffer buffer);
+
+#endif // WATERLILY_INTERNAL_GRAPH_H
@@ -1,9 +1,30 @@
 #ifndef WATERLILY_INTERNAL_INPUT_H
 #define WATERLILY_INTERNAL_INPUT_H
 
+#include <stdatomic.h>
+#include <stdio.h>
 #include <xkbcommon/xkbcommon.h>
 
-#define WATERLILY_KEY_TIMER_MS 50
+// What key repeat runs at until the compositor says otherwise, in keys per
+// second and milliseconds.
+#define WATERLILY_KEY_REPEAT_RATE 25
+#define WATERLILY_KEY_REPEAT_DELAY 600
+// Must be a power of two.
+#define WATERLILY_INPUT_RING_SIZE 256
+// Latin-1 keysyms take the first 256 slots, the 0xFF00 function keys the
+// next 256, and gamepad buttons the last.
+#define WATERLILY_KEY_SLOTS 768
+// Gamepad buttons get symbols of their own past anything XKB hands out, 32
+// for each pad.
+#define WATERLILY_KEY_GAMEPAD_BASE 0x11000000
+#define WATERLILY_KEY_GAMEPAD(pad, button)                                     \
+    ((waterlily_keycode_t)(WATERLILY_KEY_GAMEPAD_BASE + (pad) * 32 + (button)))
+// Must be a power of two, and twice the bindings keeps the probes short.
+#define WATERLILY_MAX_KEY_COMBINATIONS 1024
+#define WATERLILY_COMBINATION_SLOTS (WATERLILY_MAX_KEY_COMBINATIONS * 2)
+// "WLIR", at the start of every input recording.
+#define WATERLILY_INPUT_RECORDING_MAGIC 0x52494C57
+#define WATERLILY_INPUT_RECORDING_VERSION 1
 
 typedef enum waterlily_key_state
 {
@@ -144,28 +165,118 @@ typedef enum waterlily_keycode : uint32_t
     WATERLILY_KEY_F35 = 0xffe0,
 } waterlily_keycode_t;
 
+typedef enum waterlily_modifier : uint32_t
+{
+    WATERLILY_MODIFIER_NONE = 0,
+    WATERLILY_MODIFIER_SHIFT = 1 << 0,
+    WATERLILY_MODIFIER_CONTROL = 1 << 1,
+    WATERLILY_MODIFIER_ALT = 1 << 2,
+    WATERLILY_MODIFIER_SUPER = 1 << 3,
+} waterlily_modifier_t;
+
 typedef struct waterlily_key
 {
     uint64_t timestamp;
     waterlily_keycode_t symbol;
     waterlily_key_state_t state;
+    // The modifiers held when the key was pressed.
+    uint32_t modifiers;
 } waterlily_key_t;
 
+typedef enum waterlily_key_set : uint8_t
+{
+    WATERLILY_KEY_SET_DOWN,
+    // These three only hold what happened during the current tick.
+    WATERLILY_KEY_SET_PRESSED,
+    WATERLILY_KEY_SET_RELEASED,
+    WATERLILY_KEY_SET_REPEATED,
+    WATERLILY_KEY_SETS,
+} waterlily_key_set_t;
+
+// Fires when second is pressed while first is held, or when first is pressed
+// if second is WATERLILY_KEY_NONE. The modifiers have to match exactly.
 typedef struct waterlily_key_combination
 {
-    waterlily_key_t first;
-    waterlily_key_t second;
+    uint32_t modifiers;
+    waterlily_keycode_t first;
+    waterlily_keycode_t second;
     void *data;
     void (*func)(waterlily_key_t *first, waterlily_key_t *second, void *data);
 } waterlily_key_combination_t;
 
+// The on-disk layout of recordings, which are a header and then one record
+// per key event in the order they were handled.
+struct waterlily_input_recording
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t tickRate;
+    uint32_t reserved;
+};
+
+struct waterlily_input_record
+{
+    // The simulation tick the event was handled on.
+    uint32_t tick;
+    // Wayland's millisecond timestamp for the event.
+    uint32_t timestamp;
+    uint32_t symbol;
+    uint8_t state;
+    uint8_t modifiers;
+    uint16_t reserved;
+};
+
 struct waterlily_input_context
 {
     struct xkb_context *handle;
+    struct xkb_keymap *keymap;
     struct xkb_state *state;
-    waterlily_key_t down[2];
-    waterlily_key_combination_t *combinations;
+    // Filled by the Wayland callbacks and drained once per tick. The indices
+    // sit on their own cache lines so the two sides don't fight over them.
+    struct
+    {
+        waterlily_key_t events[WATERLILY_INPUT_RING_SIZE];
+        alignas(64) atomic_size_t head;
+        alignas(64) atomic_size_t tail;
+    } ring;
+    uint64_t keys[WATERLILY_KEY_SETS][WATERLILY_KEY_SLOTS / 64];
+    uint32_t modifiers;
+    // The last non-modifier key pressed and still held, what two key
+    // combinations start from.
+    waterlily_key_t held;
+    // Open addressed on (modifiers, first, second). Removals shift the rest
+    // of their run back, so an empty slot always ends a probe.
+    struct
+    {
+        waterlily_key_combination_t combination;
+        bool used;
+    } combinations[WATERLILY_COMBINATION_SLOTS];
     size_t combinationCount;
+    // Repeats are made here rather than trusting the compositor, and get
+    // queued like any other key event.
+    struct
+    {
+        int timer;
+        int32_t rate;
+        int32_t delay;
+        uint32_t scancode;
+        waterlily_key_t key;
+        // Set once the compositor sends repeats itself, for good.
+        bool external;
+    } repeat;
+    uint32_t tick;
+    // The timestamp of the first key handled since a frame last took it, for
+    // measuring how long input takes to reach the screen.
+    uint64_t firstTimestamp;
+    FILE *recording;
+    // While replaying, live key events are ignored so every run sees exactly
+    // the same input on the same ticks.
+    struct
+    {
+        struct waterlily_input_record *records;
+        size_t count;
+        size_t next;
+    } replay;
 };
 
 void waterlily_createInputContext(const char *const string);
@@ -174,7 +285,26 @@ void waterlily_updateKeysDown(uint32_t scancode, uint64_t timestamp,
                               waterlily_key_state_t state);
 void waterlily_updateModifiersDown(uint32_t depressed, uint32_t latched,
                                    uint32_t locked, uint32_t group);
+void waterlily_queueKey(const waterlily_key_t *key);
 void waterlily_handleKeys(void);
+uint64_t waterlily_takeInputTimestamp(void);
+void waterlily_setKeyRepeat(int32_t rate, int32_t delay);
+void waterlily_stopKeyRepeat(void);
+
+void waterlily_recordInput(const char *path);
+void waterlily_replayInput(const char *path);
+bool waterlily_isReplayingInput(void);
+
+void waterlily_bindKeys(const waterlily_key_combination_t *combination);
+void waterlily_bindKeyMap(const waterlily_key_combination_t *map, size_t count);
+bool waterlily_rebindKeys(const waterlily_key_combination_t *from,
+                          const waterlily_key_combination_t *to);
+void waterlily_unbindKeys(const waterlily_key_combination_t *combination);
+
+bool waterlily_isKeyDown(waterlily_keycode_t key);
+bool waterlily_wasKeyPressed(waterlily_keycode_t key);
+bool waterlily_wasKeyReleased(waterlily_keycode_t key);
+bool waterlily_wasKeyRepeated(waterlily_keycode_t key);
 
 #endif // WATERLILY_INTERNAL_INPUT_H
 
@@ -0,0 +1,103 @@
+#ifndef WATERLILY_INTERNAL_LIGHTS_H
+#define WATERLILY_INTERNAL_LIGHTS_H
+
+#include "files.h"
+#include "vulkan.h"
+
+#define WATERLILY_MAX_LIGHTS 256
+// Pixels per lightmap texel, and so per occluder tile.
+#define WATERLILY_LIGHT_TILE_SIZE 16
+// Texels per side of the square a single workgroup lights.
+#define WATERLILY_LIGHT_CELL_SIZE 8
+#define WATERLILY_MAX_LIGHT_CELLS 2048
+#define WATERLILY_MAX_LIGHT_INDICES 8192
+#define WATERLILY_MAX_OCCLUDER_TILES (256 * 256)
+#define WATERLILY_LIGHTMAP_SET 2
+#define WATERLILY_LIGHT_SHADER "lights"
+
+// This mirrors the std430 layout of the light compute shader.
+typedef struct waterlily_light
+{
+    float position[2];
+    float radius;
+    float intensity;
+    // Which way a cone points as a unit vector, ignored by point lights.
+    float direction[2];
+    // The cosine of the cone's half angle, -1 for a point light.
+    float cone;
+    uint32_t color;
+} waterlily_light_t;
+
+struct waterlily_light_cell
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t firstLight;
+    uint32_t lightCount;
+};
+
+struct waterlily_light_frame
+{
+    waterlily_light_t lights[WATERLILY_MAX_LIGHTS];
+    struct waterlily_light_cell cells[WATERLILY_MAX_LIGHT_CELLS];
+    uint32_t indices[WATERLILY_MAX_LIGHT_INDICES];
+};
+
+struct waterlily_light_constants
+{
+    uint32_t extent[2];
+    uint32_t occluderExtent[2];
+    float tileSize;
+};
+
+struct waterlily_light_context
+{
+    VkDevice logical;
+    bool enabled;
+    VkSampler sampler;
+    VkDescriptorSetLayout sceneLayout;
+    VkDescriptorSetLayout computeLayout;
+    VkDescriptorPool pool;
+    VkDescriptorSet sceneSet;
+    VkDescriptorSet computeSet;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+    struct
+    {
+        VkBuffer handle;
+        VkDeviceMemory memory;
+    } occluders;
+    uint32_t occluderExtent[2];
+    VkClearColorValue ambient;
+    struct
+    {
+        waterlily_light_t info;
+        bool used;
+    } sources[WATERLILY_MAX_LIGHTS];
+    // Per cell light counts, then which cell entry each one was given.
+    uint32_t *grid;
+    uint32_t gridExtent[2];
+    uint32_t cellCount;
+    struct
+    {
+        uint32_t lightmap;
+    } graph;
+};
+
+struct waterlily_light_context *
+waterlily_createLightContext(VkDevice logical, waterlily_file_t *archive);
+void waterlily_destroyLightContext(void);
+
+uint32_t waterlily_createLight(const waterlily_light_t *light);
+void waterlily_updateLight(uint32_t index, const waterlily_light_t *light);
+void waterlily_destroyLight(uint32_t index);
+void waterlily_setAmbientLight(uint32_t color);
+void waterlily_setOccluders(const uint8_t *tiles, uint32_t width,
+                            uint32_t height);
+
+void waterlily_addLightGraph(void);
+void waterlily_useLightGraph(uint32_t pass);
+void waterlily_bindLightmap(void);
+void waterlily_bindLights(VkCommandBuffer buffer, VkPipelineLayout layout);
+
+#endif // WATERLILY_INTERNAL_LIGHTS_H
@@ -1,10 +1,32 @@
 #ifndef WATERLILY_INTERNAL_LOGGING_H
 #define WATERLILY_INTERNAL_LOGGING_H
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #define __need_size_t
 #include <stddef.h>
 
+// Bytes per record, where it came from and its packed arguments. Text
+// formatted straight out is cut off here too.
+#define WATERLILY_LOG_RECORD_SIZE 256
+// Records per thread, must be a power of two.
+#define WATERLILY_LOG_RING_SIZE 128
+// Threads past this many at once log synchronously.
+#define WATERLILY_LOG_THREADS 16
+// The longest a flush waits on the writer, in nanoseconds, so a stalled
+// stdout can't hang whoever flushes.
+#define WATERLILY_LOG_FLUSH_NS 100000000
+// "WLBL", at the start of every binary log.
+#define WATERLILY_BINARY_LOG_MAGIC 0x4C424C57
+#define WATERLILY_BINARY_LOG_VERSION 1
+// A binary log takes no more records past this many bytes.
+#define WATERLILY_BINARY_LOG_SIZE (64 * 1024 * 1024)
+// Must be a power of two, one for every line that logs.
+#define WATERLILY_LOG_FORMATS 4096
+// Set on a record's format ID when it defines the format instead of using it.
+#define WATERLILY_LOG_DEFINITION 0x80000000
+
 typedef enum waterlily_log_type : uint8_t
 {
     WATERLILY_LOG_TYPE_INFO,
@@ -12,6 +34,13 @@ typedef enum waterlily_log_type : uint8_t
     WATERLILY_LOG_TYPE_WARNING,
 } waterlily_log_type_t;
 
+// The least important type of message compiled in at all. Anything under it
+// is gone from the binary, arguments included. The Makefile's build modes
+// set this.
+#ifndef WATERLILY_LOG_LEVEL
+#define WATERLILY_LOG_LEVEL WATERLILY_LOG_TYPE_INFO
+#endif
+
 typedef struct waterlily_log
 {
     const waterlily_log_type_t type;
@@ -19,15 +48,122 @@ typedef struct waterlily_log
     const char *const filename;
 } waterlily_log_t;
 
+typedef enum waterlily_log_argument : uint8_t
+{
+    // A literal percent sign, which takes nothing.
+    WATERLILY_LOG_ARGUMENT_NONE,
+    WATERLILY_LOG_ARGUMENT_INT,
+    // Anything with a l, ll, z, j or t length, all 64 bits here.
+    WATERLILY_LOG_ARGUMENT_WIDE,
+    WATERLILY_LOG_ARGUMENT_DOUBLE,
+    WATERLILY_LOG_ARGUMENT_POINTER,
+    WATERLILY_LOG_ARGUMENT_STRING,
+    // Anything binary logs can't hold, like %n or * widths.
+    WATERLILY_LOG_ARGUMENT_INVALID,
+} waterlily_log_argument_t;
+
+// The on-disk layout of binary logs, which are a header and then records
+// until one with a size of zero. Arguments are packed in the order they're
+// formatted, strings as a 16 bit length and then their bytes.
+struct waterlily_binary_log_header
+{
+    uint32_t magic;
+    uint32_t version;
+    // When the log was opened, on the same clock as the records.
+    uint64_t start;
+};
+
+struct waterlily_binary_log_record
+{
+    // Including this header and padding to eight bytes, written last.
+    uint32_t size;
+    uint32_t format;
+    uint64_t time;
+};
+
+// What follows the record header of a definition, then the file name and
+// format string, both terminated.
+struct waterlily_binary_log_definition
+{
+    uint32_t line;
+    waterlily_log_type_t type;
+    uint8_t reserved[3];
+};
+
+// The writer thread does the formatting, so the file name and format are
+// kept as the literals they are and the arguments packed like a binary log's.
+struct waterlily_log_record
+{
+    const char *filename;
+    const char *format;
+    uint32_t line;
+    waterlily_log_type_t type;
+    uint16_t size;
+    uint8_t arguments[WATERLILY_LOG_RECORD_SIZE - 24];
+};
+
+// Only the thread that owns it writes to a ring, and only the writer thread
+// reads from it. Rings go back to the pool when their thread exits.
+struct waterlily_log_ring
+{
+    struct waterlily_log_record records[WATERLILY_LOG_RING_SIZE];
+    alignas(64) atomic_size_t head;
+    alignas(64) atomic_size_t tail;
+    atomic_bool owned;
+};
+
+struct waterlily_log_context
+{
+    struct waterlily_log_ring rings[WATERLILY_LOG_THREADS];
+    // How many rings have ever been owned, which the writer drains up to.
+    atomic_uint ringCount;
+    pthread_key_t ringKey;
+    // Lines dropped since the writer last said so, because their ring was
+    // full. Warnings are written out synchronously instead.
+    atomic_size_t dropped;
+    // Messages under this are dropped before they're formatted.
+    atomic_uint level;
+    // Until this is set, and again once it's cleared, everything is written
+    // straight out by whoever logs it.
+    atomic_bool running;
+    // Set by the writer right before it blocks, so producers only pay for a
+    // wake when one is needed.
+    atomic_bool sleeping;
+    int wake;
+    pthread_t writer;
+    // While this is mapped, messages go here unformatted instead, warnings
+    // excepted.
+    struct
+    {
+        int descriptor;
+        uint8_t *mapped;
+        atomic_size_t offset;
+        atomic_size_t dropped;
+        // Open addressed on a hash of the file name and line, and a slot's
+        // index is the format's ID.
+        atomic_uint_least64_t formats[WATERLILY_LOG_FORMATS];
+    } binary;
+};
+
+void waterlily_createLogContext(void);
+void waterlily_destroyLogContext(void);
+void waterlily_flushLogs(void);
+void waterlily_setLogLevel(waterlily_log_type_t level);
+void waterlily_openBinaryLog(const char *path);
+void waterlily_closeBinaryLog(void);
+void waterlily_printBinaryLog(const char *path);
+
 void(waterlily_log)(const waterlily_log_t *data, const char *const format, ...);
 [[noreturn]]
 void(waterlily_report)(const waterlily_log_t *data, const char *const format,
                        ...);
 
 #define waterlily_log(type, format, ...)                                       \
-    waterlily_log(                                                             \
-        &(waterlily_log_t){WATERLILY_LOG_TYPE_##type, __LINE__, FILENAME},     \
-        format __VA_OPT__(, ) __VA_ARGS__)
+    (WATERLILY_LOG_TYPE_##type >= WATERLILY_LOG_LEVEL                          \
+         ? waterlily_log(&(waterlily_log_t){WATERLILY_LOG_TYPE_##type,         \
+                                            __LINE__, FILENAME},               \
+                         format __VA_OPT__(, ) __VA_ARGS__)                    \
+         : (void)0)
 
 #define waterlily_report(format, ...)                                          \
     waterlily_report(&(waterlily_log_t){0, __LINE__, FILENAME},                \
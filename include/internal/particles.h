@@ -0,0 +1,147 @@
+#ifndef WATERLILY_INTERNAL_PARTICLES_H
+#define WATERLILY_INTERNAL_PARTICLES_H
+
+#include "files.h"
+#include "vulkan.h"
+
+#define WATERLILY_MAX_PARTICLES 65536
+#define WATERLILY_MAX_EMITTERS 64
+#define WATERLILY_PARTICLE_WORKGROUP_SIZE 64
+#define WATERLILY_PARTICLE_SHADER "particles"
+// Emitters a side of the square grid a --particles benchmark spreads its
+// particles over.
+#define WATERLILY_PARTICLE_BENCHMARK_GRID 4
+// Seconds each benchmark particle lives, which is also how long it takes for
+// the full count to be alive.
+#define WATERLILY_PARTICLE_BENCHMARK_LIFE 1.0f
+// Frames a benchmark runs before the engine exits on its own.
+#define WATERLILY_PARTICLE_BENCHMARK_FRAMES 3600
+
+typedef struct waterlily_emitter
+{
+    float position[2];
+    // Half the size of the area particles spawn in.
+    float spread[2];
+    float velocity[2];
+    // The most each velocity component is randomly nudged by.
+    float jitter[2];
+    float gravity[2];
+    float size[2];
+    float uv[4];
+    float life;
+    float rate;
+    uint32_t texture;
+    uint32_t color;
+    uint32_t layer;
+} waterlily_emitter_t;
+
+// These mirror the std430 layouts of the particle compute shader.
+struct waterlily_particle_emitter
+{
+    float position[2];
+    float spread[2];
+    float velocity[2];
+    float jitter[2];
+    float gravity[2];
+    float size[2];
+    float uv[4];
+    float life;
+    uint32_t texture;
+    uint32_t color;
+    uint32_t layer;
+    uint32_t firstSpawn;
+    uint32_t spawnCount;
+    uint32_t reserved[2];
+};
+
+#define WATERLILY_PARTICLE_EMITTER_SIZE                                        \
+    (sizeof(struct waterlily_particle_emitter) * WATERLILY_MAX_EMITTERS)
+
+struct waterlily_particle
+{
+    float position[2];
+    float velocity[2];
+    float gravity[2];
+    float size[2];
+    float uv[4];
+    float age;
+    float life;
+    uint32_t texture;
+    uint32_t color;
+    uint32_t layer;
+    uint32_t reserved[3];
+};
+
+struct waterlily_particle_counters
+{
+    uint32_t alive[2];
+    int32_t dead;
+    uint32_t reserved;
+    VkDispatchIndirectCommand dispatch;
+    uint32_t padding;
+    VkDrawIndirectCommand draw;
+};
+
+struct waterlily_particle_constants
+{
+    float delta;
+    uint32_t spawnCount;
+    uint32_t emitterCount;
+    uint32_t parity;
+    uint32_t seed;
+};
+
+typedef enum waterlily_particle_phase : uint8_t
+{
+    WATERLILY_PARTICLE_SIMULATE,
+    WATERLILY_PARTICLE_EMIT,
+    WATERLILY_PARTICLE_FINALIZE,
+    WATERLILY_PARTICLE_PHASES,
+} waterlily_particle_phase_t;
+
+struct waterlily_particle_context
+{
+    VkDevice logical;
+    bool enabled;
+    VkDescriptorSetLayout layout;
+    VkDescriptorPool pool;
+    VkDescriptorSet set;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipelines[WATERLILY_PARTICLE_PHASES];
+    struct
+    {
+        VkBuffer handle;
+        VkDeviceMemory memory;
+    } particles, lists, counters, instances;
+    struct
+    {
+        waterlily_emitter_t info;
+        float accumulator;
+        bool used;
+    } sources[WATERLILY_MAX_EMITTERS];
+    struct
+    {
+        uint32_t counters;
+        uint32_t instances;
+    } graph;
+    uint32_t parity;
+    uint32_t seed;
+    struct timespec last;
+};
+
+struct waterlily_particle_context *
+waterlily_createParticleContext(VkDevice logical, waterlily_file_t *archive);
+void waterlily_destroyParticleContext(void);
+
+uint32_t waterlily_createEmitter(const waterlily_emitter_t *emitter);
+void waterlily_updateEmitter(uint32_t index,
+                             const waterlily_emitter_t *emitter);
+void waterlily_destroyEmitter(uint32_t index);
+void waterlily_startParticleBenchmark(uint32_t count, uint32_t width,
+                                      uint32_t height);
+
+bool waterlily_addParticleGraph(void);
+void waterlily_useParticleGraph(uint32_t pass);
+void waterlily_drawParticles(VkCommandBuffer buffer);
+
+#endif // WATERLILY_INTERNAL_PARTICLES_H
@@ -0,0 +1,71 @@
+#ifndef WATERLILY_INTERNAL_PROFILER_H
+#define WATERLILY_INTERNAL_PROFILER_H
+
+#include <stdint.h>
+
+// Values under this land in a bucket each, and every power of two past it is
+// split into half as many buckets, so any recorded value is within an eighth
+// of the one reported for it.
+#define WATERLILY_HISTOGRAM_SUB_BUCKETS 16
+// Enough to hold about eighteen minutes in nanoseconds, anything longer lands
+// in the last bucket.
+#define WATERLILY_HISTOGRAM_BUCKETS 304
+// How often --fps reports, in nanoseconds.
+#define WATERLILY_PROFILER_REPORT_NS 1000000000ULL
+
+// These match wp_presentation_feedback's kind flags.
+typedef enum waterlily_presentation_flag : uint32_t
+{
+    WATERLILY_PRESENTATION_VSYNC = 1 << 0,
+    WATERLILY_PRESENTATION_HARDWARE_CLOCK = 1 << 1,
+    WATERLILY_PRESENTATION_HARDWARE_COMPLETION = 1 << 2,
+    WATERLILY_PRESENTATION_ZERO_COPY = 1 << 3,
+} waterlily_presentation_flag_t;
+
+typedef struct waterlily_histogram
+{
+    uint64_t counts[WATERLILY_HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+} waterlily_histogram_t;
+
+struct waterlily_profiler_context
+{
+    // Whether to log a summary every WATERLILY_PROFILER_REPORT_NS.
+    bool report;
+    uint64_t lastReport;
+    uint64_t lastFrame;
+    uint32_t frames;
+    // Nanoseconds from the first input a frame saw to its reaching the
+    // screen.
+    waterlily_histogram_t latency;
+    struct
+    {
+        uint64_t presented;
+        uint64_t discarded;
+        // What the compositor last told us about a presented frame.
+        uint64_t time;
+        uint32_t refresh;
+        uint32_t flags;
+    } presentation;
+};
+
+struct waterlily_profiler_context *waterlily_createProfilerContext(bool report);
+void waterlily_destroyProfilerContext(void);
+
+void waterlily_recordHistogram(waterlily_histogram_t *histogram,
+                               uint64_t value);
+uint64_t
+waterlily_getHistogramPercentile(const waterlily_histogram_t *histogram,
+                                 double percentile);
+void waterlily_clearHistogram(waterlily_histogram_t *histogram);
+
+void waterlily_markProfilerFrame(void);
+void waterlily_recordPresentation(uint64_t input, uint64_t presented,
+                                  uint32_t refresh, uint32_t flags);
+void waterlily_discardPresentation(void);
+const waterlily_histogram_t *waterlily_getLatencyHistogram(void);
+uint32_t waterlily_getRefreshInterval(void);
+
+#endif // WATERLILY_INTERNAL_PROFILER_H
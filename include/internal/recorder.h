@@ -0,0 +1,51 @@
+#ifndef WATERLILY_INTERNAL_RECORDER_H
+#define WATERLILY_INTERNAL_RECORDER_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Must be a power of two.
+#define WATERLILY_FLIGHT_ENTRIES 4096
+// Written to the working directory, which is the game's own.
+#define WATERLILY_FLIGHT_FILE "flight-recorder.txt"
+// Enough for the handler to dump from even after a stack overflow.
+#define WATERLILY_FLIGHT_STACK_SIZE (64 * 1024)
+
+// The first three match waterlily_log_type_t.
+typedef enum waterlily_flight_kind : uint8_t
+{
+    WATERLILY_FLIGHT_INFO,
+    WATERLILY_FLIGHT_SUCCESS,
+    WATERLILY_FLIGHT_WARNING,
+    WATERLILY_FLIGHT_TRACE,
+    WATERLILY_FLIGHT_FRAME,
+} waterlily_flight_kind_t;
+
+struct waterlily_flight_entry
+{
+    // One past the entry's index once it's whole, so a dump can skip
+    // anything torn or already overwritten.
+    atomic_uint_least64_t sequence;
+    uint64_t time;
+    // A log's line, or how long a trace scope or frame took.
+    uint64_t value;
+    // A log's unformatted message, or a trace scope's name.
+    const char *name;
+    const char *filename;
+    waterlily_flight_kind_t kind;
+};
+
+struct waterlily_flight_context
+{
+    struct waterlily_flight_entry entries[WATERLILY_FLIGHT_ENTRIES];
+    atomic_uint_least64_t head;
+    atomic_bool dumping;
+};
+
+struct waterlily_flight_context *waterlily_createRecorderContext(void);
+
+void waterlily_recordFlight(waterlily_flight_kind_t kind, const char *name,
+                            const char *filename, uint64_t value);
+void waterlily_dumpFlight(const char *reason);
+
+#endif // WATERLILY_INTERNAL_RECORDER_H
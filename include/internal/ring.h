@@ -0,0 +1,32 @@
+#ifndef WATERLILY_INTERNAL_RING_H
+#define WATERLILY_INTERNAL_RING_H
+
+#include "vulkan.h"
+
+// How much every frame in flight can allocate before it runs out.
+#define WATERLILY_RING_FRAME_SIZE (4 * 1024 * 1024)
+
+struct waterlily_ring_context
+{
+    VkDevice logical;
+    VkBuffer handle;
+    VkDeviceMemory memory;
+    uint8_t *mapped;
+    // The strictest of the uniform and storage offset alignments, so any
+    // allocation can be bound through a dynamic offset.
+    VkDeviceSize alignment;
+    // Where the current frame's slice starts, and how far into it the next
+    // allocation goes.
+    VkDeviceSize base;
+    VkDeviceSize head;
+};
+
+struct waterlily_ring_context *
+waterlily_createRingContext(VkPhysicalDevice physical, VkDevice logical);
+void waterlily_destroyRingContext(void);
+
+void waterlily_resetRing(uint32_t frame);
+void *waterlily_allocateRing(VkDeviceSize size, VkDeviceSize *offset);
+VkBuffer waterlily_getRingBuffer(void);
+
+#endif // WATERLILY_INTERNAL_RING_H
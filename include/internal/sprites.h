@@ -0,0 +1,49 @@
+#ifndef WATERLILY_INTERNAL_SPRITES_H
+#define WATERLILY_INTERNAL_SPRITES_H
+
+#include "vulkan.h"
+
+#define WATERLILY_MAX_SPRITES 65536
+// Only these layers can be depth sorted by Y, the rest keep draw order.
+#define WATERLILY_MAX_SORTED_LAYERS 256
+// Sort keys carry the sprite's index below the bits that are sorted on.
+#define WATERLILY_SPRITE_INDEX_BITS 17
+#define WATERLILY_SPRITE_KEY_DIGITS 6
+
+// This is the exact per-instance layout the scene vertex shader receives, so
+// it has to stay tightly packed.
+typedef struct waterlily_sprite
+{
+    float position[2];
+    float size[2];
+    float uv[4];
+    uint32_t texture;
+    uint32_t color;
+    uint32_t layer;
+    // An index from waterlily_getTileAnimation, zero when it doesn't animate.
+    uint32_t animation;
+} waterlily_sprite_t;
+
+struct waterlily_sprite_context
+{
+    waterlily_sprite_t *instances;
+    size_t count;
+    // Sort keys and their scratch copy for the radix sort, with a histogram
+    // per digit and which bits differ between any of the keys.
+    uint64_t *keys[2];
+    uint32_t counts[WATERLILY_SPRITE_KEY_DIGITS][256];
+    uint64_t differing;
+    uint64_t sortedLayers[WATERLILY_MAX_SORTED_LAYERS / 64];
+};
+
+struct waterlily_sprite_context *waterlily_createSpriteContext(void);
+void waterlily_destroySpriteContext(void);
+
+const VkPipelineVertexInputStateCreateInfo *
+waterlily_getSpriteVertexInput(void);
+void waterlily_sortSpriteLayer(uint32_t layer, bool sorted);
+void waterlily_drawSprite(const waterlily_sprite_t *sprite);
+void waterlily_drawSprites(const waterlily_sprite_t *sprites, size_t count);
+void waterlily_recordSprites(VkCommandBuffer buffer);
+
+#endif // WATERLILY_INTERNAL_SPRITES_H
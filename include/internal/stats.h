@@ -0,0 +1,73 @@
+#ifndef WATERLILY_INTERNAL_STATS_H
+#define WATERLILY_INTERNAL_STATS_H
+
+#include <internal/profiler.h>
+#include <stdint.h>
+
+// Frames per window when --stats doesn't give a count.
+#define WATERLILY_STATS_WINDOW 600
+// The frame budget, in nanoseconds, until the compositor tells us its
+// refresh rate. Anything over budget counts as a hitch.
+#define WATERLILY_STATS_BUDGET_NS (1000000000ULL / 60)
+
+typedef enum waterlily_frame_stat : uint8_t
+{
+    // Time the main loop spent working on a frame, not counting the waits
+    // below.
+    WATERLILY_FRAME_STAT_CPU,
+    // Time between the frame's first and last GPU commands, which comes in
+    // a few frames late.
+    WATERLILY_FRAME_STAT_GPU,
+    // Time blocked on fences and the swapchain before a frame could start.
+    WATERLILY_FRAME_STAT_ACQUIRE,
+    // Time blocked handing the frame to the presentation engine.
+    WATERLILY_FRAME_STAT_PRESENT,
+    WATERLILY_FRAME_STAT_COUNT,
+} waterlily_frame_stat_t;
+
+struct waterlily_frame_record
+{
+    waterlily_histogram_t histogram;
+    uint64_t hitches;
+};
+
+// What the query functions hand out, all in nanoseconds but the counts.
+struct waterlily_frame_summary
+{
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t max;
+    uint64_t count;
+    uint64_t hitches;
+};
+
+struct waterlily_stats_context
+{
+    // Whether to log each window as it closes.
+    bool report;
+    uint32_t window;
+    uint32_t frames;
+    uint64_t frameStart;
+    // Acquire and present time so far this frame, which CPU time leaves out.
+    uint64_t waits;
+    struct waterlily_frame_record total[WATERLILY_FRAME_STAT_COUNT];
+    struct waterlily_frame_record current[WATERLILY_FRAME_STAT_COUNT];
+    // The last window to close, zeroed until one has.
+    struct waterlily_frame_record last[WATERLILY_FRAME_STAT_COUNT];
+};
+
+struct waterlily_stats_context *waterlily_createStatsContext(uint32_t window);
+void waterlily_destroyStatsContext(void);
+
+void waterlily_beginStatsFrame(void);
+void waterlily_endStatsFrame(void);
+void waterlily_recordFrameStat(waterlily_frame_stat_t stat, uint64_t value);
+
+// Either the last window to close or the whole run so far.
+struct waterlily_frame_summary
+waterlily_getFrameSummary(waterlily_frame_stat_t stat, bool window);
+const waterlily_histogram_t *
+waterlily_getFrameHistogram(waterlily_frame_stat_t stat, bool window);
+
+#endif // WATERLILY_INTERNAL_STATS_H
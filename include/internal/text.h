@@ -0,0 +1,46 @@
+#ifndef WATERLILY_INTERNAL_TEXT_H
+#define WATERLILY_INTERNAL_TEXT_H
+
+#include "files.h"
+#include "sprites.h"
+
+#define WATERLILY_MAX_FONTS 8
+#define WATERLILY_ASCII_GLYPHS 128
+// This has to stay a power of two, it's used as a mask.
+#define WATERLILY_TEXT_CACHE_SIZE 256
+
+typedef struct waterlily_font
+{
+    struct waterlily_archive_font_section info;
+    uint32_t texture;
+    int16_t ascii[WATERLILY_ASCII_GLYPHS];
+} waterlily_font_t;
+
+struct waterlily_text_layout
+{
+    uint64_t hash;
+    const waterlily_font_t *font;
+    char *text;
+    uint32_t color;
+    uint32_t layer;
+    float origin[2];
+    waterlily_sprite_t *sprites;
+    size_t count;
+};
+
+struct waterlily_text_context
+{
+    waterlily_font_t fonts[WATERLILY_MAX_FONTS];
+    size_t fontCount;
+    struct waterlily_text_layout cache[WATERLILY_TEXT_CACHE_SIZE];
+};
+
+struct waterlily_text_context *
+waterlily_createTextContext(waterlily_file_t *archive);
+void waterlily_destroyTextContext(void);
+
+const waterlily_font_t *waterlily_getFont(const char *name);
+void waterlily_drawText(const waterlily_font_t *font, const char *text,
+                        float x, float y, uint32_t color, uint32_t layer);
+
+#endif // WATERLILY_INTERNAL_TEXT_H
@@ -0,0 +1,62 @@
+#ifndef WATERLILY_INTERNAL_TEXTURES_H
+#define WATERLILY_INTERNAL_TEXTURES_H
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#define __need_size_t
+#include <stddef.h>
+
+#define WATERLILY_MAX_TEXTURES 4096
+#define WATERLILY_MAX_PENDING_TEXTURE_RELEASES 64
+#define WATERLILY_TEXTURE_BINDING 0
+#define WATERLILY_TEXTURE_SET 0
+
+struct waterlily_texture
+{
+    VkImage image;
+    VkImageView view;
+    VkDeviceMemory memory;
+    VkExtent2D extent;
+    bool owned;
+    bool used;
+    // Waiting on in-flight frames before going back on the free list.
+    bool released;
+};
+
+struct waterlily_texture_context
+{
+    VkPhysicalDevice physical;
+    VkDevice logical;
+    VkSampler sampler;
+    VkDescriptorSetLayout layout;
+    VkDescriptorPool pool;
+    VkDescriptorSet set;
+    uint32_t capacity;
+    struct waterlily_texture *textures;
+    uint32_t *freeList;
+    size_t freeCount;
+    struct
+    {
+        uint32_t index;
+        uint64_t frame;
+    } pending[WATERLILY_MAX_PENDING_TEXTURE_RELEASES];
+    size_t pendingCount;
+    uint64_t frame;
+};
+
+struct waterlily_texture_context *
+waterlily_createTextureContext(VkPhysicalDevice physical, VkDevice logical);
+void waterlily_destroyTextureContext(void);
+
+uint32_t waterlily_createTexture(uint32_t width, uint32_t height,
+                                 VkFormat format, const void *pixels,
+                                 size_t size);
+uint32_t waterlily_registerTexture(VkImageView view, VkImageLayout layout);
+void waterlily_updateTexture(uint32_t index, VkImageView view,
+                             VkImageLayout layout);
+void waterlily_releaseTexture(uint32_t index);
+void waterlily_collectTextures(void);
+void waterlily_bindTextures(VkCommandBuffer buffer, VkPipelineBindPoint point,
+                            VkPipelineLayout layout);
+
+#endif // WATERLILY_INTERNAL_TEXTURES_H
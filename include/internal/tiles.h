@@ -0,0 +1,64 @@
+#ifndef WATERLILY_INTERNAL_TILES_H
+#define WATERLILY_INTERNAL_TILES_H
+
+#include "files.h"
+#include "sprites.h"
+
+#define WATERLILY_MAX_TILE_LAYERS 16
+#define WATERLILY_TILE_ANIMATION_SET 1
+#define WATERLILY_TILE_ANIMATION_BINDING 0
+#define WATERLILY_TILE_FRAME_BINDING 1
+
+// These mirror the std430 storage buffers the scene vertex shader reads.
+struct waterlily_tile_animation
+{
+    uint32_t firstFrame;
+    uint32_t frameCount;
+    uint32_t period;
+    uint32_t reserved;
+};
+
+struct waterlily_tile_frame
+{
+    // The tile offset from the sprite's own UV rectangle, x in the low half.
+    uint32_t offset;
+    // When the frame ends, in milliseconds from the start of the loop.
+    uint32_t end;
+};
+
+struct waterlily_tile_context
+{
+    VkDevice logical;
+    VkDescriptorSetLayout layout;
+    VkDescriptorPool pool;
+    VkDescriptorSet set;
+    struct
+    {
+        VkBuffer handle;
+        VkDeviceMemory memory;
+    } table;
+    char **names;
+    size_t animationCount;
+    struct
+    {
+        VkBuffer handle;
+        VkDeviceMemory memory;
+        uint32_t count;
+    } layers[WATERLILY_MAX_TILE_LAYERS];
+    size_t layerCount;
+};
+
+struct waterlily_tile_context *
+waterlily_createTileContext(VkPhysicalDevice physical, VkDevice logical,
+                            waterlily_file_t *archive);
+void waterlily_destroyTileContext(void);
+
+uint32_t waterlily_getTileAnimation(const char *name);
+uint32_t waterlily_createTileLayer(const waterlily_sprite_t *tiles,
+                                   size_t count);
+void waterlily_clearTileLayers(void);
+void waterlily_bindTileAnimations(VkCommandBuffer buffer,
+                                  VkPipelineLayout layout);
+void waterlily_recordTiles(VkCommandBuffer buffer);
+
+#endif // WATERLILY_INTERNAL_TILES_H
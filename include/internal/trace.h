@@ -0,0 +1,63 @@
+#ifndef WATERLILY_INTERNAL_TRACE_H
+#define WATERLILY_INTERNAL_TRACE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Threads past this go untraced.
+#define WATERLILY_TRACE_THREADS 16
+// Events per thread, must be a power of two. Past this the oldest ones are
+// overwritten, so a trace always holds the latest stretch of the run.
+#define WATERLILY_TRACE_EVENTS (1 << 18)
+
+typedef struct waterlily_trace
+{
+    const char *name;
+    uint64_t start;
+} waterlily_trace_t;
+
+struct waterlily_trace_event
+{
+    const char *name;
+    uint64_t start;
+    uint64_t duration;
+};
+
+// Only the thread that claimed a buffer writes to it.
+struct waterlily_trace_buffer
+{
+    struct waterlily_trace_event *events;
+    // Every event the thread ever kept, the ring holds the last of them.
+    atomic_size_t head;
+};
+
+struct waterlily_trace_context
+{
+    const char *path;
+    atomic_bool enabled;
+    // Set from the signal handler, the next scope to end writes the file.
+    atomic_bool requested;
+    uint64_t start;
+    struct waterlily_trace_buffer buffers[WATERLILY_TRACE_THREADS];
+    atomic_uint bufferCount;
+    // Events from threads that didn't get a buffer.
+    atomic_size_t dropped;
+};
+
+struct waterlily_trace_context *waterlily_createTraceContext(const char *path);
+void waterlily_destroyTraceContext(void);
+void waterlily_writeTrace(void);
+
+waterlily_trace_t waterlily_beginTrace(const char *name);
+void waterlily_endTrace(waterlily_trace_t *trace);
+
+// Times everything from here to the end of the enclosing block. Scopes are
+// always timed for the flight recorder, and only kept for the trace file
+// when one was asked for.
+#define WATERLILY_TRACE_NAME2(line) trace##line
+#define WATERLILY_TRACE_NAME(line) WATERLILY_TRACE_NAME2(line)
+#define WATERLILY_TRACE_SCOPE(name)                                            \
+    [[gnu::cleanup(waterlily_endTrace)]] waterlily_trace_t                     \
+    WATERLILY_TRACE_NAME(__LINE__) = waterlily_beginTrace(name)
+
+#endif // WATERLILY_INTERNAL_TRACE_H
@@ -1,11 +1,31 @@
 #ifndef WATERLILY_INTERNAL_VULKAN_H
 #define WATERLILY_INTERNAL_VULKAN_H
 
+#include "files.h"
 #include "window.h"
 
+#include <time.h>
 #include <vulkan/vulkan.h>
 
 #define WATERLILY_CONCURRENT_FRAMES 2
+// Relative to the user's cache directory.
+#define WATERLILY_DEVICE_CACHE "waterlily-device"
+
+struct waterlily_push_constants
+{
+    float extent[2];
+    // Milliseconds since the renderer started, wrapping after ~49 days.
+    uint32_t time;
+};
+
+// What's remembered between launches about the chosen device.
+struct waterlily_vulkan_device_cache
+{
+    uint8_t uuid[VK_UUID_SIZE];
+    uint32_t driverVersion;
+    uint32_t graphicsQueue;
+    uint32_t presentQueue;
+};
 
 struct waterlily_vulkan_queue
 {
@@ -15,8 +35,10 @@ struct waterlily_vulkan_queue
 
 struct waterlily_vulkan_context
 {
+    struct waterlily_window_context *window;
     VkInstance instance;
     uint32_t currentFrame;
+    struct timespec start;
 #if BUILD_TYPE == 0
     VkDebugUtilsMessengerEXT debugMessenger;
 #endif
@@ -39,16 +61,20 @@ struct waterlily_vulkan_context
     {
         VkPipeline handle;
         VkPipelineLayout layout;
-        VkRenderPass renderpass;
     } pipeline;
     struct
     {
         VkSwapchainKHR handle;
-        VkImageView *images;
-        VkFramebuffer *framebuffers;
+        VkImage *images;
+        VkImageView *views;
         uint32_t imageCount;
     } swapchain;
     struct
+    {
+        uint32_t swapchain;
+        uint32_t scene;
+    } graph;
+    struct
     {
         VkSemaphore imageAvailableSemphores[WATERLILY_CONCURRENT_FRAMES];
         VkSemaphore renderFinishedSemaphores[WATERLILY_CONCURRENT_FRAMES];
@@ -57,12 +83,37 @@ struct waterlily_vulkan_context
         VkCommandPool pool;
         VkCommandBuffer buffers[WATERLILY_CONCURRENT_FRAMES];
     } commandBuffers;
+    struct
+    {
+        // Two a frame, around all of its commands. Null if the graphics
+        // queue can't timestamp.
+        VkQueryPool pool;
+        // Nanoseconds a tick, and which bits of a timestamp are valid.
+        float period;
+        uint64_t mask;
+        // Whether a frame slot has timestamps waiting to be read.
+        bool pending[WATERLILY_CONCURRENT_FRAMES];
+    } timestamps;
 };
 
 struct waterlily_vulkan_context *
-waterlily_createVulkanContext(struct waterlily_window_context *window);
+waterlily_createVulkanContext(struct waterlily_window_context *window,
+                              struct waterlily_configuration *config);
 void waterlily_destroyVulkanContext(void);
-void waterlily_renderFrame(void);
+bool waterlily_renderFrame(void);
+
+void waterlily_createVulkanBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                                  VkMemoryPropertyFlags properties,
+                                  VkBuffer *buffer, VkDeviceMemory *memory);
+VkCommandBuffer waterlily_beginVulkanCommands(void);
+void waterlily_submitVulkanCommands(VkCommandBuffer buffer);
+void waterlily_uploadVulkanBuffer(VkBuffer buffer, const void *data,
+                                  VkDeviceSize size);
+VkShaderModule waterlily_createVulkanShader(
+    const struct waterlily_archive_shader_section *shader);
+uint32_t waterlily_findVulkanMemoryType(VkPhysicalDevice physical,
+                                        uint32_t typeBits,
+                                        VkMemoryPropertyFlags properties);
 
 #endif // WATERLILY_INTERNAL_VULKAN_H
 
@@ -6,11 +6,35 @@
 #include <stdint.h>
 #include <wayland-client.h>
 
+// The surface size in surface coordinates until the compositor picks one.
+#define WATERLILY_DEFAULT_WIDTH 1280
+#define WATERLILY_DEFAULT_HEIGHT 720
+#define WATERLILY_HEADLESS_WIDTH 1920
+#define WATERLILY_HEADLESS_HEIGHT 1080
+// How many frames may wait on presentation feedback at once.
+#define WATERLILY_MAX_FEEDBACK 8
+
+struct waterlily_window_feedback
+{
+    void *handle;
+    // The first input the frame saw, zero if it saw none.
+    uint64_t input;
+};
+
 struct waterlily_window_context
 {
     uint32_t scale;
     bool resized;
     bool close;
+    // The compositor isn't showing us, so there's nothing worth drawing.
+    bool suspended;
+    bool activated;
+    // Set once the compositor wants another frame. It stops asking while
+    // we're hidden, so nothing is drawn then either.
+    bool frameReady;
+    struct wl_callback *frame;
+    // Whether a display read was announced and is still outstanding.
+    bool reading;
     struct wl_display *display;
     struct wl_registry *registry;
     struct wl_compositor *compositor;
@@ -21,6 +45,21 @@ struct waterlily_window_context
     void *shell;
     void *shellSurface;
     void *toplevel;
+    void *viewporter;
+    void *viewport;
+    void *fractionalScaler;
+    void *fractionalScale;
+    // In 120ths, zero until the compositor tells us.
+    uint32_t preferredScale;
+    // How much of the output's resolution we actually render at.
+    float renderScale;
+    void *presentation;
+    // The clock presentation timestamps are in.
+    uint32_t presentationClock;
+    struct waterlily_window_feedback feedback[WATERLILY_MAX_FEEDBACK];
+    uint32_t surfaceWidth;
+    uint32_t surfaceHeight;
+    // The size of the buffer we render, in pixels.
     uint32_t width;
     uint32_t height;
 };
@@ -28,7 +67,9 @@ struct waterlily_window_context
 struct waterlily_window_context *
 waterlily_createWindowContext(struct waterlily_configuration *config);
 void waterlily_destroyWindowContext(void);
-bool waterlily_processWindowEvents(void);
+bool waterlily_processWindowEvents(int timeout);
+void waterlily_requestWindowFrame(void);
+void waterlily_finishWindowFrame(bool presented);
 
 #endif // WATERLILY_INTERNAL_WINDOW_H
 
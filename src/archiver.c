@@ -1,12 +1,19 @@
 #include <internal/logging.h>
 #include <archiver/compressor.h>
+#include <internal/trace.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 int main(int argc, char **argv)
 {
-    (void)argc;
     waterlily_log(INFO, "Starting compression process.");
+    if (argc > 1 && strncmp(argv[1], "--trace=", 8) == 0)
+    {
+        waterlily_createTraceContext(argv[1] + 8);
+        if (atexit(waterlily_destroyTraceContext) != 0)
+            waterlily_report("Failed to set exit function.");
+    }
 
     char *path = argv[0];
     path[strrchr(path, '/') - argv[0]] = 0;
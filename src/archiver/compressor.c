@@ -1,15 +1,86 @@
 #include <archiver/compressor.h>
+#include <archiver/fonts.h>
+#include <archiver/shaders.h>
+#include <archiver/tiles.h>
 #include <internal/files.h>
+#include <internal/logging.h>
+#include <internal/trace.h>
+#include <stdlib.h>
+#include <string.h>
+
+void waterlily_appendArchive(waterlily_archive_buffer_t *buffer,
+                             const void *data, size_t size)
+{
+    if (buffer->size + size > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity == 0 ? 4096 : buffer->capacity;
+        while (capacity < buffer->size + size)
+            capacity *= 2;
+
+        buffer->data = realloc(buffer->data, capacity);
+        if (buffer->data == nullptr)
+            waterlily_report("Failed to grow archive to %zu bytes.", capacity);
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+void waterlily_appendArchiveU8(waterlily_archive_buffer_t *buffer,
+                               uint8_t value)
+{
+    waterlily_appendArchive(buffer, &value, sizeof(value));
+}
+
+void waterlily_appendArchiveU16(waterlily_archive_buffer_t *buffer,
+                                uint16_t value)
+{
+    waterlily_appendArchive(buffer, &value, sizeof(value));
+}
+
+void waterlily_appendArchiveU32(waterlily_archive_buffer_t *buffer,
+                                uint32_t value)
+{
+    waterlily_appendArchive(buffer, &value, sizeof(value));
+}
+
+size_t waterlily_beginArchiveSection(waterlily_archive_buffer_t *buffer,
+                                     uint8_t id)
+{
+    waterlily_appendArchiveU8(buffer, id);
+    // The length is patched in once the section is finished.
+    size_t section = buffer->size;
+    waterlily_appendArchiveU32(buffer, 0);
+    return section;
+}
+
+void waterlily_endArchiveSection(waterlily_archive_buffer_t *buffer,
+                                 size_t section)
+{
+    uint32_t length = buffer->size - section - sizeof(uint32_t);
+    memcpy(buffer->data + section, &length, sizeof(length));
+}
 
 void waterlily_flattenAssets(void)
 {
+    WATERLILY_TRACE_SCOPE("flattenAssets");
+    waterlily_archive_buffer_t buffer = {0};
+    waterlily_appendArchiveU8(&buffer, WATERLILY_ASSET_ARCHIVE_ID);
+    waterlily_bakeShaders(&buffer);
+    waterlily_bakeFonts(&buffer);
+    waterlily_bakeTileAnimations(&buffer);
+
     waterlily_file_t file = {
         .name = "assets",
         .type = WATERLILY_ARCHIVE_FILE,
+        .text.size = buffer.size,
+        .text.contents = (char *)buffer.data,
     };
 
     waterlily_writeFile(&file, false);
+    free(buffer.data);
+    waterlily_log(SUCCESS, "Flattened assets into %zu bytes.", file.text.size);
 }
 
 void waterlily_compressAssets(void) {}
-
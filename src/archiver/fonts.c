@@ -0,0 +1,391 @@
+#include <archiver/fonts.h>
+#include <dirent.h>
+#include <internal/files.h>
+#include <internal/logging.h>
+#include <internal/trace.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct glyph
+{
+    struct waterlily_archive_glyph info;
+    uint8_t *bitmap;
+    bool skip;
+};
+
+static struct
+{
+    uint16_t width;
+    uint16_t height;
+    uint16_t lineHeight;
+    int16_t ascent;
+    struct glyph glyphs[WATERLILY_MAX_FONT_GLYPHS];
+    size_t glyphCount;
+    struct waterlily_archive_kerning kernings[WATERLILY_MAX_FONT_KERNINGS];
+    size_t kerningCount;
+    uint8_t *pixels;
+} font = {0};
+
+static uint8_t hexValue(char digit)
+{
+    if (digit >= '0' && digit <= '9')
+        return digit - '0';
+    if (digit >= 'a' && digit <= 'f')
+        return digit - 'a' + 10;
+    if (digit >= 'A' && digit <= 'F')
+        return digit - 'A' + 10;
+    return 0;
+}
+
+static void parseBitmapRow(struct glyph *glyph, size_t row, const char *line)
+{
+    // Rows are padded to whole bytes and stored most significant bit first,
+    // so every hex digit carries four columns.
+    size_t digits = strlen(line);
+    uint8_t width = glyph->info.width;
+    for (size_t x = 0; x < width && x / 4 < digits; ++x)
+    {
+        uint8_t nibble = hexValue(line[x / 4]);
+        if (nibble & (0x8 >> (x % 4)))
+            glyph->bitmap[row * width + x] = 0xFF;
+    }
+}
+
+static void finishGlyph(struct glyph *glyph)
+{
+    if (glyph->skip)
+    {
+        free(glyph->bitmap);
+        return;
+    }
+    font.glyphCount++;
+}
+
+static void parseGlyphBox(struct glyph *glyph, int width, int height,
+                          int xOffset, int yOffset)
+{
+    if (width < 0 || width > UINT8_MAX || height < 0 ||
+        height > UINT8_MAX || xOffset < INT8_MIN || xOffset > INT8_MAX ||
+        yOffset < INT8_MIN || yOffset > INT8_MAX)
+    {
+        waterlily_log(WARNING, "Skipping glyph %u with oversized box.",
+                      glyph->info.codepoint);
+        glyph->skip = true;
+        return;
+    }
+
+    glyph->info.width = width;
+    glyph->info.height = height;
+    glyph->info.xOffset = xOffset;
+    glyph->info.yOffset = yOffset;
+}
+
+static void parseFont(char *contents)
+{
+    struct glyph *glyph = nullptr;
+    bool bitmap = false;
+    size_t row = 0;
+    int boxHeight = 0, boxDescent = 0, ascent = -1, descent = -1;
+
+    char *save = nullptr;
+    for (char *line = strtok_r(contents, "\n", &save); line != nullptr;
+         line = strtok_r(nullptr, "\n", &save))
+    {
+        size_t length = strlen(line);
+        if (length > 0 && line[length - 1] == '\r')
+            line[length - 1] = 0;
+
+        if (bitmap)
+        {
+            if (strncmp(line, "ENDCHAR", 7) == 0)
+            {
+                finishGlyph(glyph);
+                glyph = nullptr;
+                bitmap = false;
+            }
+            else if (row < glyph->info.height)
+                parseBitmapRow(glyph, row++, line);
+            continue;
+        }
+
+        int a, b, c, d;
+        if (sscanf(line, "FONTBOUNDINGBOX %d %d %d %d", &a, &b, &c, &d) == 4)
+        {
+            boxHeight = b;
+            boxDescent = -d;
+        }
+        else if (sscanf(line, "FONT_ASCENT %d", &a) == 1)
+            ascent = a;
+        else if (sscanf(line, "FONT_DESCENT %d", &a) == 1)
+            descent = a;
+        else if (strncmp(line, "STARTCHAR", 9) == 0)
+        {
+            if (font.glyphCount == WATERLILY_MAX_FONT_GLYPHS)
+                waterlily_report("Font has more than %d glyphs.",
+                                 WATERLILY_MAX_FONT_GLYPHS);
+            glyph = &font.glyphs[font.glyphCount];
+            *glyph = (struct glyph){0};
+        }
+        else if (glyph == nullptr)
+            continue;
+        else if (sscanf(line, "ENCODING %d", &a) == 1)
+        {
+            // Unencoded glyphs have nothing to look them up by.
+            glyph->skip = a < 0;
+            glyph->info.codepoint = a;
+        }
+        else if (sscanf(line, "DWIDTH %d", &a) == 1)
+        {
+            if (a < 0 || a > UINT8_MAX)
+                glyph->skip = true;
+            glyph->info.advance = a;
+        }
+        else if (sscanf(line, "BBX %d %d %d %d", &a, &b, &c, &d) == 4)
+            parseGlyphBox(glyph, a, b, c, d);
+        else if (strncmp(line, "BITMAP", 6) == 0)
+        {
+            size_t size = (size_t)glyph->info.width * glyph->info.height;
+            glyph->bitmap = calloc(size == 0 ? 1 : size, 1);
+            if (glyph->bitmap == nullptr)
+                waterlily_report("Failed to allocate glyph bitmap.");
+            bitmap = true;
+            row = 0;
+        }
+        else if (strncmp(line, "ENDCHAR", 7) == 0)
+        {
+            finishGlyph(glyph);
+            glyph = nullptr;
+        }
+    }
+
+    // BDF only requires the bounding box, the ascent and descent properties
+    // are optional but describe the line far better when present.
+    font.ascent = ascent >= 0 ? ascent : boxHeight - boxDescent;
+    font.lineHeight = ascent >= 0 && descent >= 0 ? ascent + descent
+                                                  : boxHeight;
+}
+
+static int compareHeight(const void *a, const void *b)
+{
+    const struct glyph *first = a, *second = b;
+    if (first->info.height != second->info.height)
+        return second->info.height - first->info.height;
+    return (first->info.codepoint > second->info.codepoint) -
+           (first->info.codepoint < second->info.codepoint);
+}
+
+static int compareCodepoint(const void *a, const void *b)
+{
+    const struct glyph *first = a, *second = b;
+    return (first->info.codepoint > second->info.codepoint) -
+           (first->info.codepoint < second->info.codepoint);
+}
+
+static int compareKerning(const void *a, const void *b)
+{
+    const struct waterlily_archive_kerning *first = a, *second = b;
+    if (first->first != second->first)
+        return (first->first > second->first) -
+               (first->first < second->first);
+    return (first->second > second->second) -
+           (first->second < second->second);
+}
+
+static void packFont(void)
+{
+    constexpr uint32_t padding = WATERLILY_FONT_ATLAS_PADDING;
+    constexpr uint32_t width = WATERLILY_FONT_ATLAS_WIDTH;
+
+    // Shelf packing wastes the least space when each shelf holds glyphs of
+    // about the same height, so the tallest go first.
+    qsort(font.glyphs, font.glyphCount, sizeof(struct glyph), compareHeight);
+
+    uint32_t x = padding, y = padding, shelf = 0;
+    for (size_t i = 0; i < font.glyphCount; ++i)
+    {
+        auto glyph = &font.glyphs[i].info;
+        if (glyph->width + padding * 2 > width)
+            waterlily_report("Glyph %u does not fit the atlas.",
+                             glyph->codepoint);
+
+        if (x + glyph->width + padding > width)
+        {
+            x = padding;
+            y += shelf + padding;
+            shelf = 0;
+        }
+
+        glyph->x = x;
+        glyph->y = y;
+        x += glyph->width + padding;
+        if (glyph->height > shelf)
+            shelf = glyph->height;
+    }
+
+    uint32_t height = 1;
+    while (height < y + shelf + padding)
+        height <<= 1;
+    if (height > UINT16_MAX)
+        waterlily_report("Font atlas is too tall at %u pixels.", height);
+
+    font.width = width;
+    font.height = height;
+    font.pixels = calloc((size_t)width * height, 1);
+    if (font.pixels == nullptr)
+        waterlily_report("Failed to allocate font atlas.");
+
+    for (size_t i = 0; i < font.glyphCount; ++i)
+    {
+        auto glyph = &font.glyphs[i];
+        for (size_t row = 0; row < glyph->info.height; ++row)
+            memcpy(&font.pixels[(glyph->info.y + row) * width + glyph->info.x],
+                   &glyph->bitmap[row * glyph->info.width], glyph->info.width);
+    }
+
+    // The runtime binary searches glyphs by codepoint.
+    qsort(font.glyphs, font.glyphCount, sizeof(struct glyph),
+          compareCodepoint);
+}
+
+static void parseKernings(char *contents)
+{
+    char *save = nullptr;
+    for (char *line = strtok_r(contents, "\n", &save); line != nullptr;
+         line = strtok_r(nullptr, "\n", &save))
+    {
+        if (line[0] == '#')
+            continue;
+
+        int first, second, amount;
+        if (sscanf(line, "%i %i %i", &first, &second, &amount) != 3)
+            continue;
+        if (first < 0 || second < 0 || amount < INT8_MIN || amount > INT8_MAX)
+        {
+            waterlily_log(WARNING, "Skipping invalid kerning %d, %d.", first,
+                          second);
+            continue;
+        }
+
+        if (font.kerningCount == WATERLILY_MAX_FONT_KERNINGS)
+            waterlily_report("Font has more than %d kerning pairs.",
+                             WATERLILY_MAX_FONT_KERNINGS);
+        font.kernings[font.kerningCount++] = (struct waterlily_archive_kerning){
+            .first = first,
+            .second = second,
+            .amount = amount,
+        };
+    }
+
+    qsort(font.kernings, font.kerningCount,
+          sizeof(struct waterlily_archive_kerning), compareKerning);
+}
+
+static void writeFont(waterlily_archive_buffer_t *buffer, const char *name)
+{
+    size_t nameLength = strlen(name);
+    if (nameLength > UINT8_MAX)
+        waterlily_report("Font name '%s' is too long.", name);
+    if (font.glyphCount > UINT16_MAX || font.kerningCount > UINT16_MAX)
+        waterlily_report("Font '%s' has too many entries.", name);
+
+    size_t section =
+        waterlily_beginArchiveSection(buffer, WATERLILY_FONT_SECTION_ID);
+    waterlily_appendArchiveU8(buffer, nameLength);
+    waterlily_appendArchive(buffer, name, nameLength);
+    waterlily_appendArchiveU16(buffer, font.width);
+    waterlily_appendArchiveU16(buffer, font.height);
+    waterlily_appendArchiveU16(buffer, font.lineHeight);
+    waterlily_appendArchiveU16(buffer, (uint16_t)font.ascent);
+
+    waterlily_appendArchiveU16(buffer, font.glyphCount);
+    for (size_t i = 0; i < font.glyphCount; ++i)
+    {
+        auto glyph = &font.glyphs[i].info;
+        waterlily_appendArchiveU32(buffer, glyph->codepoint);
+        waterlily_appendArchiveU16(buffer, glyph->x);
+        waterlily_appendArchiveU16(buffer, glyph->y);
+        waterlily_appendArchiveU8(buffer, glyph->width);
+        waterlily_appendArchiveU8(buffer, glyph->height);
+        waterlily_appendArchiveU8(buffer, (uint8_t)glyph->xOffset);
+        waterlily_appendArchiveU8(buffer, (uint8_t)glyph->yOffset);
+        waterlily_appendArchiveU8(buffer, glyph->advance);
+    }
+
+    waterlily_appendArchiveU16(buffer, font.kerningCount);
+    for (size_t i = 0; i < font.kerningCount; ++i)
+    {
+        waterlily_appendArchiveU32(buffer, font.kernings[i].first);
+        waterlily_appendArchiveU32(buffer, font.kernings[i].second);
+        waterlily_appendArchiveU8(buffer, (uint8_t)font.kernings[i].amount);
+    }
+
+    waterlily_appendArchive(buffer, font.pixels,
+                            (size_t)font.width * font.height);
+    waterlily_endArchiveSection(buffer, section);
+}
+
+static void bakeFont(waterlily_archive_buffer_t *buffer, const char *name)
+{
+    char filename[sizeof(WATERLILY_FONT_DIRECTORY) + strlen(name)];
+    (void)sprintf(filename, WATERLILY_FONT_DIRECTORY "%s", name);
+
+    waterlily_file_t file = {
+        .name = filename,
+        .type = WATERLILY_FONT_FILE,
+    };
+    waterlily_readFile(&file);
+    parseFont(file.text.contents);
+    waterlily_closeFile(&file);
+    packFont();
+
+    // BDF has no kerning of its own, so pairs come from an optional
+    // sidecar file of "first second amount" lines.
+    char kerningPath[sizeof(WATERLILY_ASSET_DIRECTORY) + sizeof(filename) +
+                     sizeof(".kern")];
+    (void)sprintf(kerningPath, WATERLILY_ASSET_DIRECTORY "%s.kern", filename);
+    if (access(kerningPath, R_OK) == 0)
+    {
+        file.type = WATERLILY_KERNING_FILE;
+        waterlily_readFile(&file);
+        parseKernings(file.text.contents);
+        waterlily_closeFile(&file);
+    }
+
+    writeFont(buffer, name);
+    waterlily_log(SUCCESS, "Baked font '%s' with %zu glyphs into %ux%u atlas.",
+                  name, font.glyphCount, font.width, font.height);
+
+    for (size_t i = 0; i < font.glyphCount; ++i)
+        free(font.glyphs[i].bitmap);
+    free(font.pixels);
+    font.glyphCount = 0;
+    font.kerningCount = 0;
+}
+
+void waterlily_bakeFonts(waterlily_archive_buffer_t *buffer)
+{
+    WATERLILY_TRACE_SCOPE("bakeFonts");
+    DIR *directory =
+        opendir(WATERLILY_ASSET_DIRECTORY WATERLILY_FONT_DIRECTORY);
+    if (directory == nullptr)
+    {
+        waterlily_log(INFO, "No font directory, skipping fonts.");
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != nullptr)
+    {
+        char *extension = strrchr(entry->d_name, '.');
+        if (extension == nullptr || strcmp(extension, ".bdf") != 0)
+            continue;
+
+        *extension = 0;
+        bakeFont(buffer, entry->d_name);
+    }
+
+    if (closedir(directory) != 0)
+        waterlily_report("Failed to close font directory.");
+}
@@ -1 +1,137 @@
 #include <archiver/shaders.h>
+#include <dirent.h>
+#include <glslang/Include/glslang_c_interface.h>
+#include <glslang/Public/resource_limits_c.h>
+#include <internal/files.h>
+#include <internal/logging.h>
+#include <internal/trace.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const struct
+{
+    const char *extension;
+    glslang_stage_t stage;
+    uint8_t id;
+} stages[] = {
+    {".vert", GLSLANG_STAGE_VERTEX, WATERLILY_VERTEX_SHADER},
+    {".frag", GLSLANG_STAGE_FRAGMENT, WATERLILY_FRAGMENT_SHADER},
+    {".comp", GLSLANG_STAGE_COMPUTE, WATERLILY_COMPUTE_SHADER},
+};
+
+static char *readSource(const char *filename)
+{
+    char path[sizeof(WATERLILY_ASSET_DIRECTORY WATERLILY_SHADER_DIRECTORY) +
+              strlen(filename)];
+    (void)sprintf(path,
+                  WATERLILY_ASSET_DIRECTORY WATERLILY_SHADER_DIRECTORY "%s",
+                  filename);
+
+    // Shader sources don't fit any of the file types, their extension is
+    // what picks the stage.
+    FILE *handle = fopen(path, "r");
+    if (handle == nullptr)
+        waterlily_report("Failed to open shader '%s'.", path);
+
+    if (fseek(handle, 0, SEEK_END) != 0)
+        waterlily_report("Failed to seek shader '%s'.", path);
+    long size = ftell(handle);
+    rewind(handle);
+
+    char *source = malloc(size + 1);
+    if (source == nullptr)
+        waterlily_report("Failed to allocate shader '%s'.", path);
+    if (fread(source, 1, size, handle) != (size_t)size)
+        waterlily_report("Failed to read shader '%s'.", path);
+    source[size] = 0;
+
+    if (fclose(handle) != 0)
+        waterlily_report("Failed to close shader '%s'.", path);
+    return source;
+}
+
+static void compileShader(waterlily_archive_buffer_t *buffer,
+                          const char *filename, size_t stage)
+{
+    char *source = readSource(filename);
+    const glslang_input_t input = {
+        .language = GLSLANG_SOURCE_GLSL,
+        .stage = stages[stage].stage,
+        .client = GLSLANG_CLIENT_VULKAN,
+        .client_version = GLSLANG_TARGET_VULKAN_1_3,
+        .target_language = GLSLANG_TARGET_SPV,
+        .target_language_version = GLSLANG_TARGET_SPV_1_6,
+        .code = source,
+        .default_version = 460,
+        .default_profile = GLSLANG_NO_PROFILE,
+        .messages = GLSLANG_MSG_DEFAULT_BIT,
+        .resource = glslang_default_resource(),
+    };
+
+    glslang_shader_t *shader = glslang_shader_create(&input);
+    if (!glslang_shader_preprocess(shader, &input) ||
+        !glslang_shader_parse(shader, &input))
+        waterlily_report("Failed to compile shader '%s':\n%s", filename,
+                         glslang_shader_get_info_log(shader));
+
+    glslang_program_t *program = glslang_program_create();
+    glslang_program_add_shader(program, shader);
+    if (!glslang_program_link(program, GLSLANG_MSG_SPV_RULES_BIT |
+                                           GLSLANG_MSG_VULKAN_RULES_BIT))
+        waterlily_report("Failed to link shader '%s':\n%s", filename,
+                         glslang_program_get_info_log(program));
+    glslang_program_SPIRV_generate(program, input.stage);
+
+    size_t nameLength = strlen(filename) - strlen(stages[stage].extension);
+    if (nameLength > UINT8_MAX)
+        waterlily_report("Shader name '%s' is too long.", filename);
+
+    uint32_t size = glslang_program_SPIRV_get_size(program) * sizeof(uint32_t);
+    waterlily_appendArchiveU8(buffer, stages[stage].id);
+    waterlily_appendArchiveU8(buffer, nameLength);
+    waterlily_appendArchive(buffer, filename, nameLength);
+    waterlily_appendArchiveU32(buffer, size);
+    waterlily_appendArchive(buffer, glslang_program_SPIRV_get_ptr(program),
+                            size);
+    waterlily_log(SUCCESS, "Compiled shader '%s' into %u bytes.", filename,
+                  size);
+
+    glslang_program_delete(program);
+    glslang_shader_delete(shader);
+    free(source);
+}
+
+void waterlily_bakeShaders(waterlily_archive_buffer_t *buffer)
+{
+    WATERLILY_TRACE_SCOPE("bakeShaders");
+    DIR *directory =
+        opendir(WATERLILY_ASSET_DIRECTORY WATERLILY_SHADER_DIRECTORY);
+    if (directory == nullptr)
+    {
+        waterlily_log(INFO, "No shader directory, skipping shaders.");
+        return;
+    }
+
+    glslang_initialize_process();
+    size_t section =
+        waterlily_beginArchiveSection(buffer, WATERLILY_SHADER_SECTION_ID);
+
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != nullptr)
+    {
+        char *extension = strrchr(entry->d_name, '.');
+        if (extension == nullptr)
+            continue;
+
+        for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); ++i)
+            if (strcmp(extension, stages[i].extension) == 0)
+                compileShader(buffer, entry->d_name, i);
+    }
+
+    waterlily_endArchiveSection(buffer, section);
+    glslang_finalize_process();
+
+    if (closedir(directory) != 0)
+        waterlily_report("Failed to close shader directory.");
+}
@@ -0,0 +1,101 @@
+#include <archiver/tiles.h>
+#include <internal/files.h>
+#include <internal/logging.h>
+#include <internal/trace.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static void writeAnimation(waterlily_archive_buffer_t *buffer, char *line)
+{
+    char *save = nullptr;
+    char *name = strtok_r(line, " \t", &save);
+    if (name == nullptr || name[0] == '#')
+        return;
+
+    size_t nameLength = strlen(name);
+    if (nameLength > UINT8_MAX)
+        waterlily_report("Tile animation name '%s' is too long.", name);
+
+    struct waterlily_archive_tile_frame frames[WATERLILY_MAX_TILE_FRAMES];
+    size_t frameCount = 0;
+    for (char *token = strtok_r(nullptr, " \t", &save); token != nullptr;
+         token = strtok_r(nullptr, " \t", &save))
+    {
+        int x, y, duration;
+        if (sscanf(token, "%d,%d:%d", &x, &y, &duration) != 3)
+            waterlily_report("Malformed frame '%s' in tile animation '%s'.",
+                             token, name);
+        if (x < INT16_MIN || x > INT16_MAX || y < INT16_MIN ||
+            y > INT16_MAX || duration <= 0 || duration > UINT16_MAX)
+            waterlily_report("Frame '%s' of '%s' is out of range.", token,
+                             name);
+        if (frameCount == WATERLILY_MAX_TILE_FRAMES)
+            waterlily_report("Tile animation '%s' has more than %d frames.",
+                             name, WATERLILY_MAX_TILE_FRAMES);
+
+        frames[frameCount++] = (struct waterlily_archive_tile_frame){
+            .x = x,
+            .y = y,
+            .duration = duration,
+        };
+    }
+
+    if (frameCount == 0)
+        waterlily_report("Tile animation '%s' has no frames.", name);
+
+    waterlily_appendArchiveU8(buffer, nameLength);
+    waterlily_appendArchive(buffer, name, nameLength);
+    waterlily_appendArchiveU8(buffer, frameCount);
+    for (size_t i = 0; i < frameCount; ++i)
+    {
+        waterlily_appendArchiveU16(buffer, (uint16_t)frames[i].x);
+        waterlily_appendArchiveU16(buffer, (uint16_t)frames[i].y);
+        waterlily_appendArchiveU16(buffer, frames[i].duration);
+    }
+}
+
+void waterlily_bakeTileAnimations(waterlily_archive_buffer_t *buffer)
+{
+    WATERLILY_TRACE_SCOPE("bakeTileAnimations");
+    if (access(WATERLILY_ASSET_DIRECTORY WATERLILY_TILE_DIRECTORY
+               "animations.anim",
+               R_OK) != 0)
+    {
+        waterlily_log(INFO, "No tile animations, skipping them.");
+        return;
+    }
+
+    waterlily_file_t file = {
+        .name = WATERLILY_TILE_DIRECTORY "animations",
+        .type = WATERLILY_ANIMATION_FILE,
+    };
+    waterlily_readFile(&file);
+
+    size_t section = waterlily_beginArchiveSection(
+        buffer, WATERLILY_TILE_ANIMATION_SECTION_ID);
+    // The count is patched in once every line has been read.
+    size_t countOffset = buffer->size;
+    waterlily_appendArchiveU16(buffer, 0);
+
+    uint16_t count = 0;
+    char *save = nullptr;
+    for (char *line = strtok_r(file.text.contents, "\r\n", &save);
+         line != nullptr; line = strtok_r(nullptr, "\r\n", &save))
+    {
+        size_t before = buffer->size;
+        writeAnimation(buffer, line);
+        if (buffer->size == before)
+            continue;
+
+        if (count == WATERLILY_MAX_TILE_ANIMATIONS)
+            waterlily_report("More than %d tile animations.",
+                             WATERLILY_MAX_TILE_ANIMATIONS);
+        count++;
+    }
+
+    memcpy(buffer->data + countOffset, &count, sizeof(count));
+    waterlily_endArchiveSection(buffer, section);
+    waterlily_closeFile(&file);
+    waterlily_log(SUCCESS, "Baked %u tile animations.", count);
+}
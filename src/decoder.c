@@ -0,0 +1,15 @@
+#include <internal/logging.h>
+#include <stdio.h>
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        (void)fprintf(stderr, "Usage: %s FILE\nPrint a binary log as text.\n",
+                      argv[0]);
+        return -1;
+    }
+
+    waterlily_printBinaryLog(argv[1]);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <internal/clock.h>
+#include <internal/events.h>
+#include <internal/logging.h>
+#include <time.h>
+
+static struct waterlily_clock_context context = {0};
+
+uint64_t waterlily_getClockTime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void tick(uint64_t, void *)
+{
+    // Waking the loop is all this is for, the time is read when advancing.
+}
+
+struct waterlily_clock_context *waterlily_createClockContext(void)
+{
+    context.last = waterlily_getClockTime();
+    context.timer =
+        waterlily_createEventTimer(WATERLILY_TICK_NS, tick, nullptr);
+    waterlily_log(SUCCESS, "Created clock at %d ticks per second.",
+                  WATERLILY_TICK_RATE);
+    return &context;
+}
+
+uint32_t waterlily_advanceClock(void)
+{
+    uint64_t now = waterlily_getClockTime();
+    context.accumulator += now - context.last;
+    context.last = now;
+
+    constexpr uint64_t limit = WATERLILY_TICK_NS * WATERLILY_MAX_FRAME_TICKS;
+    if (context.accumulator > limit)
+    {
+        waterlily_log(WARNING, "Dropped %zu ms of simulation time.",
+                      (size_t)((context.accumulator - limit) / 1000000));
+        context.accumulator = limit;
+    }
+
+    uint32_t ticks = context.accumulator / WATERLILY_TICK_NS;
+    context.accumulator -= ticks * WATERLILY_TICK_NS;
+    context.ticks += ticks;
+    // How far the frame sits between the last tick and the next one, for
+    // interpolating whatever was simulated.
+    context.alpha = (float)context.accumulator / WATERLILY_TICK_NS;
+    return ticks;
+}
+
+void waterlily_throttleClock(bool throttled)
+{
+    if (context.throttled == throttled)
+        return;
+
+    // The simulation keeps its fixed step, it just catches up in bigger
+    // batches between wakes.
+    context.throttled = throttled;
+    uint64_t interval = throttled ? WATERLILY_BACKGROUND_NS : WATERLILY_TICK_NS;
+    waterlily_setEventTimer(context.timer, interval, interval);
+    waterlily_log(INFO, "Clock now wakes %d times per second.",
+                  throttled ? WATERLILY_BACKGROUND_RATE : WATERLILY_TICK_RATE);
+}
+
+uint64_t waterlily_getClockTicks(void)
+{
+    return context.ticks;
+}
+
+float waterlily_getClockAlpha(void)
+{
+    return context.alpha;
+}
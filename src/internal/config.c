@@ -1,6 +1,7 @@
 #include <internal/config.h>
 #include <internal/files.h>
 #include <internal/logging.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -30,30 +31,94 @@ static void digestArguments(int argc, const char *const *const argv)
                              currentArg);
         currentArg += 2;
 
+        // These have to show up whatever the log level, so they skip it.
         if (strcmp(currentArg, "help") == 0)
         {
-            waterlily_log(
-                INFO, "Usage: app [OPTIONS]\nOptions:\n\t--help: Display this "
-                      "help message and exit.\n\t--license: Display licensing "
-                      "information and exit.\n\n\t--fps: Display an FPS "
-                      "counter once in-game.");
+            waterlily_flushLogs();
+            (void)puts(
+                "Usage: app [OPTIONS]\nOptions:\n\t--help: Display this help "
+                "message and exit.\n\t--license: Display licensing "
+                "information and exit.\n\n\t--fps: Log the frame rate and "
+                "input latency every second.\n\t--stats=FRAMES: Log frame "
+                "time percentiles every FRAMES frames.\n\t--log=LEVEL: Only "
+                "log info, success or warning messages and up.\n\t"
+                "--binary-log=FILE: "
+                "Log to FILE unformatted, for waterlilydecoder to read.\n\t"
+                "--trace=FILE: Write a Chrome trace to FILE at exit or on "
+                "SIGUSR1.\n\t--record=FILE: Record all key input to FILE.\n\t"
+                "--replay=FILE: Play back the input recorded in FILE.\n\t"
+                "--particles=COUNT: Benchmark COUNT particles, then exit.\n\t"
+                "--headless: Run without a compositor, needs --replay or "
+                "--particles.");
             exit(0);
         }
         else if (strcmp(currentArg, "license") == 0)
         {
-            waterlily_log(
-                INFO, "Copyright (c) 2025 - Israfil Argos\nThis software is "
-                      "under the GPLv3. This program may be repackaged and "
-                      "redistributed under the terms of that license.\nYou "
-                      "should have recieved a copy of the license alongside "
-                      "your copy of this program,\nbut if you did not, you can "
-                      "find it at <https://www.gnu.org/licenses/gpl-3.0.txt>");
+            waterlily_flushLogs();
+            (void)puts(
+                "Copyright (c) 2025 - Israfil Argos\nThis software is under "
+                "the GPLv3. This program may be repackaged and redistributed "
+                "under the terms of that license.\nYou should have recieved "
+                "a copy of the license alongside your copy of this "
+                "program,\nbut if you did not, you can find it at "
+                "<https://www.gnu.org/licenses/gpl-3.0.txt>");
             exit(0);
         }
         else if (strcmp(currentArg, "fps") == 0)
             config.arguments.displayFPS = true;
+        else if (strcmp(currentArg, "headless") == 0)
+            config.arguments.headless = true;
+        else if (strncmp(currentArg, "log=", 4) == 0)
+        {
+            static const char *const levels[] = {
+                [WATERLILY_LOG_TYPE_INFO] = "info",
+                [WATERLILY_LOG_TYPE_SUCCESS] = "success",
+                [WATERLILY_LOG_TYPE_WARNING] = "warning",
+            };
+            size_t level = 0;
+            constexpr size_t count = sizeof(levels) / sizeof(levels[0]);
+            while (level < count && strcmp(currentArg + 4, levels[level]) != 0)
+                level++;
+            if (level == count)
+                waterlily_report("Unknown log level '%s'.", currentArg + 4);
+            waterlily_setLogLevel(level);
+        }
+        else if (strncmp(currentArg, "binary-log=", 11) == 0)
+            waterlily_openBinaryLog(currentArg + 11);
+        else if (strncmp(currentArg, "record=", 7) == 0)
+            config.arguments.record = currentArg + 7;
+        else if (strncmp(currentArg, "replay=", 7) == 0)
+            config.arguments.replay = currentArg + 7;
+        else if (strncmp(currentArg, "trace=", 6) == 0)
+            config.arguments.trace = currentArg + 6;
+        else if (strncmp(currentArg, "stats=", 6) == 0)
+        {
+            char *end;
+            unsigned long frames = strtoul(currentArg + 6, &end, 10);
+            if (*end != 0 || end == currentArg + 6 || frames == 0 ||
+                frames > UINT32_MAX)
+                waterlily_report("Invalid statistics window '%s'.",
+                                 currentArg + 6);
+            config.arguments.stats = frames;
+        }
+        else if (strncmp(currentArg, "particles=", 10) == 0)
+        {
+            char *end;
+            unsigned long count = strtoul(currentArg + 10, &end, 10);
+            if (*end != 0 || end == currentArg + 10 || count == 0 ||
+                count > UINT32_MAX)
+                waterlily_report("Invalid particle count '%s'.",
+                                 currentArg + 10);
+            config.arguments.particles = count;
+        }
     }
 
+    // Nothing could ever end a headless run otherwise.
+    if (config.arguments.headless && config.arguments.replay == nullptr &&
+        config.arguments.particles == 0)
+        waterlily_report("Running headless needs an input replay or a "
+                         "particle benchmark.");
+
     waterlily_log(SUCCESS, "Parsed all provided arguments.");
 }
 
@@ -64,6 +129,8 @@ static void readConfiguration(void)
         .type = WATERLILY_CONFIG_FILE,
     };
     waterlily_readFile(&file);
+    config.throttle = true;
+    config.scale = 1.0f;
 
     for (size_t i = 0; i < file.config.pairCount; ++i)
     {
@@ -77,7 +144,16 @@ static void readConfiguration(void)
                 config.author = readConfig.value.author;
                 break;
             case WATERLILY_CONFIG_VERSION_KEY:
-                config.version = readConfig.value.author;
+                config.version = readConfig.value.version;
+                break;
+            case WATERLILY_CONFIG_DEVICE_KEY:
+                config.device = readConfig.value.device;
+                break;
+            case WATERLILY_CONFIG_THROTTLE_KEY:
+                config.throttle = readConfig.value.throttle;
+                break;
+            case WATERLILY_CONFIG_SCALE_KEY:
+                config.scale = readConfig.value.scale;
                 break;
             default:
                 waterlily_report("Got unknown engine configuration key '%d'.",
@@ -0,0 +1,156 @@
+#include <errno.h>
+#include <internal/events.h>
+#include <internal/logging.h>
+#include <internal/trace.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+static struct waterlily_event_context context = {0};
+
+static void addSource(int descriptor, waterlily_event_type_t type,
+                      waterlily_event_callback_t callback, void *data)
+{
+    for (size_t i = 0; i < WATERLILY_MAX_EVENT_SOURCES; ++i)
+    {
+        struct waterlily_event_source *source = &context.sources[i];
+        if (source->used)
+            continue;
+
+        *source = (struct waterlily_event_source){
+            .descriptor = descriptor,
+            .type = type,
+            .used = true,
+            .generation = source->generation + 1,
+            .callback = callback,
+            .data = data,
+        };
+        struct epoll_event event = {
+            .events = EPOLLIN,
+            .data.u64 = (uint64_t)source->generation << 32 | i,
+        };
+        if (epoll_ctl(context.epoll, EPOLL_CTL_ADD, descriptor, &event) == -1)
+            waterlily_report("Failed to watch descriptor %d, code %d.",
+                             descriptor, errno);
+        return;
+    }
+
+    waterlily_report("Ran out of event sources.");
+}
+
+struct waterlily_event_context *waterlily_createEventContext(void)
+{
+    context.epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (context.epoll == -1)
+        waterlily_report("Failed to create event loop, code %d.", errno);
+
+    waterlily_log(SUCCESS, "Created event loop.");
+    return &context;
+}
+
+void waterlily_destroyEventContext(void)
+{
+    for (size_t i = 0; i < WATERLILY_MAX_EVENT_SOURCES; ++i)
+        if (context.sources[i].used)
+            waterlily_unwatchEvents(context.sources[i].descriptor);
+    close(context.epoll);
+}
+
+void waterlily_watchEvents(int descriptor, waterlily_event_callback_t callback,
+                           void *data)
+{
+    addSource(descriptor, WATERLILY_EVENT_FILE, callback, data);
+}
+
+int waterlily_createEventTimer(uint64_t interval,
+                               waterlily_event_callback_t callback, void *data)
+{
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer == -1)
+        waterlily_report("Failed to create timer, code %d.", errno);
+
+    addSource(timer, WATERLILY_EVENT_TIMER, callback, data);
+    waterlily_setEventTimer(timer, interval, interval);
+    return timer;
+}
+
+void waterlily_setEventTimer(int timer, uint64_t delay, uint64_t interval)
+{
+    // Zero for both disarms the timer.
+    struct itimerspec time = {
+        .it_interval = {interval / 1000000000, interval % 1000000000},
+        .it_value = {delay / 1000000000, delay % 1000000000},
+    };
+    if (timerfd_settime(timer, 0, &time, nullptr) == -1)
+        waterlily_report("Failed to arm timer, code %d.", errno);
+}
+
+int waterlily_createEventSignal(waterlily_event_callback_t callback,
+                                void *data)
+{
+    int signal = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (signal == -1)
+        waterlily_report("Failed to create event signal, code %d.", errno);
+
+    addSource(signal, WATERLILY_EVENT_SIGNAL, callback, data);
+    return signal;
+}
+
+void waterlily_signalEvent(int signal)
+{
+    // Safe from any thread, this is how workers wake the loop.
+    uint64_t count = 1;
+    if (write(signal, &count, sizeof(count)) != sizeof(count))
+        waterlily_log(WARNING, "Failed to signal event %d.", signal);
+}
+
+void waterlily_unwatchEvents(int descriptor)
+{
+    for (size_t i = 0; i < WATERLILY_MAX_EVENT_SOURCES; ++i)
+    {
+        struct waterlily_event_source *source = &context.sources[i];
+        if (!source->used || source->descriptor != descriptor)
+            continue;
+
+        (void)epoll_ctl(context.epoll, EPOLL_CTL_DEL, descriptor, nullptr);
+        // The loop only owns what it created.
+        if (source->type != WATERLILY_EVENT_FILE)
+            close(descriptor);
+        source->used = false;
+        return;
+    }
+}
+
+void waterlily_waitEvents(int timeout)
+{
+    struct epoll_event events[WATERLILY_MAX_EVENT_SOURCES];
+    int count;
+    do
+        count = epoll_wait(context.epoll, events, WATERLILY_MAX_EVENT_SOURCES,
+                           timeout);
+    while (count == -1 && errno == EINTR);
+    if (count == -1)
+        waterlily_report("Failed to wait for events, code %d.", errno);
+
+    for (int i = 0; i < count; ++i)
+    {
+        // A callback earlier in the batch may have unwatched this source, or
+        // even handed its slot to another descriptor.
+        struct waterlily_event_source *source =
+            &context.sources[(uint32_t)events[i].data.u64];
+        if (!source->used || source->generation != events[i].data.u64 >> 32)
+            continue;
+
+        uint64_t value = 0;
+        // Timers and signals keep waking the loop until they're drained.
+        if (source->type != WATERLILY_EVENT_FILE &&
+            read(source->descriptor, &value, sizeof(value)) != sizeof(value))
+            continue;
+        WATERLILY_TRACE_SCOPE(
+            source->type == WATERLILY_EVENT_FILE    ? "fileEvent"
+            : source->type == WATERLILY_EVENT_TIMER ? "timerEvent"
+                                                    : "signalEvent");
+        source->callback(value, source->data);
+    }
+}
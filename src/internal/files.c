@@ -1,5 +1,6 @@
 #include <internal/files.h>
 #include <internal/logging.h>
+#include <internal/trace.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -47,6 +48,9 @@ static void compileShaders(void)
     waterlily_log(SUCCESS, "Compiled all shaders.");
 }
 
+// The longest extension ("waterlily") plus its dot.
+#define WATERLILY_EXTENSION_LENGTH 10
+
 static void getFilepath(char *filepath, waterlily_file_t *file)
 {
     static const char *extensions[] = {
@@ -55,6 +59,9 @@ static void getFilepath(char *filepath, waterlily_file_t *file)
         [WATERLILY_FRAGMENT_SHADER_FILE] = "frag",
         [WATERLILY_VERTEX_SHADER_FILE] = "vert",
         [WATERLILY_ARCHIVE_FILE] = "waterlily",
+        [WATERLILY_FONT_FILE] = "bdf",
+        [WATERLILY_KERNING_FILE] = "kern",
+        [WATERLILY_ANIMATION_FILE] = "anim",
     };
 
     (void)sprintf(filepath, WATERLILY_ASSET_DIRECTORY "%s.%s", file->name,
@@ -95,6 +102,39 @@ static void digestValue(char *key, char *value, char *ch,
                     .value.version = strndup(value, ch - value),
                 };
             break;
+        case WATERLILY_CONFIG_DEVICE_KEY:
+            file->config.pairs[file->config.pairCount] =
+                (typeof(file->config.pairs[0])){
+                    .key = keyType,
+                    .value.device = strndup(value, ch - value),
+                };
+            break;
+        case WATERLILY_CONFIG_THROTTLE_KEY:
+            file->config.pairs[file->config.pairCount] =
+                (typeof(file->config.pairs[0])){
+                    .key = keyType,
+                    .value.throttle = strncmp(value, "off", 3) != 0 &&
+                                      strncmp(value, "false", 5) != 0,
+                };
+            break;
+        case WATERLILY_CONFIG_SCALE_KEY:
+        {
+            // "native" is the same as 1, matching the output exactly.
+            float scale = strncmp(value, "native", 6) == 0
+                              ? 1.0f
+                              : strtof(value, nullptr);
+            if (scale <= 0.0f || scale > 2.0f)
+            {
+                *ch = 0;
+                waterlily_report("Render scale '%s' out of range.", value);
+            }
+            file->config.pairs[file->config.pairCount] =
+                (typeof(file->config.pairs[0])){
+                    .key = keyType,
+                    .value.scale = scale,
+                };
+            break;
+        }
         default:
             waterlily_report("Unimplement configuration key %d.", keyType);
     }
@@ -142,12 +182,19 @@ static void parseConfig(waterlily_file_t *file)
                 keyType = WATERLILY_CONFIG_AUTHOR_KEY;
             else if (strncmp(key, "version", 7) == 0)
                 keyType = WATERLILY_CONFIG_VERSION_KEY;
+            else if (strncmp(key, "device", 6) == 0)
+                keyType = WATERLILY_CONFIG_DEVICE_KEY;
+            else if (strncmp(key, "throttle", 8) == 0)
+                keyType = WATERLILY_CONFIG_THROTTLE_KEY;
+            else if (strncmp(key, "scale", 5) == 0)
+                keyType = WATERLILY_CONFIG_SCALE_KEY;
             else
             {
                 *ch = 0;
                 waterlily_report("Found unknown configuration key '%s'.", key);
             }
-            value = ch;
+            // The value starts after the separator, not on it.
+            value = ch + 1;
             continue;
         }
         else if (*ch != '\n')
@@ -186,78 +233,234 @@ static void parseShaderArchive(waterlily_file_t *file)
     }
 }
 
-static void parseShaderArchiveSection(char **cursor,
+// Archives are binary and may contain zeroes anywhere, so they're walked with
+// an explicit end instead of looking for a terminator.
+struct reader
+{
+    const uint8_t *cursor;
+    const uint8_t *end;
+};
+
+static const uint8_t *readBytes(struct reader *reader, size_t count)
+{
+    if ((size_t)(reader->end - reader->cursor) < count)
+        waterlily_report("Archive truncated, wanted %zu more bytes.", count);
+
+    const uint8_t *bytes = reader->cursor;
+    reader->cursor += count;
+    return bytes;
+}
+
+static uint8_t readU8(struct reader *reader) { return *readBytes(reader, 1); }
+
+static uint16_t readU16(struct reader *reader)
+{
+    uint16_t value;
+    memcpy(&value, readBytes(reader, sizeof(value)), sizeof(value));
+    return value;
+}
+
+static uint32_t readU32(struct reader *reader)
+{
+    uint32_t value;
+    memcpy(&value, readBytes(reader, sizeof(value)), sizeof(value));
+    return value;
+}
+
+static void *copyBytes(struct reader *reader, size_t count)
+{
+    void *copy = malloc(count + 1);
+    if (copy == nullptr)
+        waterlily_report("Failed to allocate %zu archive bytes.", count);
+    memcpy(copy, readBytes(reader, count), count);
+    ((uint8_t *)copy)[count] = 0;
+    return copy;
+}
+
+static void parseShaderArchiveSection(struct reader *reader,
                                       struct waterlily_archive_section *section)
 {
-    (*cursor)++;
-    while (**cursor != 0)
+    while (reader->cursor != reader->end)
     {
         section->count++;
         section->shaders = realloc(
-            &section->shaders,
+            section->shaders,
             sizeof(struct waterlily_archive_shader_section) * section->count);
-        section->shaders[section->count - 1].type = **cursor;
-        if (**cursor != 0x0 && **cursor != 0x1)
-            waterlily_report("Got unknown shader stage '%x'.", **cursor);
-
-        (*cursor)++;
-        section->shaders[section->count - 1].size = *(uint16_t *)(*cursor);
-        section->shaders[section->count - 1].code = (uint32_t *)strndup(
-            *cursor, section->shaders[section->count - 1].size);
-        (*cursor) += section->shaders[section->count - 1].size;
+        if (section->shaders == nullptr)
+            waterlily_report("Failed to allocate shader section.");
+
+        auto shader = &section->shaders[section->count - 1];
+        uint8_t stage = readU8(reader);
+        if (stage != WATERLILY_VERTEX_SHADER &&
+            stage != WATERLILY_FRAGMENT_SHADER &&
+            stage != WATERLILY_COMPUTE_SHADER)
+            waterlily_report("Got unknown shader stage '%x'.", stage);
+
+        shader->type = stage;
+        shader->name = copyBytes(reader, readU8(reader));
+        shader->size = readU32(reader);
+        shader->code = copyBytes(reader, shader->size);
     }
 }
 
-static void parseAssetArchiveFile(waterlily_file_t *file)
+static void parseFontArchiveSection(struct reader *reader,
+                                    struct waterlily_archive_section *section)
 {
-    char *cursor = (char *)file->text.contents;
-    while (*cursor != 0)
+    struct waterlily_archive_font_section *font = calloc(1, sizeof(*font));
+    if (font == nullptr)
+        waterlily_report("Failed to allocate font section.");
+    section->font = font;
+    section->count = 1;
+
+    font->name = copyBytes(reader, readU8(reader));
+    font->width = readU16(reader);
+    font->height = readU16(reader);
+    font->lineHeight = readU16(reader);
+    font->ascent = (int16_t)readU16(reader);
+
+    font->glyphCount = readU16(reader);
+    font->glyphs = malloc(sizeof(*font->glyphs) * font->glyphCount);
+    if (font->glyphs == nullptr && font->glyphCount != 0)
+        waterlily_report("Failed to allocate %zu glyphs.", font->glyphCount);
+    for (size_t i = 0; i < font->glyphCount; ++i)
+    {
+        auto glyph = &font->glyphs[i];
+        glyph->codepoint = readU32(reader);
+        glyph->x = readU16(reader);
+        glyph->y = readU16(reader);
+        glyph->width = readU8(reader);
+        glyph->height = readU8(reader);
+        glyph->xOffset = (int8_t)readU8(reader);
+        glyph->yOffset = (int8_t)readU8(reader);
+        glyph->advance = readU8(reader);
+    }
+
+    font->kerningCount = readU16(reader);
+    font->kernings = malloc(sizeof(*font->kernings) * font->kerningCount);
+    if (font->kernings == nullptr && font->kerningCount != 0)
+        waterlily_report("Failed to allocate %zu kerning pairs.",
+                         font->kerningCount);
+    for (size_t i = 0; i < font->kerningCount; ++i)
     {
-        switch (*cursor)
+        font->kernings[i].first = readU32(reader);
+        font->kernings[i].second = readU32(reader);
+        font->kernings[i].amount = (int8_t)readU8(reader);
+    }
+
+    font->pixels = copyBytes(reader, (size_t)font->width * font->height);
+    if (reader->cursor != reader->end)
+        waterlily_report("Font '%s' has trailing data.", font->name);
+    waterlily_log(INFO, "Got font '%s' with %zu glyphs.", font->name,
+                  font->glyphCount);
+}
+
+static void
+parseTileAnimationArchiveSection(struct reader *reader,
+                                 struct waterlily_archive_section *section)
+{
+    section->count = readU16(reader);
+    section->animations = calloc(section->count, sizeof(*section->animations));
+    if (section->animations == nullptr && section->count != 0)
+        waterlily_report("Failed to allocate %zu tile animations.",
+                         section->count);
+
+    for (size_t i = 0; i < section->count; ++i)
+    {
+        auto animation = &section->animations[i];
+        animation->name = copyBytes(reader, readU8(reader));
+        animation->frameCount = readU8(reader);
+        animation->frames =
+            malloc(sizeof(*animation->frames) * animation->frameCount);
+        if (animation->frames == nullptr && animation->frameCount != 0)
+            waterlily_report("Failed to allocate frames of '%s'.",
+                             animation->name);
+
+        for (size_t j = 0; j < animation->frameCount; ++j)
         {
-            case 0x0:
-                file->archive.assets.sectionCount++;
-                file->archive.assets.sections =
-                    realloc(file->archive.assets.sections,
-                            sizeof(struct waterlily_archive_section) *
-                                file->archive.assets.sectionCount);
-                file->archive.assets
-                    .sections[file->archive.assets.sectionCount - 1]
-                    .type = WATERLILY_SHADER_SECTION;
-                parseShaderArchiveSection(
-                    &cursor,
-                    &file->archive.assets
-                         .sections[file->archive.assets.sectionCount - 1]);
+            animation->frames[j].x = (int16_t)readU16(reader);
+            animation->frames[j].y = (int16_t)readU16(reader);
+            animation->frames[j].duration = readU16(reader);
+        }
+    }
+    waterlily_log(INFO, "Got %zu tile animations.", section->count);
+}
+
+static void parseAssetArchiveFile(struct reader *reader,
+                                  waterlily_file_t *file)
+{
+    struct waterlily_archive_section *sections = nullptr;
+    size_t sectionCount = 0;
+
+    while (reader->cursor != reader->end)
+    {
+        uint8_t id = readU8(reader);
+        uint32_t length = readU32(reader);
+        struct reader sectionReader = {
+            .cursor = readBytes(reader, length),
+            .end = reader->cursor,
+        };
+
+        struct waterlily_archive_section section = {0};
+        switch (id)
+        {
+            case WATERLILY_SHADER_SECTION_ID:
+                section.type = WATERLILY_SHADER_SECTION;
+                parseShaderArchiveSection(&sectionReader, &section);
+                break;
+            case WATERLILY_FONT_SECTION_ID:
+                section.type = WATERLILY_FONT_SECTION;
+                parseFontArchiveSection(&sectionReader, &section);
+                break;
+            case WATERLILY_TILE_ANIMATION_SECTION_ID:
+                section.type = WATERLILY_TILE_ANIMATION_SECTION;
+                parseTileAnimationArchiveSection(&sectionReader, &section);
                 break;
             default:
-                waterlily_report("Unknown asset archive section ID '%x'.",
-                                 *cursor);
+                waterlily_log(WARNING, "Skipping unknown archive section '%x'.",
+                              id);
+                continue;
         }
+
+        sections = realloc(sections, sizeof(section) * (sectionCount + 1));
+        if (sections == nullptr)
+            waterlily_report("Failed to allocate archive sections.");
+        sections[sectionCount++] = section;
     }
+
+    file->archive.type = WATERLILY_ASSET_ARCHIVE;
+    file->archive.assets.sections = sections;
+    file->archive.assets.sectionCount = sectionCount;
 }
 
-static void parseArchiveFile(waterlily_file_t *file)
+static void parseArchiveFile(waterlily_file_t *file, size_t size)
 {
-    switch (*file->text.contents)
+    if (size == 0)
+        waterlily_report("Got empty archive file.");
+
+    struct reader reader = {
+        .cursor = (const uint8_t *)file->text.contents,
+        .end = (const uint8_t *)file->text.contents + size,
+    };
+    uint8_t type = readU8(&reader);
+    switch (type)
     {
-        case 0x0:
-            file->archive.type = WATERLILY_ASSET_ARCHIVE;
+        case WATERLILY_ASSET_ARCHIVE_ID:
             waterlily_log(INFO, "Got asset archive.");
-            parseAssetArchiveFile(file);
+            parseAssetArchiveFile(&reader, file);
             break;
         default:
-            waterlily_report("Got unknown archive file type '%x'",
-                             *file->text.contents);
+            waterlily_report("Got unknown archive file type '%x'", type);
     }
 }
 
 void waterlily_readFile(waterlily_file_t *file)
 {
+    WATERLILY_TRACE_SCOPE("readFile");
     waterlily_log(INFO, "Opening file '%s' of type %d.", file->name,
                   file->type);
 
-    size_t filepathLength =
-        sizeof(WATERLILY_ASSET_DIRECTORY) + strlen(file->name) + 5;
+    size_t filepathLength = sizeof(WATERLILY_ASSET_DIRECTORY) +
+                            strlen(file->name) + WATERLILY_EXTENSION_LENGTH;
     char filepath[filepathLength];
     getFilepath(filepath, file);
 
@@ -280,7 +483,11 @@ void waterlily_readFile(waterlily_file_t *file)
         waterlily_report("Failed to stat file.");
     waterlily_log(SUCCESS, "Statted file.");
 
-    char contents[stat.st_size + 1];
+    // Archives carry whole font atlases now, far too much for the stack.
+    char *contents = malloc(stat.st_size + 1);
+    if (contents == nullptr)
+        waterlily_report("Failed to allocate %zu bytes for file.",
+                         (size_t)stat.st_size + 1);
     size_t read = fread(contents, 1, stat.st_size, handle);
     if (read != (size_t)stat.st_size)
         waterlily_report("Failed to read file, could only read %zu bytes.",
@@ -297,20 +504,29 @@ void waterlily_readFile(waterlily_file_t *file)
     {
         case WATERLILY_TEXT_FILE:
             [[fallthrough]];
+        case WATERLILY_FONT_FILE:
+            [[fallthrough]];
+        case WATERLILY_KERNING_FILE:
+            [[fallthrough]];
+        case WATERLILY_ANIMATION_FILE:
+            [[fallthrough]];
         case WATERLILY_VERTEX_SHADER_FILE:
             [[fallthrough]];
         case WATERLILY_FRAGMENT_SHADER_FILE:
-            file->text.contents = strdup(contents);
+            // Text files keep the buffer as their contents.
             file->text.size = stat.st_size;
             break;
         case WATERLILY_SHADER_FILE:
+            // The shaders point into the buffer, so it stays too.
             parseShaderArchive(file);
             break;
         case WATERLILY_CONFIG_FILE:
             parseConfig(file);
+            free(contents);
             break;
         case WATERLILY_ARCHIVE_FILE:
-            parseArchiveFile(file);
+            parseArchiveFile(file, stat.st_size);
+            free(contents);
             break;
     }
 }
@@ -320,8 +536,8 @@ void waterlily_writeFile(waterlily_file_t *file, bool append)
     waterlily_log(INFO, "Writing to file '%s' of type %d.", file->name,
                   file->type);
 
-    size_t filepathLength =
-        sizeof(WATERLILY_ASSET_DIRECTORY) + strlen(file->name) + 5;
+    size_t filepathLength = sizeof(WATERLILY_ASSET_DIRECTORY) +
+                            strlen(file->name) + WATERLILY_EXTENSION_LENGTH;
     char filepath[filepathLength];
     getFilepath(filepath, file);
 
@@ -341,5 +557,84 @@ void waterlily_writeFile(waterlily_file_t *file, bool append)
     waterlily_log(INFO, "Closed file handle.");
 }
 
-void waterlily_closeFile(waterlily_file_t *file) { (void)file; }
+static void closeArchiveSection(struct waterlily_archive_section *section)
+{
+    switch (section->type)
+    {
+        case WATERLILY_SHADER_SECTION:
+            for (size_t i = 0; i < section->count; ++i)
+            {
+                free(section->shaders[i].name);
+                free(section->shaders[i].code);
+            }
+            free(section->shaders);
+            break;
+        case WATERLILY_FONT_SECTION:
+            free(section->font->name);
+            free(section->font->glyphs);
+            free(section->font->kernings);
+            free(section->font->pixels);
+            free(section->font);
+            break;
+        case WATERLILY_TILE_ANIMATION_SECTION:
+            for (size_t i = 0; i < section->count; ++i)
+            {
+                free(section->animations[i].name);
+                free(section->animations[i].frames);
+            }
+            free(section->animations);
+            break;
+    }
+}
+
+void waterlily_closeFile(waterlily_file_t *file)
+{
+    switch (file->type)
+    {
+        case WATERLILY_TEXT_FILE:
+            [[fallthrough]];
+        case WATERLILY_FONT_FILE:
+            [[fallthrough]];
+        case WATERLILY_KERNING_FILE:
+            [[fallthrough]];
+        case WATERLILY_ANIMATION_FILE:
+            [[fallthrough]];
+        case WATERLILY_VERTEX_SHADER_FILE:
+            [[fallthrough]];
+        case WATERLILY_FRAGMENT_SHADER_FILE:
+            free(file->text.contents);
+            file->text.contents = nullptr;
+            break;
+        case WATERLILY_SHADER_FILE:
+            // The first shader starts at the buffer they were all read into.
+            free(file->shader[0].code);
+            for (size_t i = 0; i < WATERLILY_SHADER_STAGES; ++i)
+                file->shader[i].code = nullptr;
+            break;
+        case WATERLILY_ARCHIVE_FILE:
+            for (size_t i = 0; i < file->archive.assets.sectionCount; ++i)
+                closeArchiveSection(&file->archive.assets.sections[i]);
+            free(file->archive.assets.sections);
+            file->archive.assets.sections = nullptr;
+            file->archive.assets.sectionCount = 0;
+            break;
+        default:
+            break;
+    }
+}
 
+const struct waterlily_archive_shader_section *
+waterlily_findArchiveShader(const waterlily_file_t *archive, const char *name)
+{
+    for (size_t i = 0; i < archive->archive.assets.sectionCount; ++i)
+    {
+        auto section = &archive->archive.assets.sections[i];
+        if (section->type != WATERLILY_SHADER_SECTION)
+            continue;
+
+        for (size_t j = 0; j < section->count; ++j)
+            if (strcmp(section->shaders[j].name, name) == 0)
+                return &section->shaders[j];
+    }
+    return nullptr;
+}
@@ -0,0 +1,307 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <internal/events.h>
+#include <internal/gamepad.h>
+#include <internal/input.h>
+#include <internal/logging.h>
+#include <linux/input.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct waterlily_gamepad_context context = {0};
+
+// These follow the button and axis enums.
+static const uint16_t buttonCodes[WATERLILY_GAMEPAD_BUTTONS] = {
+    BTN_SOUTH,  BTN_EAST,       BTN_NORTH,     BTN_WEST,
+    BTN_TL,     BTN_TR,         BTN_TL2,       BTN_TR2,
+    BTN_SELECT, BTN_START,      BTN_MODE,      BTN_THUMBL,
+    BTN_THUMBR, BTN_DPAD_UP,    BTN_DPAD_DOWN, BTN_DPAD_LEFT,
+    BTN_DPAD_RIGHT,
+};
+static const uint16_t axisCodes[WATERLILY_GAMEPAD_AXES] = {
+    ABS_X, ABS_Y, ABS_RX, ABS_RY, ABS_Z, ABS_RZ,
+};
+
+static bool testBit(const uint8_t *bits, uint32_t bit)
+{
+    return (bits[bit / 8] >> (bit % 8)) & 1;
+}
+
+static void setButton(uint32_t index, waterlily_gamepad_button_t button,
+                      bool down, uint64_t timestamp)
+{
+    struct waterlily_gamepad *pad = &context.pads[index];
+    uint32_t bit = 1U << button;
+    if (((pad->buttons & bit) != 0) == down)
+        return;
+
+    pad->buttons ^= bit;
+    waterlily_queueKey(&(waterlily_key_t){
+        .timestamp = timestamp,
+        .symbol = WATERLILY_KEY_GAMEPAD(index, button),
+        .state = down ? WATERLILY_KEY_STATE_DOWN : WATERLILY_KEY_STATE_UP,
+    });
+}
+
+static void setHat(uint32_t index, uint16_t code, int32_t value,
+                   uint64_t timestamp)
+{
+    // Plenty of pads report their d-pad as a hat instead of buttons.
+    bool horizontal = code == ABS_HAT0X;
+    setButton(index,
+              horizontal ? WATERLILY_GAMEPAD_LEFT : WATERLILY_GAMEPAD_UP,
+              value < 0, timestamp);
+    setButton(index,
+              horizontal ? WATERLILY_GAMEPAD_RIGHT : WATERLILY_GAMEPAD_DOWN,
+              value > 0, timestamp);
+}
+
+static void setAxis(uint32_t index, uint16_t code, int32_t value)
+{
+    struct waterlily_gamepad *pad = &context.pads[index];
+    for (size_t i = 0; i < WATERLILY_GAMEPAD_AXES; ++i)
+    {
+        if (axisCodes[i] != code)
+            continue;
+
+        auto range = &pad->ranges[i];
+        if (range->maximum == range->minimum)
+            return;
+        float position = (float)(value - range->minimum) /
+                         (range->maximum - range->minimum);
+        // Triggers rest at zero, sticks in the middle.
+        pad->axes[i] = i >= WATERLILY_GAMEPAD_LEFT_Z ? position
+                                                     : position * 2.0f - 1.0f;
+        return;
+    }
+}
+
+static void resyncPad(uint32_t index, uint64_t timestamp)
+{
+    struct waterlily_gamepad *pad = &context.pads[index];
+
+    uint8_t keys[KEY_MAX / 8 + 1] = {0};
+    if (ioctl(pad->descriptor, EVIOCGKEY(sizeof(keys)), keys) != -1)
+        for (size_t i = 0; i < WATERLILY_GAMEPAD_BUTTONS; ++i)
+            setButton(index, i, testBit(keys, buttonCodes[i]), timestamp);
+
+    struct input_absinfo info;
+    for (size_t i = 0; i < WATERLILY_GAMEPAD_AXES; ++i)
+        if (ioctl(pad->descriptor, EVIOCGABS(axisCodes[i]), &info) != -1)
+            setAxis(index, axisCodes[i], info.value);
+    uint16_t hats[] = {ABS_HAT0X, ABS_HAT0Y};
+    for (size_t i = 0; i < 2; ++i)
+        if (ioctl(pad->descriptor, EVIOCGABS(hats[i]), &info) != -1)
+            setHat(index, hats[i], info.value, timestamp);
+}
+
+static void closePad(uint32_t index)
+{
+    struct waterlily_gamepad *pad = &context.pads[index];
+    // Nothing can be held on a pad that's gone.
+    for (size_t i = 0; i < WATERLILY_GAMEPAD_BUTTONS; ++i)
+        setButton(index, i, false, 0);
+
+    waterlily_unwatchEvents(pad->descriptor);
+    close(pad->descriptor);
+    pad->used = false;
+    waterlily_log(INFO, "Disconnected gamepad %u.", index);
+}
+
+static void readPad(uint64_t, void *data)
+{
+    uint32_t index = (uintptr_t)data;
+    struct waterlily_gamepad *pad = &context.pads[index];
+
+    struct input_event events[WATERLILY_GAMEPAD_BATCH];
+    ssize_t size;
+    while ((size = read(pad->descriptor, events, sizeof(events))) > 0)
+    {
+        for (size_t i = 0; i < size / sizeof(events[0]); ++i)
+        {
+            struct input_event *event = &events[i];
+            uint64_t timestamp = event->input_event_sec * 1000 +
+                                 event->input_event_usec / 1000;
+
+            // Once the kernel's buffer overflowed, nothing until the next
+            // report can be trusted, so the state is read back whole.
+            if (pad->dropped)
+            {
+                if (event->type == EV_SYN && event->code == SYN_REPORT)
+                {
+                    pad->dropped = false;
+                    resyncPad(index, timestamp);
+                }
+                continue;
+            }
+
+            switch (event->type)
+            {
+                case EV_KEY:
+                    for (size_t j = 0; j < WATERLILY_GAMEPAD_BUTTONS; ++j)
+                        if (buttonCodes[j] == event->code)
+                            setButton(index, j, event->value != 0,
+                                      timestamp);
+                    break;
+                case EV_ABS:
+                    if (event->code == ABS_HAT0X || event->code == ABS_HAT0Y)
+                        setHat(index, event->code, event->value, timestamp);
+                    else
+                        setAxis(index, event->code, event->value);
+                    break;
+                case EV_SYN:
+                    if (event->code == SYN_DROPPED)
+                        pad->dropped = true;
+                    break;
+            }
+        }
+    }
+
+    if (size == -1 && errno == ENODEV)
+        closePad(index);
+    else if (size == -1 && errno != EAGAIN)
+        waterlily_log(WARNING, "Failed to read gamepad %u, code %d.", index,
+                      errno);
+}
+
+static void openPad(uint32_t number)
+{
+    for (size_t i = 0; i < WATERLILY_MAX_GAMEPADS; ++i)
+        if (context.pads[i].used && context.pads[i].number == number)
+            return;
+
+    char path[sizeof(WATERLILY_GAMEPAD_DIRECTORY "/event") + 10];
+    (void)snprintf(path, sizeof(path), WATERLILY_GAMEPAD_DIRECTORY "/event%u",
+                   number);
+    // Usually this is just a device we're not allowed to read, which is fine.
+    int descriptor = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (descriptor == -1)
+        return;
+
+    // Anything with gamepad or joystick buttons counts, which takes in uinput
+    // devices just the same.
+    uint8_t keys[KEY_MAX / 8 + 1] = {0};
+    if (ioctl(descriptor, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) == -1 ||
+        (!testBit(keys, BTN_GAMEPAD) && !testBit(keys, BTN_JOYSTICK)))
+    {
+        close(descriptor);
+        return;
+    }
+
+    uint32_t index = 0;
+    while (index < WATERLILY_MAX_GAMEPADS && context.pads[index].used)
+        index++;
+    if (index == WATERLILY_MAX_GAMEPADS)
+    {
+        waterlily_log(WARNING, "Ignoring '%s', too many gamepads.", path);
+        close(descriptor);
+        return;
+    }
+
+    // Event times default to the wall clock, but everything else we time
+    // against is monotonic.
+    int clock = CLOCK_MONOTONIC;
+    (void)ioctl(descriptor, EVIOCSCLOCKID, &clock);
+
+    struct waterlily_gamepad *pad = &context.pads[index];
+    *pad = (struct waterlily_gamepad){
+        .descriptor = descriptor,
+        .number = number,
+        .used = true,
+    };
+    struct input_absinfo info;
+    for (size_t i = 0; i < WATERLILY_GAMEPAD_AXES; ++i)
+        if (ioctl(descriptor, EVIOCGABS(axisCodes[i]), &info) != -1)
+            pad->ranges[i] = (typeof(pad->ranges[0])){info.minimum,
+                                                      info.maximum};
+
+    resyncPad(index, 0);
+    waterlily_watchEvents(descriptor, readPad, (void *)(uintptr_t)index);
+    waterlily_log(SUCCESS, "Connected gamepad %u from '%s'.", index, path);
+}
+
+static void readHotplug(uint64_t, void *)
+{
+    alignas(struct inotify_event) char buffer[4096];
+    ssize_t size;
+    while ((size = read(context.inotify, buffer, sizeof(buffer))) > 0)
+    {
+        for (char *cursor = buffer; cursor < buffer + size;)
+        {
+            struct inotify_event *event = (struct inotify_event *)cursor;
+            cursor += sizeof(*event) + event->len;
+            if (event->len == 0 || strncmp(event->name, "event", 5) != 0)
+                continue;
+
+            // Removal is normally caught by the read failing first.
+            uint32_t number = strtoul(event->name + 5, nullptr, 10);
+            if (event->mask & IN_DELETE)
+            {
+                for (size_t i = 0; i < WATERLILY_MAX_GAMEPADS; ++i)
+                    if (context.pads[i].used &&
+                        context.pads[i].number == number)
+                        closePad(i);
+            }
+            // udev usually only makes the node readable a moment after it
+            // appears, hence watching attribute changes too.
+            else
+                openPad(number);
+        }
+    }
+}
+
+struct waterlily_gamepad_context *waterlily_createGamepadContext(void)
+{
+    context.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (context.inotify == -1 ||
+        inotify_add_watch(context.inotify, WATERLILY_GAMEPAD_DIRECTORY,
+                          IN_CREATE | IN_ATTRIB | IN_DELETE) == -1)
+        waterlily_log(WARNING, "Failed to watch for gamepads, code %d.",
+                      errno);
+    else
+        waterlily_watchEvents(context.inotify, readHotplug, nullptr);
+
+    DIR *directory = opendir(WATERLILY_GAMEPAD_DIRECTORY);
+    if (directory != nullptr)
+    {
+        struct dirent *entry;
+        while ((entry = readdir(directory)) != nullptr)
+            if (strncmp(entry->d_name, "event", 5) == 0)
+                openPad(strtoul(entry->d_name + 5, nullptr, 10));
+        (void)closedir(directory);
+    }
+
+    waterlily_log(SUCCESS, "Created gamepad context.");
+    return &context;
+}
+
+void waterlily_destroyGamepadContext(void)
+{
+    for (size_t i = 0; i < WATERLILY_MAX_GAMEPADS; ++i)
+        if (context.pads[i].used)
+            closePad(i);
+
+    if (context.inotify > 0)
+    {
+        waterlily_unwatchEvents(context.inotify);
+        close(context.inotify);
+    }
+}
+
+bool waterlily_isGamepadConnected(uint32_t pad)
+{
+    return pad < WATERLILY_MAX_GAMEPADS && context.pads[pad].used;
+}
+
+float waterlily_getGamepadAxis(uint32_t pad, waterlily_gamepad_axis_t axis)
+{
+    if (!waterlily_isGamepadConnected(pad))
+        return 0.0f;
+    return context.pads[pad].axes[axis];
+}
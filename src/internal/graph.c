@@ -0,0 +1,784 @@
+#include <internal/graph.h>
+#include <internal/logging.h>
+#include <internal/vulkan.h>
+
+static struct waterlily_graph_context context = {0};
+
+// Everything the graph needs to know about a usage to build barriers for it.
+// Shader accesses are resolved to the stages of the pass type using them.
+static const struct
+{
+    VkPipelineStageFlags2 graphicsStages;
+    VkPipelineStageFlags2 computeStages;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+    VkImageUsageFlags imageUsage;
+    bool write;
+} usages[] = {
+    [WATERLILY_GRAPH_USAGE_COLOR_ATTACHMENT] =
+        {
+            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT |
+                VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+            true,
+        },
+    [WATERLILY_GRAPH_USAGE_SAMPLED] =
+        {
+            VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT |
+                VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_IMAGE_USAGE_SAMPLED_BIT,
+            false,
+        },
+    [WATERLILY_GRAPH_USAGE_STORAGE_READ] =
+        {
+            VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT |
+                VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_USAGE_STORAGE_BIT,
+            false,
+        },
+    [WATERLILY_GRAPH_USAGE_STORAGE_WRITE] =
+        {
+            VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT |
+                VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_USAGE_STORAGE_BIT,
+            true,
+        },
+    [WATERLILY_GRAPH_USAGE_INDIRECT] =
+        {
+            VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+            VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+            VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            0,
+            false,
+        },
+    [WATERLILY_GRAPH_USAGE_VERTEX] =
+        {
+            VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT,
+            VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT,
+            VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            0,
+            false,
+        },
+    [WATERLILY_GRAPH_USAGE_TRANSFER_SOURCE] =
+        {
+            VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            VK_ACCESS_2_TRANSFER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            false,
+        },
+    [WATERLILY_GRAPH_USAGE_TRANSFER_DESTINATION] =
+        {
+            VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            true,
+        },
+};
+
+// The hazard tracking state of a single resource while walking the passes.
+struct tracker
+{
+    VkPipelineStageFlags2 writeStages;
+    VkAccessFlags2 writeAccess;
+    VkPipelineStageFlags2 readStages;
+    VkPipelineStageFlags2 visibleStages;
+    VkImageLayout layout;
+    bool touched;
+};
+
+static uint32_t addResource(struct waterlily_graph_resource *resource)
+{
+    if (context.resourceCount == WATERLILY_GRAPH_MAX_RESOURCES)
+        waterlily_report("Too many frame graph resources (adding '%s').",
+                         resource->name);
+    if (context.compiled)
+        waterlily_report("Frame graph resource '%s' added after compile.",
+                         resource->name);
+
+    resource->firstPass = UINT32_MAX;
+    context.resources[context.resourceCount] = *resource;
+    return context.resourceCount++;
+}
+
+uint32_t waterlily_addGraphImage(const char *name, VkFormat format,
+                                 float scale)
+{
+    return addResource(&(struct waterlily_graph_resource){
+        .name = name,
+        .type = WATERLILY_GRAPH_IMAGE,
+        .image.format = format,
+        .image.scale = scale,
+    });
+}
+
+uint32_t waterlily_importGraphImage(const char *name, VkFormat format,
+                                    waterlily_graph_state_t initial,
+                                    waterlily_graph_state_t final)
+{
+    return addResource(&(struct waterlily_graph_resource){
+        .name = name,
+        .type = WATERLILY_GRAPH_IMAGE,
+        .imported = true,
+        .image.format = format,
+        .initial = initial,
+        .final = final,
+    });
+}
+
+uint32_t waterlily_importGraphBuffer(const char *name, VkBuffer buffer,
+                                     VkDeviceSize size)
+{
+    return addResource(&(struct waterlily_graph_resource){
+        .name = name,
+        .type = WATERLILY_GRAPH_BUFFER,
+        .imported = true,
+        .buffer.handle = buffer,
+        .buffer.size = size,
+    });
+}
+
+void waterlily_bindGraphImage(uint32_t resource, VkImage image,
+                              VkImageView view, VkExtent2D extent)
+{
+    struct waterlily_graph_resource *bound = &context.resources[resource];
+    bound->image.handle = image;
+    bound->image.view = view;
+    bound->image.extent = extent;
+}
+
+void waterlily_markGraphOutput(uint32_t resource)
+{
+    context.resources[resource].output = true;
+}
+
+VkImage waterlily_getGraphImage(uint32_t resource)
+{
+    return context.resources[resource].image.handle;
+}
+
+VkImageView waterlily_getGraphImageView(uint32_t resource)
+{
+    return context.resources[resource].image.view;
+}
+
+VkExtent2D waterlily_getGraphImageExtent(uint32_t resource)
+{
+    return context.resources[resource].image.extent;
+}
+
+uint32_t waterlily_addGraphPass(const char *name,
+                                waterlily_graph_pass_type_t type,
+                                waterlily_graph_record_t record, void *data)
+{
+    if (context.passCount == WATERLILY_GRAPH_MAX_PASSES)
+        waterlily_report("Too many frame graph passes (adding '%s').", name);
+    if (context.compiled)
+        waterlily_report("Frame graph pass '%s' added after compile.", name);
+
+    context.passes[context.passCount] = (struct waterlily_graph_pass){
+        .name = name,
+        .type = type,
+        .record = record,
+        .data = data,
+    };
+    return context.passCount++;
+}
+
+void waterlily_useGraphResource(uint32_t pass, uint32_t resource,
+                                waterlily_graph_usage_t usage)
+{
+    struct waterlily_graph_pass *user = &context.passes[pass];
+    if (user->accessCount == WATERLILY_GRAPH_MAX_PASS_ACCESSES)
+        waterlily_report("Too many resources used by pass '%s'.", user->name);
+
+    if (usage == WATERLILY_GRAPH_USAGE_COLOR_ATTACHMENT)
+    {
+        if (user->type != WATERLILY_GRAPH_PASS_GRAPHICS || user->rendering)
+            waterlily_report("Pass '%s' cannot take another attachment.",
+                             user->name);
+        user->rendering = true;
+        user->colorAttachment.resource = resource;
+    }
+
+    if (context.resources[resource].type == WATERLILY_GRAPH_IMAGE)
+        context.resources[resource].image.usage |= usages[usage].imageUsage;
+    user->accesses[user->accessCount++] = (struct waterlily_graph_access){
+        .resource = resource,
+        .usage = usage,
+    };
+}
+
+void waterlily_clearGraphAttachment(uint32_t pass, VkClearColorValue color)
+{
+    context.passes[pass].clears = true;
+    context.passes[pass].clearColor = color;
+}
+
+static waterlily_graph_state_t getState(const struct waterlily_graph_pass *pass,
+                                        waterlily_graph_usage_t usage)
+{
+    return (waterlily_graph_state_t){
+        .stages = pass->type == WATERLILY_GRAPH_PASS_COMPUTE
+                      ? usages[usage].computeStages
+                      : usages[usage].graphicsStages,
+        .access = usages[usage].access,
+        .layout = usages[usage].layout,
+    };
+}
+
+static void cullPasses(void)
+{
+    bool needed[WATERLILY_GRAPH_MAX_RESOURCES];
+    for (size_t i = 0; i < context.resourceCount; ++i)
+        needed[i] = context.resources[i].output;
+
+    // Walk backwards from the outputs. A pass survives only if something
+    // after it consumes what it writes. Clearing an attachment kills whatever
+    // was written into it before.
+    size_t culled = 0;
+    for (size_t i = context.passCount; i-- > 0;)
+    {
+        struct waterlily_graph_pass *pass = &context.passes[i];
+        pass->culled = true;
+        for (size_t j = 0; j < pass->accessCount; ++j)
+            if (usages[pass->accesses[j].usage].write &&
+                needed[pass->accesses[j].resource])
+                pass->culled = false;
+
+        if (pass->culled)
+        {
+            waterlily_log(INFO, "Culled frame graph pass '%s'.", pass->name);
+            culled++;
+            continue;
+        }
+
+        for (size_t j = 0; j < pass->accessCount; ++j)
+        {
+            const struct waterlily_graph_access *access = &pass->accesses[j];
+            if (access->usage == WATERLILY_GRAPH_USAGE_COLOR_ATTACHMENT &&
+                pass->clears)
+                needed[access->resource] = false;
+        }
+        for (size_t j = 0; j < pass->accessCount; ++j)
+        {
+            const struct waterlily_graph_access *access = &pass->accesses[j];
+            if (access->usage != WATERLILY_GRAPH_USAGE_COLOR_ATTACHMENT ||
+                !pass->clears)
+                needed[access->resource] = true;
+        }
+    }
+
+    if (culled == context.passCount)
+        waterlily_report("Every frame graph pass was culled.");
+}
+
+static void computeLifetimes(void)
+{
+    for (size_t i = 0; i < context.resourceCount; ++i)
+    {
+        context.resources[i].firstPass = UINT32_MAX;
+        context.resources[i].lastPass = 0;
+    }
+
+    for (size_t i = 0; i < context.passCount; ++i)
+    {
+        const struct waterlily_graph_pass *pass = &context.passes[i];
+        if (pass->culled)
+            continue;
+
+        for (size_t j = 0; j < pass->accessCount; ++j)
+        {
+            struct waterlily_graph_resource *resource =
+                &context.resources[pass->accesses[j].resource];
+            if (resource->firstPass == UINT32_MAX)
+                resource->firstPass = i;
+            resource->lastPass = i;
+        }
+    }
+}
+
+static bool isTransient(const struct waterlily_graph_resource *resource)
+{
+    return !resource->imported && resource->type == WATERLILY_GRAPH_IMAGE &&
+           resource->firstPass != UINT32_MAX;
+}
+
+static void destroyTransients(void)
+{
+    for (size_t i = 0; i < context.resourceCount; ++i)
+    {
+        struct waterlily_graph_resource *resource = &context.resources[i];
+        if (resource->imported || resource->type != WATERLILY_GRAPH_IMAGE)
+            continue;
+
+        vkDestroyImageView(context.logical, resource->image.view, nullptr);
+        vkDestroyImage(context.logical, resource->image.handle, nullptr);
+        resource->image.view = nullptr;
+        resource->image.handle = nullptr;
+    }
+
+    vkFreeMemory(context.logical, context.transientMemory, nullptr);
+    context.transientMemory = nullptr;
+    context.transientSize = 0;
+}
+
+static inline VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static void createTransientImage(struct waterlily_graph_resource *resource)
+{
+    resource->image.extent = (VkExtent2D){
+        .width = (uint32_t)(context.extent.width * resource->image.scale),
+        .height = (uint32_t)(context.extent.height * resource->image.scale),
+    };
+    if (resource->image.extent.width == 0)
+        resource->image.extent.width = 1;
+    if (resource->image.extent.height == 0)
+        resource->image.extent.height = 1;
+
+    VkImageCreateInfo imageInfo = {0};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = resource->image.format;
+    imageInfo.extent.width = resource->image.extent.width;
+    imageInfo.extent.height = resource->image.extent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = resource->image.usage;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkResult result = vkCreateImage(context.logical, &imageInfo, nullptr,
+                                    &resource->image.handle);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create transient image '%s', code %d.",
+                         resource->name, result);
+}
+
+static void createTransientView(struct waterlily_graph_resource *resource)
+{
+    VkImageViewCreateInfo viewInfo = {0};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = resource->image.handle;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = resource->image.format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    VkResult result = vkCreateImageView(context.logical, &viewInfo, nullptr,
+                                        &resource->image.view);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create transient view '%s', code %d.",
+                         resource->name, result);
+}
+
+static bool lifetimesOverlap(const struct waterlily_graph_resource *a,
+                             const struct waterlily_graph_resource *b)
+{
+    return a->firstPass <= b->lastPass && b->firstPass <= a->lastPass;
+}
+
+static void createTransients(void)
+{
+    destroyTransients();
+
+    uint32_t order[WATERLILY_GRAPH_MAX_RESOURCES];
+    VkMemoryRequirements requirements[WATERLILY_GRAPH_MAX_RESOURCES];
+    size_t count = 0;
+    uint32_t typeBits = UINT32_MAX;
+
+    // Largest first, so the small attachments fill the holes between them.
+    for (size_t i = 0; i < context.resourceCount; ++i)
+    {
+        struct waterlily_graph_resource *resource = &context.resources[i];
+        if (!isTransient(resource))
+            continue;
+
+        createTransientImage(resource);
+        vkGetImageMemoryRequirements(context.logical, resource->image.handle,
+                                     &requirements[i]);
+        typeBits &= requirements[i].memoryTypeBits;
+
+        size_t slot = count++;
+        while (slot > 0 &&
+               requirements[order[slot - 1]].size < requirements[i].size)
+        {
+            order[slot] = order[slot - 1];
+            slot--;
+        }
+        order[slot] = i;
+    }
+
+    if (count == 0)
+        return;
+
+    // Resources whose lifetimes never overlap may share the same memory.
+    for (size_t i = 0; i < count; ++i)
+    {
+        struct waterlily_graph_resource *resource =
+            &context.resources[order[i]];
+        VkMemoryRequirements *required = &requirements[order[i]];
+        resource->offset = 0;
+
+        for (size_t j = 0; j < i; ++j)
+        {
+            const struct waterlily_graph_resource *placed =
+                &context.resources[order[j]];
+            VkDeviceSize placedEnd =
+                placed->offset + requirements[order[j]].size;
+            if (!lifetimesOverlap(resource, placed) ||
+                placed->offset >= resource->offset + required->size ||
+                placedEnd <= resource->offset)
+                continue;
+
+            resource->offset = alignUp(placedEnd, required->alignment);
+            j = (size_t)-1;
+        }
+
+        if (resource->offset + required->size > context.transientSize)
+            context.transientSize = resource->offset + required->size;
+    }
+
+    VkMemoryAllocateInfo allocateInfo = {0};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = context.transientSize;
+    allocateInfo.memoryTypeIndex = waterlily_findVulkanMemoryType(
+        context.physical, typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    VkResult result = vkAllocateMemory(context.logical, &allocateInfo, nullptr,
+                                       &context.transientMemory);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to allocate transient memory, code %d.",
+                         result);
+
+    VkDeviceSize unaliased = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        struct waterlily_graph_resource *resource =
+            &context.resources[order[i]];
+        result = vkBindImageMemory(context.logical, resource->image.handle,
+                                   context.transientMemory, resource->offset);
+        if (result != VK_SUCCESS)
+            waterlily_report("Failed to bind transient image '%s', code %d.",
+                             resource->name, result);
+        createTransientView(resource);
+        unaliased += requirements[order[i]].size;
+    }
+
+    waterlily_log(SUCCESS, "Allocated %zu transient images in %zu bytes.",
+                  count, (size_t)context.transientSize);
+    waterlily_log(INFO, "Aliasing saved %zu bytes of transient memory.",
+                  (size_t)(unaliased - context.transientSize));
+}
+
+static void addBarrier(struct waterlily_graph_pass *pass, uint32_t resource,
+                       struct tracker *tracker, VkPipelineStageFlags2 srcStages,
+                       VkAccessFlags2 srcAccess, waterlily_graph_state_t *state)
+{
+    if (context.resources[resource].type == WATERLILY_GRAPH_BUFFER)
+    {
+        VkMemoryBarrier2 *memory = &pass->barriers.memory;
+        memory->sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+        memory->srcStageMask |= srcStages;
+        memory->srcAccessMask |= srcAccess;
+        memory->dstStageMask |= state->stages;
+        memory->dstAccessMask |= state->access;
+        return;
+    }
+
+    size_t index = pass->barriers.imageCount++;
+    pass->barriers.imageResources[index] = resource;
+    pass->barriers.images[index] = (VkImageMemoryBarrier2){
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = srcStages,
+        .srcAccessMask = srcAccess,
+        .dstStageMask = state->stages,
+        .dstAccessMask = state->access,
+        .oldLayout = tracker->layout,
+        .newLayout = state->layout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .subresourceRange =
+            {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .levelCount = 1,
+                .layerCount = 1,
+            },
+    };
+}
+
+static void trackAccess(struct waterlily_graph_pass *pass,
+                        const struct waterlily_graph_access *access,
+                        struct tracker *tracker, bool emit)
+{
+    const struct waterlily_graph_resource *resource =
+        &context.resources[access->resource];
+    waterlily_graph_state_t state = getState(pass, access->usage);
+    bool write = usages[access->usage].write;
+    bool image = resource->type == WATERLILY_GRAPH_IMAGE;
+
+    if (access->usage == WATERLILY_GRAPH_USAGE_COLOR_ATTACHMENT && emit)
+        pass->colorAttachment.loadOp =
+            pass->clears ? VK_ATTACHMENT_LOAD_OP_CLEAR
+            : tracker->touched || resource->imported
+                ? VK_ATTACHMENT_LOAD_OP_LOAD
+                : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
+    bool layoutChange = image && tracker->layout != state.layout;
+    bool pendingWrite = tracker->writeStages != 0 &&
+                        (state.stages & ~tracker->visibleStages) != 0;
+
+    if (write || layoutChange)
+    {
+        // Writes must wait on everything touching the resource since the
+        // last write, as must the read/write implied by a layout transition.
+        VkPipelineStageFlags2 srcStages =
+            tracker->writeStages | tracker->readStages;
+        if (srcStages == 0)
+            srcStages = VK_PIPELINE_STAGE_2_NONE;
+        if (emit && (srcStages != VK_PIPELINE_STAGE_2_NONE || layoutChange))
+            addBarrier(pass, access->resource, tracker, srcStages,
+                       tracker->writeAccess, &state);
+    }
+    else if (pendingWrite && emit)
+        addBarrier(pass, access->resource, tracker, tracker->writeStages,
+                   tracker->writeAccess, &state);
+
+    tracker->layout = state.layout;
+    tracker->touched = true;
+    if (write)
+    {
+        tracker->writeStages = state.stages;
+        tracker->writeAccess = state.access;
+        tracker->readStages = 0;
+        tracker->visibleStages = 0;
+    }
+    else
+    {
+        tracker->readStages |= state.stages;
+        tracker->visibleStages |= state.stages;
+    }
+}
+
+static void simulate(struct tracker *trackers, bool emit)
+{
+    for (size_t i = 0; i < context.passCount; ++i)
+    {
+        struct waterlily_graph_pass *pass = &context.passes[i];
+        if (pass->culled)
+            continue;
+
+        if (emit)
+        {
+            pass->barriers.imageCount = 0;
+            pass->barriers.memory = (VkMemoryBarrier2){0};
+        }
+
+        for (size_t j = 0; j < pass->accessCount; ++j)
+            trackAccess(pass, &pass->accesses[j],
+                        &trackers[pass->accesses[j].resource], emit);
+    }
+}
+
+static void computeBarriers(void)
+{
+    struct tracker trackers[WATERLILY_GRAPH_MAX_RESOURCES] = {0};
+    simulate(trackers, false);
+
+    // Persistent resources start the frame in whatever state the previous
+    // frame left them. Transient images share memory, so their first use has
+    // to wait on every transient access of the frame before.
+    VkPipelineStageFlags2 transientStages = 0;
+    VkAccessFlags2 transientAccess = 0;
+    for (size_t i = 0; i < context.resourceCount; ++i)
+        if (isTransient(&context.resources[i]))
+        {
+            transientStages |=
+                trackers[i].writeStages | trackers[i].readStages;
+            transientAccess |= trackers[i].writeAccess;
+        }
+
+    for (size_t i = 0; i < context.resourceCount; ++i)
+    {
+        struct waterlily_graph_resource *resource = &context.resources[i];
+        struct tracker *tracker = &trackers[i];
+        if (resource->imported && resource->type == WATERLILY_GRAPH_IMAGE)
+            *tracker = (struct tracker){
+                .writeStages = resource->initial.stages,
+                .writeAccess = resource->initial.access,
+                .layout = resource->initial.layout,
+            };
+        else if (resource->imported)
+            *tracker = (struct tracker){
+                .writeStages = tracker->writeStages | tracker->readStages,
+                .writeAccess = tracker->writeAccess,
+            };
+        else
+            *tracker = (struct tracker){
+                .writeStages = transientStages,
+                .writeAccess = transientAccess,
+                .layout = VK_IMAGE_LAYOUT_UNDEFINED,
+            };
+    }
+
+    simulate(trackers, true);
+
+    context.finalBarriers.imageCount = 0;
+    for (size_t i = 0; i < context.resourceCount; ++i)
+    {
+        struct waterlily_graph_resource *resource = &context.resources[i];
+        if (!resource->imported || resource->type != WATERLILY_GRAPH_IMAGE ||
+            resource->final.layout == VK_IMAGE_LAYOUT_UNDEFINED ||
+            resource->final.layout == trackers[i].layout)
+            continue;
+
+        size_t index = context.finalBarriers.imageCount++;
+        context.finalBarriers.imageResources[index] = i;
+        context.finalBarriers.images[index] = (VkImageMemoryBarrier2){
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = trackers[i].writeStages | trackers[i].readStages,
+            .srcAccessMask = trackers[i].writeAccess,
+            .dstStageMask = resource->final.stages,
+            .dstAccessMask = resource->final.access,
+            .oldLayout = trackers[i].layout,
+            .newLayout = resource->final.layout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .subresourceRange =
+                {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .levelCount = 1,
+                    .layerCount = 1,
+                },
+        };
+    }
+}
+
+void waterlily_compileGraph(VkExtent2D extent)
+{
+    bool resized = context.extent.width != extent.width ||
+                   context.extent.height != extent.height;
+    context.extent = extent;
+
+    if (!context.compiled)
+    {
+        cullPasses();
+        computeLifetimes();
+        computeBarriers();
+        context.compiled = true;
+        waterlily_log(SUCCESS, "Compiled frame graph.");
+    }
+    else if (!resized)
+        return;
+
+    createTransients();
+}
+
+void waterlily_executeGraph(VkCommandBuffer buffer)
+{
+    for (size_t i = 0; i < context.passCount; ++i)
+    {
+        struct waterlily_graph_pass *pass = &context.passes[i];
+        if (pass->culled)
+            continue;
+
+        for (size_t j = 0; j < pass->barriers.imageCount; ++j)
+            pass->barriers.images[j].image =
+                context.resources[pass->barriers.imageResources[j]]
+                    .image.handle;
+
+        VkDependencyInfo dependency = {0};
+        dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependency.imageMemoryBarrierCount = pass->barriers.imageCount;
+        dependency.pImageMemoryBarriers = pass->barriers.images;
+        if (pass->barriers.memory.srcStageMask != 0)
+        {
+            dependency.memoryBarrierCount = 1;
+            dependency.pMemoryBarriers = &pass->barriers.memory;
+        }
+        if (dependency.imageMemoryBarrierCount != 0 ||
+            dependency.memoryBarrierCount != 0)
+            vkCmdPipelineBarrier2(buffer, &dependency);
+
+        if (!pass->rendering)
+        {
+            pass->record(buffer, pass->data);
+            continue;
+        }
+
+        const struct waterlily_graph_resource *target =
+            &context.resources[pass->colorAttachment.resource];
+        VkRenderingAttachmentInfo attachment = {0};
+        attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        attachment.imageView = target->image.view;
+        attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        attachment.loadOp = pass->colorAttachment.loadOp;
+        attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        attachment.clearValue.color = pass->clearColor;
+
+        VkRenderingInfo rendering = {0};
+        rendering.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        rendering.renderArea.extent = target->image.extent;
+        rendering.layerCount = 1;
+        rendering.colorAttachmentCount = 1;
+        rendering.pColorAttachments = &attachment;
+
+        vkCmdBeginRendering(buffer, &rendering);
+        pass->record(buffer, pass->data);
+        vkCmdEndRendering(buffer);
+    }
+
+    if (context.finalBarriers.imageCount == 0)
+        return;
+
+    for (size_t i = 0; i < context.finalBarriers.imageCount; ++i)
+        context.finalBarriers.images[i].image =
+            context.resources[context.finalBarriers.imageResources[i]]
+                .image.handle;
+
+    VkDependencyInfo dependency = {0};
+    dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency.imageMemoryBarrierCount = context.finalBarriers.imageCount;
+    dependency.pImageMemoryBarriers = context.finalBarriers.images;
+    vkCmdPipelineBarrier2(buffer, &dependency);
+}
+
+struct waterlily_graph_context *waterlily_createGraph(VkPhysicalDevice physical,
+                                                     VkDevice logical)
+{
+    context.physical = physical;
+    context.logical = logical;
+    waterlily_log(SUCCESS, "Created frame graph.");
+    return &context;
+}
+
+void waterlily_destroyGraph(void)
+{
+    destroyTransients();
+    context = (struct waterlily_graph_context){0};
+}
@@ -1,8 +1,162 @@
+#include <internal/clock.h>
+#include <internal/events.h>
 #include <internal/input.h>
 #include <internal/logging.h>
+#include <stdlib.h>
+#include <string.h>
 
 static struct waterlily_input_context context = {0};
 
+static int32_t getKeySlot(waterlily_keycode_t key)
+{
+    if (key <= 0xFF)
+        return key;
+    if (key >= 0xFF00 && key <= 0xFFFF)
+        return 256 + (key & 0xFF);
+    if (key >= WATERLILY_KEY_GAMEPAD_BASE &&
+        key < WATERLILY_KEY_GAMEPAD_BASE + 256)
+        return 512 + (key - WATERLILY_KEY_GAMEPAD_BASE);
+    return -1;
+}
+
+static bool testKey(waterlily_key_set_t set, waterlily_keycode_t key)
+{
+    int32_t slot = getKeySlot(key);
+    if (slot == -1)
+        return false;
+    return (context.keys[set][slot / 64] >> (slot % 64)) & 1;
+}
+
+static void setKey(waterlily_key_set_t set, int32_t slot, bool value)
+{
+    uint64_t bit = 1ULL << (slot % 64);
+    if (value)
+        context.keys[set][slot / 64] |= bit;
+    else
+        context.keys[set][slot / 64] &= ~bit;
+}
+
+static size_t hashCombination(uint32_t modifiers, waterlily_keycode_t first,
+                              waterlily_keycode_t second)
+{
+    uint64_t hash = ((uint64_t)first << 32 | second) * 0x9E3779B97F4A7C15;
+    hash ^= (hash >> 29) ^ modifiers * 0xBF58476D1CE4E5B9;
+    return (hash ^ (hash >> 32)) & (WATERLILY_COMBINATION_SLOTS - 1);
+}
+
+static int32_t findCombination(uint32_t modifiers, waterlily_keycode_t first,
+                               waterlily_keycode_t second)
+{
+    size_t slot = hashCombination(modifiers, first, second);
+    for (size_t i = 0; i < WATERLILY_COMBINATION_SLOTS; ++i)
+    {
+        auto entry = &context.combinations[slot];
+        if (!entry->used)
+            return -1;
+        if (entry->used && entry->combination.modifiers == modifiers &&
+            entry->combination.first == first &&
+            entry->combination.second == second)
+            return slot;
+        slot = (slot + 1) & (WATERLILY_COMBINATION_SLOTS - 1);
+    }
+    return -1;
+}
+
+static void fireCombination(uint32_t modifiers, waterlily_key_t *first,
+                            waterlily_key_t *second)
+{
+    waterlily_keycode_t symbol =
+        second == nullptr ? WATERLILY_KEY_NONE : second->symbol;
+    int32_t slot = findCombination(modifiers, first->symbol, symbol);
+    if (slot == -1)
+        return;
+
+    auto combination = &context.combinations[slot].combination;
+    combination->func(first, second, combination->data);
+}
+
+static bool isModifier(waterlily_keycode_t key)
+{
+    // Shift_L through Hyper_R.
+    return key >= 0xFFE1 && key <= 0xFFEE;
+}
+
+static void pushKey(const waterlily_key_t *key)
+{
+    size_t head = atomic_load_explicit(&context.ring.head,
+                                       memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&context.ring.tail,
+                                       memory_order_acquire);
+    if (head - tail == WATERLILY_INPUT_RING_SIZE)
+    {
+        waterlily_log(WARNING, "Input ring full, dropped a key event.");
+        return;
+    }
+
+    context.ring.events[head & (WATERLILY_INPUT_RING_SIZE - 1)] = *key;
+    atomic_store_explicit(&context.ring.head, head + 1, memory_order_release);
+}
+
+static void replayTick(void)
+{
+    auto replay = &context.replay;
+    for (; replay->next < replay->count &&
+           replay->records[replay->next].tick == context.tick;
+         ++replay->next)
+    {
+        struct waterlily_input_record *record =
+            &replay->records[replay->next];
+        pushKey(&(waterlily_key_t){record->timestamp, record->symbol,
+                                   record->state, record->modifiers});
+    }
+
+    if (replay->next == replay->count)
+    {
+        free(replay->records);
+        replay->records = nullptr;
+        waterlily_log(SUCCESS, "Finished replaying input on tick %u.",
+                      context.tick);
+    }
+}
+
+static void recordKey(const waterlily_key_t *key)
+{
+    struct waterlily_input_record record = {
+        .tick = context.tick,
+        .timestamp = key->timestamp,
+        .symbol = key->symbol,
+        .state = key->state,
+        .modifiers = key->modifiers,
+    };
+    if (fwrite(&record, sizeof(record), 1, context.recording) != 1)
+        waterlily_report("Failed to write input recording.");
+}
+
+static void repeatKey(uint64_t count, void *)
+{
+    // A late wake can owe several repeats, they all get the current time.
+    context.repeat.key.timestamp = waterlily_getClockTime() / 1000000;
+    for (uint64_t i = 0; i < count; ++i)
+        pushKey(&context.repeat.key);
+}
+
+static void startKeyRepeat(uint32_t scancode, const waterlily_key_t *key)
+{
+    if (context.repeat.external || context.repeat.rate <= 0 ||
+        !xkb_keymap_key_repeats(context.keymap, scancode))
+        return;
+
+    context.repeat.scancode = scancode;
+    context.repeat.key = *key;
+    context.repeat.key.state = WATERLILY_KEY_STATE_REPEAT;
+    // A zero first expiry would disarm the timer instead of firing now.
+    uint64_t delay = context.repeat.delay > 0
+                         ? (uint64_t)context.repeat.delay * 1000000ULL
+                         : 1;
+    waterlily_setEventTimer(context.repeat.timer, delay,
+                            1000000000ULL / context.repeat.rate);
+}
+
 static void createKeymap(const char *const string)
 {
     struct xkb_keymap *map = xkb_keymap_new_from_string(
@@ -12,6 +166,7 @@ static void createKeymap(const char *const string)
         waterlily_report("Failed to create new keymap.");
     waterlily_log(SUCCESS, "Created a new keymap.");
 
+    context.keymap = map;
     context.state = xkb_state_new(map);
     if (context.state == nullptr)
         waterlily_report("Failed to create new XKB state object.");
@@ -26,6 +181,15 @@ void waterlily_createInputContext(const char *const string)
     waterlily_log(SUCCESS, "Created input context.");
 
     createKeymap(string);
+
+    // The keymap can be sent again, but there's only ever one timer.
+    if (context.repeat.timer == 0)
+    {
+        context.repeat.timer =
+            waterlily_createEventTimer(0, repeatKey, nullptr);
+        context.repeat.rate = WATERLILY_KEY_REPEAT_RATE;
+        context.repeat.delay = WATERLILY_KEY_REPEAT_DELAY;
+    }
 }
 
 void waterlily_destroyInputContext(void)
@@ -34,10 +198,316 @@ void waterlily_destroyInputContext(void)
     // point, so we need to make sure it doesn't segfault.
     if (context.state != nullptr)
     {
-        struct xkb_keymap *keymap = xkb_state_get_keymap(context.state);
         xkb_state_unref(context.state);
-        xkb_keymap_unref(keymap);
+        xkb_keymap_unref(context.keymap);
     }
     xkb_context_unref(context.handle);
+    if (context.repeat.timer != 0)
+        waterlily_unwatchEvents(context.repeat.timer);
+    context.repeat.timer = 0;
+
+    if (context.recording != nullptr && fclose(context.recording) != 0)
+        waterlily_log(WARNING, "Failed to finish input recording.");
+    context.recording = nullptr;
+    free(context.replay.records);
+    context.replay.records = nullptr;
+}
+
+void waterlily_updateKeysDown(uint32_t scancode, uint64_t timestamp,
+                              waterlily_key_state_t state)
+{
+    if (context.keymap == nullptr || context.replay.records != nullptr)
+        return;
+
+    // Keys are tracked by their unshifted symbol, so letting go of shift
+    // before a letter doesn't leave the capital stuck down.
+    const xkb_keysym_t *symbols;
+    int count = xkb_keymap_key_get_syms_by_level(context.keymap, scancode, 0, 0,
+                                                 &symbols);
+    if (count < 1)
+        return;
+
+    waterlily_key_t key = {timestamp, symbols[0], state, context.modifiers};
+    pushKey(&key);
+
+    if (state == WATERLILY_KEY_STATE_DOWN)
+        startKeyRepeat(scancode, &key);
+    else if (state == WATERLILY_KEY_STATE_UP &&
+             scancode == context.repeat.scancode)
+        waterlily_stopKeyRepeat();
+    else if (state == WATERLILY_KEY_STATE_REPEAT && !context.repeat.external)
+    {
+        // Newer compositors repeat keys themselves, so ours would double up.
+        // Later repeat info doesn't turn ours back on either.
+        context.repeat.external = true;
+        waterlily_stopKeyRepeat();
+        waterlily_log(INFO, "Compositor repeats keys, stopped repeating "
+                            "them here.");
+    }
+}
+
+void waterlily_queueKey(const waterlily_key_t *key)
+{
+    // Anything that isn't the keyboard comes in here.
+    if (context.replay.records == nullptr)
+        pushKey(key);
+}
+
+void waterlily_setKeyRepeat(int32_t rate, int32_t delay)
+{
+    // A rate of zero turns repeating off entirely.
+    context.repeat.rate = rate;
+    context.repeat.delay = delay;
+    waterlily_stopKeyRepeat();
+    waterlily_log(INFO, "Key repeat at %d per second after %d ms.", rate,
+                  delay);
+}
+
+void waterlily_stopKeyRepeat(void)
+{
+    context.repeat.scancode = 0;
+    if (context.repeat.timer != 0)
+        waterlily_setEventTimer(context.repeat.timer, 0, 0);
+}
+
+void waterlily_updateModifiersDown(uint32_t depressed, uint32_t latched,
+                                   uint32_t locked, uint32_t group)
+{
+    if (context.state == nullptr)
+        return;
+    (void)xkb_state_update_mask(context.state, depressed, latched, locked, 0,
+                                0, group);
+
+    static const struct
+    {
+        const char *name;
+        waterlily_modifier_t modifier;
+    } names[] = {
+        {XKB_MOD_NAME_SHIFT, WATERLILY_MODIFIER_SHIFT},
+        {XKB_MOD_NAME_CTRL, WATERLILY_MODIFIER_CONTROL},
+        {XKB_MOD_NAME_ALT, WATERLILY_MODIFIER_ALT},
+        {XKB_MOD_NAME_LOGO, WATERLILY_MODIFIER_SUPER},
+    };
+    // Resolved to our own bits here, since the keymap's are its own to pick.
+    context.modifiers = WATERLILY_MODIFIER_NONE;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+        if (xkb_state_mod_name_is_active(context.state, names[i].name,
+                                         XKB_STATE_MODS_EFFECTIVE) > 0)
+            context.modifiers |= names[i].modifier;
+}
+
+void waterlily_handleKeys(void)
+{
+    // Edges only last a single tick.
+    memset(context.keys[WATERLILY_KEY_SET_PRESSED], 0,
+           sizeof(context.keys[0]) * (WATERLILY_KEY_SETS - 1));
+    if (context.replay.records != nullptr)
+        replayTick();
+
+    size_t tail = atomic_load_explicit(&context.ring.tail,
+                                       memory_order_relaxed);
+    size_t head = atomic_load_explicit(&context.ring.head,
+                                       memory_order_acquire);
+    for (; tail != head; ++tail)
+    {
+        waterlily_key_t *key =
+            &context.ring.events[tail & (WATERLILY_INPUT_RING_SIZE - 1)];
+        if (context.recording != nullptr)
+            recordKey(key);
+        // Replayed timestamps are from whenever they were recorded.
+        if (context.firstTimestamp == 0 && context.replay.records == nullptr)
+            context.firstTimestamp = key->timestamp;
+
+        int32_t slot = getKeySlot(key->symbol);
+        if (slot == -1)
+            continue;
+
+        switch (key->state)
+        {
+            case WATERLILY_KEY_STATE_DOWN:
+                setKey(WATERLILY_KEY_SET_DOWN, slot, true);
+                setKey(WATERLILY_KEY_SET_PRESSED, slot, true);
+                if (isModifier(key->symbol))
+                    break;
+
+                // At most two lookups per press, however many bindings.
+                if (context.held.symbol != WATERLILY_KEY_NONE)
+                    fireCombination(key->modifiers, &context.held, key);
+                fireCombination(key->modifiers, key, nullptr);
+                context.held = *key;
+                break;
+            case WATERLILY_KEY_STATE_UP:
+                setKey(WATERLILY_KEY_SET_DOWN, slot, false);
+                setKey(WATERLILY_KEY_SET_RELEASED, slot, true);
+                if (context.held.symbol == key->symbol)
+                    context.held.symbol = WATERLILY_KEY_NONE;
+                break;
+            case WATERLILY_KEY_STATE_REPEAT:
+                setKey(WATERLILY_KEY_SET_REPEATED, slot, true);
+                break;
+        }
+    }
+    atomic_store_explicit(&context.ring.tail, tail, memory_order_release);
+    context.tick++;
+}
+
+uint64_t waterlily_takeInputTimestamp(void)
+{
+    uint64_t timestamp = context.firstTimestamp;
+    context.firstTimestamp = 0;
+    return timestamp;
+}
+
+void waterlily_recordInput(const char *path)
+{
+    context.recording = fopen(path, "wb");
+    if (context.recording == nullptr)
+        waterlily_report("Failed to open input recording '%s'.", path);
+
+    struct waterlily_input_recording header = {
+        .magic = WATERLILY_INPUT_RECORDING_MAGIC,
+        .version = WATERLILY_INPUT_RECORDING_VERSION,
+        .tickRate = WATERLILY_TICK_RATE,
+    };
+    if (fwrite(&header, sizeof(header), 1, context.recording) != 1)
+        waterlily_report("Failed to write input recording header.");
+    waterlily_log(SUCCESS, "Recording input to '%s'.", path);
+}
+
+void waterlily_replayInput(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+        waterlily_report("Failed to open input recording '%s'.", path);
+
+    struct waterlily_input_recording header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != WATERLILY_INPUT_RECORDING_MAGIC ||
+        header.version != WATERLILY_INPUT_RECORDING_VERSION)
+        waterlily_report("'%s' isn't an input recording.", path);
+    // Ticks only line up with the recording at the rate it was made at.
+    if (header.tickRate != WATERLILY_TICK_RATE)
+        waterlily_report("Recording was made at %u ticks per second, not %d.",
+                         header.tickRate, WATERLILY_TICK_RATE);
+
+    (void)fseek(file, 0, SEEK_END);
+    size_t size = ftell(file) - sizeof(header);
+    (void)fseek(file, sizeof(header), SEEK_SET);
+
+    auto replay = &context.replay;
+    replay->count = size / sizeof(struct waterlily_input_record);
+    replay->next = 0;
+    // One spare record so an empty recording still gets an allocation.
+    replay->records =
+        malloc((replay->count + 1) * sizeof(struct waterlily_input_record));
+    if (replay->records == nullptr)
+        waterlily_report("Failed to allocate input recording.");
+    if (fread(replay->records, sizeof(struct waterlily_input_record),
+              replay->count, file) != replay->count)
+        waterlily_report("Failed to read input recording '%s'.", path);
+    (void)fclose(file);
+
+    waterlily_log(SUCCESS, "Replaying %zu key events from '%s'.",
+                  replay->count, path);
+}
+
+bool waterlily_isReplayingInput(void)
+{
+    return context.replay.records != nullptr;
+}
+
+void waterlily_bindKeys(const waterlily_key_combination_t *combination)
+{
+    int32_t slot = findCombination(combination->modifiers, combination->first,
+                                   combination->second);
+    if (slot != -1)
+    {
+        context.combinations[slot].combination = *combination;
+        return;
+    }
+
+    if (context.combinationCount == WATERLILY_MAX_KEY_COMBINATIONS)
+        waterlily_report("Ran out of key combinations.");
+
+    size_t index = hashCombination(combination->modifiers, combination->first,
+                                   combination->second);
+    while (context.combinations[index].used)
+        index = (index + 1) & (WATERLILY_COMBINATION_SLOTS - 1);
+
+    context.combinations[index].combination = *combination;
+    context.combinations[index].used = true;
+    context.combinationCount++;
+}
+
+void waterlily_bindKeyMap(const waterlily_key_combination_t *map, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        waterlily_bindKeys(&map[i]);
+    waterlily_log(INFO, "Bound a key map of %zu combinations.", count);
+}
+
+bool waterlily_rebindKeys(const waterlily_key_combination_t *from,
+                          const waterlily_key_combination_t *to)
+{
+    int32_t slot = findCombination(from->modifiers, from->first, from->second);
+    if (slot == -1)
+        return false;
+
+    // The action stays the same, only the keys that trigger it move.
+    waterlily_key_combination_t combination =
+        context.combinations[slot].combination;
+    waterlily_unbindKeys(from);
+    combination.modifiers = to->modifiers;
+    combination.first = to->first;
+    combination.second = to->second;
+    waterlily_bindKeys(&combination);
+    return true;
+}
+
+void waterlily_unbindKeys(const waterlily_key_combination_t *combination)
+{
+    int32_t slot = findCombination(combination->modifiers, combination->first,
+                                   combination->second);
+    if (slot == -1)
+        return;
+
+    // Anything later in the run that could have sat in the hole moves into
+    // it, so lookups never have to probe past gaps. Rebinding at runtime
+    // would otherwise fill the table with tombstones.
+    constexpr size_t mask = WATERLILY_COMBINATION_SLOTS - 1;
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & mask; context.combinations[next].used;
+         next = (next + 1) & mask)
+    {
+        auto entry = &context.combinations[next].combination;
+        size_t home =
+            hashCombination(entry->modifiers, entry->first, entry->second);
+        if (((next - home) & mask) < ((next - hole) & mask))
+            continue;
+        context.combinations[hole] = context.combinations[next];
+        hole = next;
+    }
+    context.combinations[hole].used = false;
+    context.combinationCount--;
+}
+
+bool waterlily_isKeyDown(waterlily_keycode_t key)
+{
+    return testKey(WATERLILY_KEY_SET_DOWN, key);
+}
+
+bool waterlily_wasKeyPressed(waterlily_keycode_t key)
+{
+    return testKey(WATERLILY_KEY_SET_PRESSED, key);
+}
+
+bool waterlily_wasKeyReleased(waterlily_keycode_t key)
+{
+    return testKey(WATERLILY_KEY_SET_RELEASED, key);
+}
+
+bool waterlily_wasKeyRepeated(waterlily_keycode_t key)
+{
+    return testKey(WATERLILY_KEY_SET_REPEATED, key);
 }
 
@@ -0,0 +1,473 @@
+#include <internal/graph.h>
+#include <internal/lights.h>
+#include <internal/logging.h>
+#include <internal/ring.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WATERLILY_LIGHT_BINDINGS 3
+
+static struct waterlily_light_context context = {0};
+
+static void createSampler(void)
+{
+    // Unlike sprites, light is meant to bleed smoothly between tiles.
+    VkSamplerCreateInfo samplerInfo = {0};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    VkResult result = vkCreateSampler(context.logical, &samplerInfo, nullptr,
+                                      &context.sampler);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create lightmap sampler, code %d.",
+                         result);
+}
+
+static void createDescriptorSets(void)
+{
+    VkDescriptorSetLayoutBinding sceneBinding = {0};
+    sceneBinding.binding = 0;
+    sceneBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    sceneBinding.descriptorCount = 1;
+    sceneBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutBinding bindings[WATERLILY_LIGHT_BINDINGS] = {0};
+    for (size_t i = 0; i < WATERLILY_LIGHT_BINDINGS; ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    // Lights are rebinned every frame, so each frame in flight reads its
+    // own slice of one buffer.
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {0};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &sceneBinding;
+
+    VkResult result = vkCreateDescriptorSetLayout(
+        context.logical, &layoutInfo, nullptr, &context.sceneLayout);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create lightmap set layout, code %d.",
+                         result);
+
+    layoutInfo.bindingCount = WATERLILY_LIGHT_BINDINGS;
+    layoutInfo.pBindings = bindings;
+    result = vkCreateDescriptorSetLayout(context.logical, &layoutInfo,
+                                         nullptr, &context.computeLayout);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create light set layout, code %d.",
+                         result);
+
+    VkDescriptorPoolSize sizes[] = {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
+    };
+    VkDescriptorPoolCreateInfo poolInfo = {0};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = 2;
+    poolInfo.poolSizeCount = sizeof(sizes) / sizeof(sizes[0]);
+    poolInfo.pPoolSizes = sizes;
+
+    result = vkCreateDescriptorPool(context.logical, &poolInfo, nullptr,
+                                    &context.pool);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create light pool, code %d.", result);
+
+    VkDescriptorSetLayout layouts[2] = {context.sceneLayout,
+                                        context.computeLayout};
+    VkDescriptorSet sets[2];
+    VkDescriptorSetAllocateInfo allocateInfo = {0};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = context.pool;
+    allocateInfo.descriptorSetCount = 2;
+    allocateInfo.pSetLayouts = layouts;
+
+    result = vkAllocateDescriptorSets(context.logical, &allocateInfo, sets);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to allocate light sets, code %d.", result);
+    context.sceneSet = sets[0];
+    context.computeSet = sets[1];
+}
+
+static void
+createPipeline(const struct waterlily_archive_shader_section *shader)
+{
+    VkPipelineLayoutCreateInfo layoutInfo = {0};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &context.computeLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &(VkPushConstantRange){
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .size = sizeof(struct waterlily_light_constants),
+    };
+
+    VkResult result = vkCreatePipelineLayout(
+        context.logical, &layoutInfo, nullptr, &context.pipelineLayout);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create light layout, code %d.", result);
+
+    VkShaderModule module = waterlily_createVulkanShader(shader);
+    VkComputePipelineCreateInfo pipelineInfo = {0};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.layout = context.pipelineLayout;
+    pipelineInfo.stage.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+
+    result = vkCreateComputePipelines(context.logical, nullptr, 1,
+                                      &pipelineInfo, nullptr,
+                                      &context.pipeline);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create light pipeline, code %d.", result);
+    vkDestroyShaderModule(context.logical, module, nullptr);
+}
+
+static void createBuffers(void)
+{
+    constexpr VkDeviceSize occluderSize = WATERLILY_MAX_OCCLUDER_TILES / 8;
+
+    waterlily_createVulkanBuffer(occluderSize,
+                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                 &context.occluders.handle,
+                                 &context.occluders.memory);
+    uint8_t *empty = calloc(occluderSize, 1);
+    if (empty == nullptr)
+        waterlily_report("Failed to allocate light occluders.");
+    waterlily_uploadVulkanBuffer(context.occluders.handle, empty,
+                                 occluderSize);
+    free(empty);
+
+    VkDescriptorBufferInfo infos[2] = {
+        {waterlily_getRingBuffer(), 0, sizeof(struct waterlily_light_frame)},
+        {context.occluders.handle, 0, VK_WHOLE_SIZE},
+    };
+    VkWriteDescriptorSet writes[2] = {0};
+    for (size_t i = 0; i < 2; ++i)
+    {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = context.computeSet;
+        writes[i].dstBinding = i + 1;
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &infos[i];
+    }
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    vkUpdateDescriptorSets(context.logical, 2, writes, 0, nullptr);
+}
+
+uint32_t waterlily_createLight(const waterlily_light_t *light)
+{
+    for (uint32_t i = 0; i < WATERLILY_MAX_LIGHTS; ++i)
+        if (!context.sources[i].used)
+        {
+            context.sources[i].info = *light;
+            context.sources[i].used = true;
+            return i;
+        }
+    waterlily_report("Ran out of lights (%d).", WATERLILY_MAX_LIGHTS);
+}
+
+void waterlily_updateLight(uint32_t index, const waterlily_light_t *light)
+{
+    context.sources[index].info = *light;
+}
+
+void waterlily_destroyLight(uint32_t index)
+{
+    context.sources[index].used = false;
+}
+
+void waterlily_setAmbientLight(uint32_t color)
+{
+    for (size_t i = 0; i < 4; ++i)
+        context.ambient.float32[i] = ((color >> (i * 8)) & 0xFF) / 255.0f;
+}
+
+void waterlily_setOccluders(const uint8_t *tiles, uint32_t width,
+                            uint32_t height)
+{
+    if ((size_t)width * height > WATERLILY_MAX_OCCLUDER_TILES)
+        waterlily_report("Too many occluder tiles (%ux%u).", width, height);
+    if (!context.enabled)
+        return;
+
+    // One bit per tile keeps the shadow march inside a few cache lines.
+    uint32_t words[WATERLILY_MAX_OCCLUDER_TILES / 32] = {0};
+    for (size_t i = 0; i < (size_t)width * height; ++i)
+        if (tiles[i] != 0)
+            words[i / 32] |= 1u << (i % 32);
+
+    // Occluders only change on map transitions, like tile layers.
+    vkDeviceWaitIdle(context.logical);
+    waterlily_uploadVulkanBuffer(context.occluders.handle, words,
+                                 sizeof(words));
+    context.occluderExtent[0] = width;
+    context.occluderExtent[1] = height;
+    waterlily_log(SUCCESS, "Set %ux%u light occluder tiles.", width, height);
+}
+
+static bool getCellBounds(const waterlily_light_t *light, uint32_t *bounds)
+{
+    constexpr float cellSize =
+        WATERLILY_LIGHT_TILE_SIZE * WATERLILY_LIGHT_CELL_SIZE;
+    float left = (light->position[0] - light->radius) / cellSize;
+    float top = (light->position[1] - light->radius) / cellSize;
+    float right = (light->position[0] + light->radius) / cellSize;
+    float bottom = (light->position[1] + light->radius) / cellSize;
+    if (right < 0 || bottom < 0 || left >= context.gridExtent[0] ||
+        top >= context.gridExtent[1])
+        return false;
+
+    bounds[0] = left < 0 ? 0 : (uint32_t)left;
+    bounds[1] = top < 0 ? 0 : (uint32_t)top;
+    bounds[2] = right >= context.gridExtent[0] ? context.gridExtent[0] - 1
+                                               : (uint32_t)right;
+    bounds[3] = bottom >= context.gridExtent[1] ? context.gridExtent[1] - 1
+                                                : (uint32_t)bottom;
+    return true;
+}
+
+static uint32_t binLights(struct waterlily_light_frame *slice)
+{
+    uint32_t width = context.gridExtent[0];
+    memset(context.grid, 0,
+           sizeof(uint32_t) * context.gridExtent[0] * context.gridExtent[1]);
+
+    // Count how many lights reach each cell, keeping only the ones on screen.
+    uint32_t bounds[WATERLILY_MAX_LIGHTS][4];
+    uint32_t lightCount = 0;
+    for (size_t i = 0; i < WATERLILY_MAX_LIGHTS; ++i)
+    {
+        if (!context.sources[i].used ||
+            !getCellBounds(&context.sources[i].info, bounds[lightCount]))
+            continue;
+
+        auto cell = bounds[lightCount];
+        for (uint32_t y = cell[1]; y <= cell[3]; ++y)
+            for (uint32_t x = cell[0]; x <= cell[2]; ++x)
+                context.grid[y * width + x]++;
+        slice->lights[lightCount++] = context.sources[i].info;
+    }
+
+    // Every lit cell gets a run of the index list, and the grid remembers
+    // which entry it became. Dark cells are never dispatched at all. The
+    // slice is write combined, so the write cursors stay on this side.
+    uint32_t fill[WATERLILY_MAX_LIGHT_CELLS];
+    uint32_t cellCount = 0, cursor = 0;
+    bool dropped = false;
+    for (size_t i = 0; i < (size_t)width * context.gridExtent[1]; ++i)
+    {
+        uint32_t count = context.grid[i];
+        if (count == 0)
+            continue;
+        if (cellCount == WATERLILY_MAX_LIGHT_CELLS ||
+            cursor + count > WATERLILY_MAX_LIGHT_INDICES)
+        {
+            context.grid[i] = 0;
+            dropped = true;
+            continue;
+        }
+
+        slice->cells[cellCount] = (struct waterlily_light_cell){
+            .x = i % width,
+            .y = i / width,
+            .firstLight = cursor,
+            .lightCount = count,
+        };
+        fill[cellCount] = cursor;
+        cursor += count;
+        context.grid[i] = ++cellCount;
+    }
+
+    for (uint32_t i = 0; i < lightCount; ++i)
+        for (uint32_t y = bounds[i][1]; y <= bounds[i][3]; ++y)
+            for (uint32_t x = bounds[i][0]; x <= bounds[i][2]; ++x)
+            {
+                uint32_t entry = context.grid[y * width + x];
+                if (entry == 0)
+                    continue;
+                slice->indices[fill[entry - 1]++] = i;
+            }
+
+    static bool warned = false;
+    if (dropped && !warned)
+        waterlily_log(WARNING, "Too many lit cells, some will stay dark.");
+    warned |= dropped;
+    return cellCount;
+}
+
+static void recordClear(VkCommandBuffer buffer, void *)
+{
+    // Unlit tiles only ever see the ambient color, so clearing is all the
+    // work they cost.
+    VkImage image = waterlily_getGraphImage(context.graph.lightmap);
+    vkCmdClearColorImage(buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         &context.ambient, 1,
+                         &(VkImageSubresourceRange){
+                             .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                             .levelCount = 1,
+                             .layerCount = 1,
+                         });
+}
+
+static void recordLights(VkCommandBuffer buffer, void *)
+{
+    VkDeviceSize offset;
+    struct waterlily_light_frame *slice =
+        waterlily_allocateRing(sizeof(struct waterlily_light_frame), &offset);
+    uint32_t cellCount = binLights(slice);
+    if (cellCount == 0)
+        return;
+
+    VkExtent2D extent = waterlily_getGraphImageExtent(context.graph.lightmap);
+    struct waterlily_light_constants constants = {
+        .extent = {extent.width, extent.height},
+        .occluderExtent = {context.occluderExtent[0],
+                           context.occluderExtent[1]},
+        .tileSize = WATERLILY_LIGHT_TILE_SIZE,
+    };
+
+    uint32_t dynamicOffset = offset;
+    vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      context.pipeline);
+    vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            context.pipelineLayout, 0, 1, &context.computeSet,
+                            1, &dynamicOffset);
+    vkCmdPushConstants(buffer, context.pipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                       &constants);
+    // One workgroup per lit cell, so the cost follows the lights rather
+    // than the resolution.
+    vkCmdDispatch(buffer, cellCount, 1, 1);
+}
+
+void waterlily_addLightGraph(void)
+{
+    context.graph.lightmap = waterlily_addGraphImage(
+        "lightmap", VK_FORMAT_R16G16B16A16_SFLOAT,
+        1.0f / WATERLILY_LIGHT_TILE_SIZE);
+
+    uint32_t clear = waterlily_addGraphPass(
+        "lightmap clear", WATERLILY_GRAPH_PASS_COMPUTE, recordClear, nullptr);
+    waterlily_useGraphResource(clear, context.graph.lightmap,
+                               WATERLILY_GRAPH_USAGE_TRANSFER_DESTINATION);
+    if (!context.enabled)
+        return;
+
+    uint32_t pass = waterlily_addGraphPass(
+        "lights", WATERLILY_GRAPH_PASS_COMPUTE, recordLights, nullptr);
+    waterlily_useGraphResource(pass, context.graph.lightmap,
+                               WATERLILY_GRAPH_USAGE_STORAGE_WRITE);
+}
+
+void waterlily_useLightGraph(uint32_t pass)
+{
+    waterlily_useGraphResource(pass, context.graph.lightmap,
+                               WATERLILY_GRAPH_USAGE_SAMPLED);
+}
+
+void waterlily_bindLightmap(void)
+{
+    // The lightmap is a transient the graph recreates on every resize.
+    VkExtent2D extent = waterlily_getGraphImageExtent(context.graph.lightmap);
+    VkImageView view = waterlily_getGraphImageView(context.graph.lightmap);
+
+    context.gridExtent[0] = (extent.width + WATERLILY_LIGHT_CELL_SIZE - 1) /
+                            WATERLILY_LIGHT_CELL_SIZE;
+    context.gridExtent[1] = (extent.height + WATERLILY_LIGHT_CELL_SIZE - 1) /
+                            WATERLILY_LIGHT_CELL_SIZE;
+    free(context.grid);
+    context.grid = malloc(sizeof(uint32_t) * context.gridExtent[0] *
+                          context.gridExtent[1]);
+    if (context.grid == nullptr)
+        waterlily_report("Failed to allocate light grid.");
+
+    VkDescriptorImageInfo infos[2] = {
+        {context.sampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+        {nullptr, view, VK_IMAGE_LAYOUT_GENERAL},
+    };
+    VkWriteDescriptorSet writes[2] = {0};
+    for (size_t i = 0; i < 2; ++i)
+    {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].descriptorCount = 1;
+        writes[i].pImageInfo = &infos[i];
+    }
+    writes[0].dstSet = context.sceneSet;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[1].dstSet = context.computeSet;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    vkUpdateDescriptorSets(context.logical, context.enabled ? 2 : 1, writes,
+                           0, nullptr);
+}
+
+void waterlily_bindLights(VkCommandBuffer buffer, VkPipelineLayout layout)
+{
+    vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout,
+                            WATERLILY_LIGHTMAP_SET, 1, &context.sceneSet, 0,
+                            nullptr);
+}
+
+struct waterlily_light_context *
+waterlily_createLightContext(VkDevice logical, waterlily_file_t *archive)
+{
+    context.logical = logical;
+    // Full white ambient leaves games without lights looking as they did.
+    waterlily_setAmbientLight(0xFFFFFFFF);
+    createSampler();
+    createDescriptorSets();
+
+    auto shader = waterlily_findArchiveShader(archive, WATERLILY_LIGHT_SHADER);
+    if (shader == nullptr || shader->type != WATERLILY_COMPUTE_SHADER)
+    {
+        waterlily_log(WARNING, "No light shader, only ambient light is used.");
+        return &context;
+    }
+
+    createPipeline(shader);
+    createBuffers();
+    context.enabled = true;
+
+    waterlily_log(SUCCESS, "Created light context of %d lights.",
+                  WATERLILY_MAX_LIGHTS);
+    return &context;
+}
+
+void waterlily_destroyLightContext(void)
+{
+    free(context.grid);
+    context.grid = nullptr;
+
+    if (context.enabled)
+    {
+        vkDestroyPipeline(context.logical, context.pipeline, nullptr);
+        vkDestroyPipelineLayout(context.logical, context.pipelineLayout,
+                                nullptr);
+        vkDestroyBuffer(context.logical, context.occluders.handle, nullptr);
+        vkFreeMemory(context.logical, context.occluders.memory, nullptr);
+    }
+
+    vkDestroyDescriptorPool(context.logical, context.pool, nullptr);
+    vkDestroyDescriptorSetLayout(context.logical, context.computeLayout,
+                                 nullptr);
+    vkDestroyDescriptorSetLayout(context.logical, context.sceneLayout,
+                                 nullptr);
+    vkDestroySampler(context.logical, context.sampler, nullptr);
+}
@@ -1,44 +1,812 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <internal/logging.h>
+#include <internal/recorder.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include <waterlily.h>
 
 #define STRINGIFY2(expr) #expr
 #define STRINGIFY(expr) STRINGIFY2(expr)
 
-void(waterlily_log)(const waterlily_log_t *data, const char *const format, ...)
+static struct waterlily_log_context context = {0};
+// Claimed on a thread's first log, and tried for again on later ones if none
+// were free.
+static thread_local struct waterlily_log_ring *threadRing = nullptr;
+static const char *const tags[] = {
+    [WATERLILY_LOG_TYPE_INFO] = "INFO",
+    [WATERLILY_LOG_TYPE_SUCCESS] = " OK ",
+    [WATERLILY_LOG_TYPE_WARNING] = "WARN",
+};
+
+static size_t formatLine(char *text, size_t size, const waterlily_log_t *data,
+                         const char *const format, va_list args)
+{
+    int header = snprintf(text, size, "[%s] %-15s ln. %04zu: ",
+                          tags[data->type], data->filename, data->line);
+    int body = vsnprintf(text + header, size - header, format, args);
+
+    // A cut off line still gets its newline.
+    size_t length = header + (body > 0 ? body : 0);
+    if (length > size - 2)
+        length = size - 2;
+    text[length++] = '\n';
+    return length;
+}
+
+static uint64_t getTime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief Step over the next conversion in a format string, the same way for
+ * writing binary records as for reading them back.
+ * @since v0.0.1
+ *
+ * @param[in] format Where to start looking.
+ * @param[out] start Where the conversion's percent sign is.
+ * @param[out] argument What the conversion takes.
+ * @return Where the text after the conversion starts, or nullptr if there
+ * aren't any conversions left.
+ */
+static const char *nextConversion(const char *format, const char **start,
+                                  waterlily_log_argument_t *argument)
+{
+    const char *cursor = strchr(format, '%');
+    if (cursor == nullptr)
+        return nullptr;
+
+    *start = cursor++;
+    if (*cursor == '%')
+    {
+        *argument = WATERLILY_LOG_ARGUMENT_NONE;
+        return cursor + 1;
+    }
+
+    cursor += strspn(cursor, "-+ #0");
+    cursor += strspn(cursor, "0123456789");
+    if (*cursor == '.')
+        cursor += 1 + strspn(cursor + 1, "0123456789");
+
+    bool wide = false;
+    if (*cursor == 'h')
+        cursor += cursor[1] == 'h' ? 2 : 1;
+    else if (*cursor != 0 && strchr("lzjt", *cursor) != nullptr)
+    {
+        wide = true;
+        cursor += cursor[0] == 'l' && cursor[1] == 'l' ? 2 : 1;
+    }
+
+    switch (*cursor)
+    {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        case 'c':
+            *argument = wide ? WATERLILY_LOG_ARGUMENT_WIDE
+                             : WATERLILY_LOG_ARGUMENT_INT;
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            *argument = WATERLILY_LOG_ARGUMENT_DOUBLE;
+            break;
+        case 'p':
+            *argument = WATERLILY_LOG_ARGUMENT_POINTER;
+            break;
+        case 's':
+            *argument = wide ? WATERLILY_LOG_ARGUMENT_INVALID
+                             : WATERLILY_LOG_ARGUMENT_STRING;
+            break;
+        default:
+            *argument = WATERLILY_LOG_ARGUMENT_INVALID;
+            return cursor;
+    }
+    return cursor + 1;
+}
+
+static void *reserveRecord(size_t size)
+{
+    size_t offset = atomic_fetch_add_explicit(&context.binary.offset, size,
+                                              memory_order_relaxed);
+    if (offset + size > WATERLILY_BINARY_LOG_SIZE)
+    {
+        atomic_fetch_add_explicit(&context.binary.dropped, 1,
+                                  memory_order_relaxed);
+        return nullptr;
+    }
+    return context.binary.mapped + offset;
+}
+
+static void publishRecord(struct waterlily_binary_log_record *record,
+                          uint32_t size)
 {
-    static const char *const tags[] = {
-        [WATERLILY_LOG_TYPE_INFO] = "INFO",
-        [WATERLILY_LOG_TYPE_SUCCESS] = " OK ",
-        [WATERLILY_LOG_TYPE_WARNING] = "WARN",
+    // A crash mid-record leaves a size of zero, and reading stops there.
+    __atomic_store_n(&record->size, size, __ATOMIC_RELEASE);
+}
+
+static void defineFormat(uint32_t id, const waterlily_log_t *data,
+                         const char *format)
+{
+    size_t filenameLength = strlen(data->filename) + 1;
+    size_t formatLength = strlen(format) + 1;
+    size_t size = sizeof(struct waterlily_binary_log_record) +
+                  sizeof(struct waterlily_binary_log_definition) +
+                  filenameLength + formatLength;
+    size = (size + 7) & ~(size_t)7;
+
+    struct waterlily_binary_log_record *record = reserveRecord(size);
+    if (record == nullptr)
+        return;
+    record->format = id | WATERLILY_LOG_DEFINITION;
+    record->time = getTime();
+    auto definition = (struct waterlily_binary_log_definition *)(record + 1);
+    *definition = (struct waterlily_binary_log_definition){
+        .line = data->line,
+        .type = data->type,
     };
+    char *strings = (char *)(definition + 1);
+    memcpy(strings, data->filename, filenameLength);
+    memcpy(strings + filenameLength, format, formatLength);
+    publishRecord(record, size);
+}
+
+static uint32_t findFormat(const waterlily_log_t *data, const char *format)
+{
+    // FNV-1a, which is plenty for a few hundred lines.
+    uint64_t key = 14695981039346656037ULL;
+    for (const char *c = data->filename; *c != 0; ++c)
+        key = (key ^ (uint8_t)*c) * 1099511628211ULL;
+    key = (key ^ data->line) * 1099511628211ULL;
+    // Zero marks an empty slot.
+    key += key == 0;
+
+    for (size_t i = 0; i < WATERLILY_LOG_FORMATS; ++i)
+    {
+        size_t slot = (key + i) & (WATERLILY_LOG_FORMATS - 1);
+        uint64_t current = atomic_load_explicit(&context.binary.formats[slot],
+                                                memory_order_relaxed);
+        if (current == 0 &&
+            atomic_compare_exchange_strong(&context.binary.formats[slot],
+                                           &current, key))
+        {
+            // Whoever claims the slot defines it. Another thread might use
+            // it before the definition lands, so readers have to look ahead.
+            defineFormat(slot, data, format);
+            return slot;
+        }
+        if (current == key)
+            return slot;
+    }
+    return UINT32_MAX;
+}
+
+static bool append(uint8_t *buffer, size_t capacity, size_t *size,
+                   const void *data, size_t length)
+{
+    if (*size + length > capacity)
+        return false;
+    memcpy(buffer + *size, data, length);
+    *size += length;
+    return true;
+}
+
+/**
+ * @brief Pack a message's arguments the way binary logs and the log rings
+ * both hold them.
+ * @since v0.0.1
+ *
+ * @param[out] buffer Where to pack them.
+ * @param[in] capacity How big the buffer is.
+ * @param[in,out] size How much of the buffer is already used, and then how
+ * much is after packing.
+ * @param[in] format The message's format.
+ * @param[in] args The message's arguments.
+ * @return Whether every argument was packed, false if one can't be or the
+ * buffer ran out.
+ */
+static bool packArguments(uint8_t *buffer, size_t capacity, size_t *size,
+                          const char *format, va_list args)
+{
+    const char *start;
+    waterlily_log_argument_t argument;
+    for (const char *cursor = format;
+         (cursor = nextConversion(cursor, &start, &argument)) != nullptr;)
+    {
+        bool fits = true;
+        switch (argument)
+        {
+            case WATERLILY_LOG_ARGUMENT_NONE:
+                break;
+            case WATERLILY_LOG_ARGUMENT_INT:
+            {
+                int value = va_arg(args, int);
+                fits = append(buffer, capacity, size, &value, sizeof(value));
+                break;
+            }
+            case WATERLILY_LOG_ARGUMENT_WIDE:
+            {
+                uint64_t value = va_arg(args, uint64_t);
+                fits = append(buffer, capacity, size, &value, sizeof(value));
+                break;
+            }
+            case WATERLILY_LOG_ARGUMENT_DOUBLE:
+            {
+                double value = va_arg(args, double);
+                fits = append(buffer, capacity, size, &value, sizeof(value));
+                break;
+            }
+            case WATERLILY_LOG_ARGUMENT_POINTER:
+            {
+                uint64_t value = (uintptr_t)va_arg(args, void *);
+                fits = append(buffer, capacity, size, &value, sizeof(value));
+                break;
+            }
+            case WATERLILY_LOG_ARGUMENT_STRING:
+            {
+                // Strings are the one thing copied whole, since they may not
+                // outlive the call.
+                const char *value = va_arg(args, const char *);
+                if (value == nullptr)
+                    value = "(null)";
+                size_t room = capacity - *size;
+                if (room < sizeof(uint16_t))
+                    return false;
+                // Cut off at whatever room the record has left.
+                uint16_t length = strnlen(value, room - sizeof(uint16_t));
+                fits =
+                    append(buffer, capacity, size, &length, sizeof(length)) &&
+                    append(buffer, capacity, size, value, length);
+                break;
+            }
+            case WATERLILY_LOG_ARGUMENT_INVALID:
+                return false;
+        }
+        if (!fits)
+            return false;
+    }
+    return true;
+}
+
+static bool writeBinary(const waterlily_log_t *data, const char *format,
+                        va_list args)
+{
+    uint32_t id = findFormat(data, format);
+    if (id == UINT32_MAX)
+        return false;
+
+    alignas(8) uint8_t buffer[WATERLILY_LOG_RECORD_SIZE];
+    size_t size = sizeof(struct waterlily_binary_log_record);
+    if (!packArguments(buffer, sizeof(buffer), &size, format, args))
+        return false;
+
+    size = (size + 7) & ~(size_t)7;
+    struct waterlily_binary_log_record *record = reserveRecord(size);
+    // Out of room counts as written, there's no catching up on it in text.
+    if (record == nullptr)
+        return true;
+    memcpy(record + 1, buffer + sizeof(*record), size - sizeof(*record));
+    record->format = id;
+    record->time = getTime();
+    publishRecord(record, size);
+    return true;
+}
+
+void waterlily_openBinaryLog(const char *path)
+{
+    int descriptor = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (descriptor == -1)
+        waterlily_report("Failed to open binary log '%s'.", path);
+    if (ftruncate(descriptor, WATERLILY_BINARY_LOG_SIZE) == -1)
+        waterlily_report("Failed to size binary log '%s'.", path);
+
+    uint8_t *mapped = mmap(nullptr, WATERLILY_BINARY_LOG_SIZE,
+                           PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    if (mapped == MAP_FAILED)
+        waterlily_report("Failed to map binary log '%s'.", path);
+
+    *(struct waterlily_binary_log_header *)mapped =
+        (struct waterlily_binary_log_header){
+            .magic = WATERLILY_BINARY_LOG_MAGIC,
+            .version = WATERLILY_BINARY_LOG_VERSION,
+            .start = getTime(),
+        };
+    atomic_store(&context.binary.offset,
+                 sizeof(struct waterlily_binary_log_header));
+    context.binary.descriptor = descriptor;
+    context.binary.mapped = mapped;
+    waterlily_log(SUCCESS, "Logging to '%s' in binary.", path);
+}
+
+void waterlily_closeBinaryLog(void)
+{
+    uint8_t *mapped = context.binary.mapped;
+    if (mapped == nullptr)
+        return;
+
+    context.binary.mapped = nullptr;
+    size_t used = atomic_load(&context.binary.offset);
+    if (used > WATERLILY_BINARY_LOG_SIZE)
+        used = WATERLILY_BINARY_LOG_SIZE;
+    size_t dropped = atomic_load(&context.binary.dropped);
+    if (dropped != 0)
+        waterlily_log(WARNING, "Binary log was full, dropped %zu records.",
+                      dropped);
+
+    (void)munmap(mapped, WATERLILY_BINARY_LOG_SIZE);
+    // Keep the terminating zero size if there's room for it.
+    if (used + sizeof(uint32_t) <= WATERLILY_BINARY_LOG_SIZE)
+        used += sizeof(uint32_t);
+    (void)ftruncate(context.binary.descriptor, used);
+    close(context.binary.descriptor);
+}
 
-    FILE *output = data->type < WATERLILY_LOG_TYPE_WARNING ? stdout : stderr;
-    (void)fprintf(output, "[%s] %-15s ln. %04zu: ", tags[data->type],
-                  data->filename, data->line);
+static bool take(const uint8_t **cursor, const uint8_t *end, void *data,
+                 size_t length)
+{
+    if ((size_t)(end - *cursor) < length)
+        return false;
+    memcpy(data, *cursor, length);
+    *cursor += length;
+    return true;
+}
+
+static void printArguments(FILE *output, const char *format,
+                           const uint8_t *cursor, const uint8_t *end)
+{
+    const char *text = format;
+    const char *start;
+    waterlily_log_argument_t argument;
+    const char *next;
+    while ((next = nextConversion(text, &start, &argument)) != nullptr)
+    {
+        (void)fwrite(text, 1, start - text, output);
+        text = next;
+
+        char conversion[32];
+        size_t length = next - start;
+        if (length >= sizeof(conversion))
+            return;
+        memcpy(conversion, start, length);
+        conversion[length] = 0;
+
+        switch (argument)
+        {
+            case WATERLILY_LOG_ARGUMENT_NONE:
+                (void)fputc('%', output);
+                break;
+            case WATERLILY_LOG_ARGUMENT_INT:
+            {
+                int value;
+                if (!take(&cursor, end, &value, sizeof(value)))
+                    return;
+                (void)fprintf(output, conversion, value);
+                break;
+            }
+            case WATERLILY_LOG_ARGUMENT_WIDE:
+            {
+                uint64_t value;
+                if (!take(&cursor, end, &value, sizeof(value)))
+                    return;
+                (void)fprintf(output, conversion, value);
+                break;
+            }
+            case WATERLILY_LOG_ARGUMENT_DOUBLE:
+            {
+                double value;
+                if (!take(&cursor, end, &value, sizeof(value)))
+                    return;
+                (void)fprintf(output, conversion, value);
+                break;
+            }
+            case WATERLILY_LOG_ARGUMENT_POINTER:
+            {
+                uint64_t value;
+                if (!take(&cursor, end, &value, sizeof(value)))
+                    return;
+                (void)fprintf(output, conversion, (void *)(uintptr_t)value);
+                break;
+            }
+            case WATERLILY_LOG_ARGUMENT_STRING:
+            {
+                uint16_t size;
+                char value[WATERLILY_LOG_RECORD_SIZE + 1];
+                if (!take(&cursor, end, &size, sizeof(size)) ||
+                    size > WATERLILY_LOG_RECORD_SIZE ||
+                    !take(&cursor, end, value, size))
+                    return;
+                value[size] = 0;
+                (void)fprintf(output, conversion, value);
+                break;
+            }
+            case WATERLILY_LOG_ARGUMENT_INVALID:
+                return;
+        }
+    }
+    (void)fputs(text, output);
+}
+
+static void writeRecord(const struct waterlily_log_record *record)
+{
+    FILE *output = record->type < WATERLILY_LOG_TYPE_WARNING ? stdout : stderr;
+    // Lines written straight out by other threads stay out of this one.
+    flockfile(output);
+    (void)fprintf(output, "[%s] %-15s ln. %04u: ", tags[record->type],
+                  record->filename, record->line);
+    printArguments(output, record->format, record->arguments,
+                   record->arguments + record->size);
+    (void)fputc('\n', output);
+    funlockfile(output);
+}
+
+static void wakeWriter(void)
+{
+    uint64_t count = 1;
+    (void)write(context.wake, &count, sizeof(count));
+}
+
+static void drainRings(void)
+{
+    uint32_t count = atomic_load(&context.ringCount);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        struct waterlily_log_ring *ring = &context.rings[i];
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; ++tail)
+            writeRecord(&ring->records[tail & (WATERLILY_LOG_RING_SIZE - 1)]);
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+}
+
+static bool ringsEmpty(void)
+{
+    uint32_t count = atomic_load(&context.ringCount);
+    for (uint32_t i = 0; i < count; ++i)
+        if (atomic_load(&context.rings[i].tail) !=
+            atomic_load(&context.rings[i].head))
+            return false;
+    return true;
+}
+
+static void reportDropped(void)
+{
+    size_t dropped =
+        atomic_exchange_explicit(&context.dropped, 0, memory_order_relaxed);
+    if (dropped != 0)
+        (void)fprintf(stderr, "[%s] Dropped %zu log lines, their rings were "
+                              "full.\n",
+                      tags[WATERLILY_LOG_TYPE_WARNING], dropped);
+}
+
+static void *writeLogs(void *)
+{
+    while (true)
+    {
+        drainRings();
+        reportDropped();
+        (void)fflush(stdout);
+        (void)fflush(stderr);
+        if (!atomic_load(&context.running) && ringsEmpty())
+            return nullptr;
+
+        // Producers check this after publishing, and we check the rings
+        // after setting it, so one of the two always sees the other.
+        atomic_store(&context.sleeping, true);
+        if (!ringsEmpty())
+        {
+            atomic_store(&context.sleeping, false);
+            continue;
+        }
+        uint64_t count;
+        (void)read(context.wake, &count, sizeof(count));
+        atomic_store(&context.sleeping, false);
+    }
+}
+
+static void releaseRing(void *ring)
+{
+    // Whatever's left in it still gets written, the next owner just carries
+    // on from its head.
+    threadRing = nullptr;
+    atomic_store_explicit(&((struct waterlily_log_ring *)ring)->owned, false,
+                          memory_order_release);
+}
+
+static void createRingKey(void)
+{
+    if (pthread_key_create(&context.ringKey, releaseRing) != 0)
+        waterlily_report("Failed to create log ring key.");
+}
+
+static void claimRing(void)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    (void)pthread_once(&once, createRingKey);
+
+    for (uint32_t i = 0; i < WATERLILY_LOG_THREADS; ++i)
+    {
+        struct waterlily_log_ring *ring = &context.rings[i];
+        bool owned = false;
+        if (!atomic_compare_exchange_strong(&ring->owned, &owned, true))
+            continue;
+
+        uint32_t count = atomic_load(&context.ringCount);
+        while (count <= i &&
+               !atomic_compare_exchange_weak(&context.ringCount, &count, i + 1))
+            ;
+        // Threads that exit on their own hand the ring back, though the main
+        // thread's exit() never does, which is fine for the one thread.
+        if (pthread_setspecific(context.ringKey, ring) != 0)
+        {
+            atomic_store(&ring->owned, false);
+            return;
+        }
+        threadRing = ring;
+        return;
+    }
+}
+
+void waterlily_printBinaryLog(const char *path)
+{
+    static struct
+    {
+        const struct waterlily_binary_log_definition *definition;
+        const char *filename;
+        const char *format;
+    } formats[WATERLILY_LOG_FORMATS];
+
+    int descriptor = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if (descriptor == -1 || fstat(descriptor, &status) == -1)
+        waterlily_report("Failed to open binary log '%s'.", path);
+    size_t size = status.st_size;
+    if (size < sizeof(struct waterlily_binary_log_header))
+        waterlily_report("Binary log '%s' is too small.", path);
+    const uint8_t *mapped =
+        mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (mapped == MAP_FAILED)
+        waterlily_report("Failed to map binary log '%s'.", path);
+
+    const struct waterlily_binary_log_header *header = (const void *)mapped;
+    if (header->magic != WATERLILY_BINARY_LOG_MAGIC ||
+        header->version != WATERLILY_BINARY_LOG_VERSION)
+        waterlily_report("'%s' isn't a version %d binary log.", path,
+                         WATERLILY_BINARY_LOG_VERSION);
+
+    // Two passes, since a format can be used before its definition lands.
+    const uint8_t *end = mapped + size;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        const uint8_t *cursor = mapped + sizeof(*header);
+        while ((size_t)(end - cursor) >=
+               sizeof(struct waterlily_binary_log_record))
+        {
+            const struct waterlily_binary_log_record *record =
+                (const void *)cursor;
+            if (record->size < sizeof(*record) ||
+                record->size > (size_t)(end - cursor))
+                break;
+            cursor += record->size;
+            const uint8_t *body = (const uint8_t *)(record + 1);
+
+            uint32_t id = record->format & ~WATERLILY_LOG_DEFINITION;
+            if (id >= WATERLILY_LOG_FORMATS)
+                continue;
+            if (record->format & WATERLILY_LOG_DEFINITION)
+            {
+                const struct waterlily_binary_log_definition *definition =
+                    (const void *)body;
+                if (pass != 0 ||
+                    record->size < sizeof(*record) + sizeof(*definition))
+                    continue;
+
+                // Both strings have to end inside the record.
+                const char *filename = (const char *)(definition + 1);
+                const char *limit = (const char *)cursor;
+                const char *format = memchr(filename, 0, limit - filename);
+                if (format == nullptr)
+                    continue;
+                format++;
+                if (memchr(format, 0, limit - format) == nullptr)
+                    continue;
+                formats[id].definition = definition;
+                formats[id].filename = filename;
+                formats[id].format = format;
+                continue;
+            }
+            if (pass == 0)
+                continue;
+
+            if (formats[id].format == nullptr)
+            {
+                (void)printf("[????] unknown format %u\n", id);
+                continue;
+            }
+            waterlily_log_type_t type = formats[id].definition->type;
+            (void)printf("[%s] %-15s ln. %04u @ %.6f: ",
+                         tags[type <= WATERLILY_LOG_TYPE_WARNING ? type : 0],
+                         formats[id].filename, formats[id].definition->line,
+                         (record->time - header->start) / 1e9);
+            printArguments(stdout, formats[id].format, body, cursor);
+            (void)putchar('\n');
+        }
+    }
+    (void)munmap((void *)mapped, size);
+}
+
+void waterlily_createLogContext(void)
+{
+    context.wake = eventfd(0, EFD_CLOEXEC);
+    if (context.wake == -1)
+        waterlily_report("Failed to create log wake descriptor.");
+
+    atomic_store(&context.running, true);
+    if (pthread_create(&context.writer, nullptr, writeLogs, nullptr) != 0)
+    {
+        atomic_store(&context.running, false);
+        waterlily_report("Failed to create log writer thread.");
+    }
+    waterlily_log(SUCCESS, "Created log writer thread.");
+}
+
+void waterlily_destroyLogContext(void)
+{
+    if (!atomic_exchange(&context.running, false))
+        return;
+
+    wakeWriter();
+    (void)pthread_join(context.writer, nullptr);
+    reportDropped();
+    close(context.wake);
+    waterlily_closeBinaryLog();
+}
+
+void waterlily_flushLogs(void)
+{
+    if (!atomic_load(&context.running) ||
+        pthread_equal(pthread_self(), context.writer))
+        return;
+
+    // Whatever's still queued once the wait is up comes out later, or is
+    // lost if we're on the way out.
+    uint64_t deadline = getTime() + WATERLILY_LOG_FLUSH_NS;
+    while (!ringsEmpty())
+    {
+        // Flushing would block on the same stalled stream.
+        if (getTime() >= deadline)
+            return;
+        wakeWriter();
+        sched_yield();
+    }
+    // The writer may not have flushed what it just drained yet.
+    (void)fflush(stdout);
+    (void)fflush(stderr);
+}
+
+void waterlily_setLogLevel(waterlily_log_type_t level)
+{
+    atomic_store_explicit(&context.level, level, memory_order_relaxed);
+}
+
+void(waterlily_log)(const waterlily_log_t *data, const char *const format, ...)
+{
+    // The flight recorder keeps even what the level hides, but only the
+    // format, so this stays cheap.
+    waterlily_recordFlight((waterlily_flight_kind_t)data->type, format,
+                           data->filename, data->line);
+    if (data->type <
+        atomic_load_explicit(&context.level, memory_order_relaxed))
+        return;
 
     va_list args;
     va_start(args);
-    (void)vfprintf(output, format, args);
-    (void)fputc('\n', output);
+    // Warnings are still written out as text, someone should see them.
+    if (context.binary.mapped != nullptr)
+    {
+        va_list binaryArgs;
+        va_copy(binaryArgs, args);
+        bool written = writeBinary(data, format, binaryArgs);
+        va_end(binaryArgs);
+        if (written && data->type < WATERLILY_LOG_TYPE_WARNING)
+        {
+            va_end(args);
+            return;
+        }
+    }
+
+    if (threadRing == nullptr)
+        claimRing();
+    if (threadRing != nullptr &&
+        atomic_load_explicit(&context.running, memory_order_relaxed))
+    {
+        // Waiting on the writer would tie every call to stdout, so a full
+        // ring costs the line instead. Warnings go out the slow way.
+        size_t head =
+            atomic_load_explicit(&threadRing->head, memory_order_relaxed);
+        bool full = head - atomic_load_explicit(&threadRing->tail,
+                                                memory_order_acquire) ==
+                    WATERLILY_LOG_RING_SIZE;
+        if (full && data->type < WATERLILY_LOG_TYPE_WARNING)
+        {
+            va_end(args);
+            atomic_fetch_add_explicit(&context.dropped, 1,
+                                      memory_order_relaxed);
+            return;
+        }
+
+        // Only the arguments are copied here, strings included since they
+        // may not outlive the call. Formatting is the writer's job.
+        struct waterlily_log_record *record =
+            &threadRing->records[head & (WATERLILY_LOG_RING_SIZE - 1)];
+        size_t size = 0;
+        va_list packArgs;
+        va_copy(packArgs, args);
+        if (!full && packArguments(record->arguments,
+                                   sizeof(record->arguments), &size, format,
+                                   packArgs))
+        {
+            va_end(packArgs);
+            va_end(args);
+            record->filename = data->filename;
+            record->format = format;
+            record->line = data->line;
+            record->type = data->type;
+            record->size = size;
+            atomic_store_explicit(&threadRing->head, head + 1,
+                                  memory_order_seq_cst);
+            if (atomic_exchange(&context.sleeping, false))
+                wakeWriter();
+            return;
+        }
+        va_end(packArgs);
+    }
+
+    // No ring, no writer, a full ring or arguments that don't pack, so it's
+    // written out right here.
+    char text[WATERLILY_LOG_RECORD_SIZE];
+    size_t length = formatLine(text, sizeof(text), data, format, args);
     va_end(args);
+    (void)fwrite(text, 1, length,
+                 data->type < WATERLILY_LOG_TYPE_WARNING ? stdout : stderr);
 }
 
 void(waterlily_report)(const waterlily_log_t *data, const char *const format,
                        ...)
 {
-    (void)fprintf(stderr, "[FAIL] %-15s ln. %04zu: ", data->filename,
-                  data->line);
+    int error = errno;
+    // Whatever was logged before this should come out before it.
+    waterlily_flushLogs();
 
+    char message[WATERLILY_LOG_RECORD_SIZE];
     va_list args;
     va_start(args);
-    (void)vfprintf(stderr, format, args);
+    (void)vsnprintf(message, sizeof(message), format, args);
     va_end(args);
-    (void)fprintf(stderr, "\n       Current ERRNO (may be garbage): %d\n",
-                  errno);
+    (void)fprintf(stderr,
+                  "[FAIL] %-15s ln. %04zu: %s\n"
+                  "       Current ERRNO (may be garbage): %d\n",
+                  data->filename, data->line, message, error);
+    waterlily_dumpFlight(message);
     exit(-1);
 }
-
@@ -0,0 +1,459 @@
+#include <internal/graph.h>
+#include <internal/logging.h>
+#include <internal/particles.h>
+#include <internal/ring.h>
+#include <internal/sprites.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WATERLILY_PARTICLE_BINDINGS 5
+
+static struct waterlily_particle_context context = {0};
+
+static void createDescriptorSet(void)
+{
+    VkDescriptorSetLayoutBinding bindings[WATERLILY_PARTICLE_BINDINGS] = {0};
+    for (size_t i = 0; i < WATERLILY_PARTICLE_BINDINGS; ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    // Emitters are rewritten every frame, so each frame in flight reads its
+    // own slice of one buffer.
+    bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {0};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = WATERLILY_PARTICLE_BINDINGS;
+    layoutInfo.pBindings = bindings;
+
+    VkResult result = vkCreateDescriptorSetLayout(context.logical, &layoutInfo,
+                                                  nullptr, &context.layout);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create particle set layout, code %d.",
+                         result);
+
+    VkDescriptorPoolSize sizes[] = {
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, WATERLILY_PARTICLE_BINDINGS - 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1},
+    };
+    VkDescriptorPoolCreateInfo poolInfo = {0};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 2;
+    poolInfo.pPoolSizes = sizes;
+
+    result = vkCreateDescriptorPool(context.logical, &poolInfo, nullptr,
+                                    &context.pool);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create particle pool, code %d.", result);
+
+    VkDescriptorSetAllocateInfo allocateInfo = {0};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = context.pool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &context.layout;
+
+    result =
+        vkAllocateDescriptorSets(context.logical, &allocateInfo, &context.set);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to allocate particle set, code %d.", result);
+}
+
+static void
+createPipelines(const struct waterlily_archive_shader_section *shader)
+{
+    VkPipelineLayoutCreateInfo layoutInfo = {0};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &context.layout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &(VkPushConstantRange){
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .size = sizeof(struct waterlily_particle_constants),
+    };
+
+    VkResult result = vkCreatePipelineLayout(
+        context.logical, &layoutInfo, nullptr, &context.pipelineLayout);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create particle layout, code %d.",
+                         result);
+
+    // One shader covers every phase, the phase is baked in as a
+    // specialization constant so each pipeline only keeps its own branch.
+    VkShaderModule module = waterlily_createVulkanShader(shader);
+    for (uint32_t phase = 0; phase < WATERLILY_PARTICLE_PHASES; ++phase)
+    {
+        VkComputePipelineCreateInfo pipelineInfo = {0};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.layout = context.pipelineLayout;
+        pipelineInfo.stage.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = module;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.stage.pSpecializationInfo = &(VkSpecializationInfo){
+            .mapEntryCount = 1,
+            .pMapEntries =
+                &(VkSpecializationMapEntry){0, 0, sizeof(uint32_t)},
+            .dataSize = sizeof(uint32_t),
+            .pData = &phase,
+        };
+
+        result = vkCreateComputePipelines(context.logical, nullptr, 1,
+                                          &pipelineInfo, nullptr,
+                                          &context.pipelines[phase]);
+        if (result != VK_SUCCESS)
+            waterlily_report("Failed to create particle phase %u, code %d.",
+                             phase, result);
+    }
+    vkDestroyShaderModule(context.logical, module, nullptr);
+}
+
+static void createBuffers(void)
+{
+    constexpr VkDeviceSize particleSize =
+        sizeof(struct waterlily_particle) * WATERLILY_MAX_PARTICLES;
+    // Two alive lists that swap every frame, then the dead list.
+    constexpr VkDeviceSize listSize =
+        sizeof(uint32_t) * WATERLILY_MAX_PARTICLES * 3;
+    constexpr VkDeviceSize instanceSize =
+        sizeof(waterlily_sprite_t) * WATERLILY_MAX_PARTICLES;
+
+    waterlily_createVulkanBuffer(
+        particleSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &context.particles.handle,
+        &context.particles.memory);
+    waterlily_createVulkanBuffer(listSize,
+                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                 &context.lists.handle, &context.lists.memory);
+    waterlily_createVulkanBuffer(sizeof(struct waterlily_particle_counters),
+                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                     VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                 &context.counters.handle,
+                                 &context.counters.memory);
+    waterlily_createVulkanBuffer(
+        instanceSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &context.instances.handle,
+        &context.instances.memory);
+
+    // Every particle starts out dead.
+    uint32_t *lists = calloc(WATERLILY_MAX_PARTICLES * 3, sizeof(uint32_t));
+    if (lists == nullptr)
+        waterlily_report("Failed to allocate particle lists.");
+    for (uint32_t i = 0; i < WATERLILY_MAX_PARTICLES; ++i)
+        lists[WATERLILY_MAX_PARTICLES * 2 + i] = i;
+    waterlily_uploadVulkanBuffer(context.lists.handle, lists, listSize);
+    free(lists);
+
+    struct waterlily_particle_counters counters = {
+        .dead = WATERLILY_MAX_PARTICLES,
+        .dispatch = {0, 1, 1},
+        .draw = {6, 0, 0, 0},
+    };
+    waterlily_uploadVulkanBuffer(context.counters.handle, &counters,
+                                 sizeof(counters));
+
+    VkDescriptorBufferInfo infos[WATERLILY_PARTICLE_BINDINGS] = {
+        {context.particles.handle, 0, VK_WHOLE_SIZE},
+        {context.lists.handle, 0, VK_WHOLE_SIZE},
+        {context.counters.handle, 0, VK_WHOLE_SIZE},
+        {context.instances.handle, 0, VK_WHOLE_SIZE},
+        // Emitters are rewritten every frame, so they live in the frame ring
+        // and each frame binds its own allocation.
+        {waterlily_getRingBuffer(), 0, WATERLILY_PARTICLE_EMITTER_SIZE},
+    };
+    VkWriteDescriptorSet writes[WATERLILY_PARTICLE_BINDINGS] = {0};
+    for (size_t i = 0; i < WATERLILY_PARTICLE_BINDINGS; ++i)
+    {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = context.set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &infos[i];
+    }
+    writes[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    vkUpdateDescriptorSets(context.logical, WATERLILY_PARTICLE_BINDINGS,
+                           writes, 0, nullptr);
+}
+
+uint32_t waterlily_createEmitter(const waterlily_emitter_t *emitter)
+{
+    for (uint32_t i = 0; i < WATERLILY_MAX_EMITTERS; ++i)
+        if (!context.sources[i].used)
+        {
+            context.sources[i].info = *emitter;
+            context.sources[i].accumulator = 0;
+            context.sources[i].used = true;
+            return i;
+        }
+    waterlily_report("Ran out of particle emitters (%d).",
+                     WATERLILY_MAX_EMITTERS);
+}
+
+void waterlily_updateEmitter(uint32_t index,
+                             const waterlily_emitter_t *emitter)
+{
+    context.sources[index].info = *emitter;
+}
+
+void waterlily_destroyEmitter(uint32_t index)
+{
+    // Particles already spawned keep living out their lifetime.
+    context.sources[index].used = false;
+}
+
+void waterlily_startParticleBenchmark(uint32_t count, uint32_t width,
+                                      uint32_t height)
+{
+    if (!context.enabled)
+        waterlily_report("No particle shader to benchmark.");
+    if (count > WATERLILY_MAX_PARTICLES)
+        waterlily_report("Can't benchmark %u particles, the most is %d.",
+                         count, WATERLILY_MAX_PARTICLES);
+
+    // Each emitter spawns its share every lifetime, so once the first ones
+    // start dying the count holds steady.
+    constexpr uint32_t side = WATERLILY_PARTICLE_BENCHMARK_GRID;
+    float cellWidth = (float)width / side;
+    float cellHeight = (float)height / side;
+    waterlily_emitter_t emitter = {
+        .spread = {cellWidth / 2, cellHeight / 2},
+        .velocity = {0, -60},
+        .jitter = {40, 40},
+        .gravity = {0, 30},
+        .size = {4, 4},
+        .uv = {0, 0, 1, 1},
+        .life = WATERLILY_PARTICLE_BENCHMARK_LIFE,
+        .rate = count / (side * side * WATERLILY_PARTICLE_BENCHMARK_LIFE),
+        .color = 0xFFFFFFFF,
+    };
+    for (uint32_t i = 0; i < side * side; ++i)
+    {
+        emitter.position[0] = cellWidth * (i % side + 0.5f);
+        emitter.position[1] = cellHeight * (i / side + 0.5f);
+        (void)waterlily_createEmitter(&emitter);
+    }
+
+    waterlily_log(SUCCESS, "Started particle benchmark of %u particles for "
+                           "%d frames.",
+                  count, WATERLILY_PARTICLE_BENCHMARK_FRAMES);
+}
+
+static float getDelta(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    float delta = (now.tv_sec - context.last.tv_sec) +
+                  (now.tv_nsec - context.last.tv_nsec) / 1e9f;
+    context.last = now;
+    // A long stall shouldn't fling every particle across the screen.
+    return delta > 0.1f ? 0.1f : delta;
+}
+
+static uint32_t writeEmitters(float delta, uint32_t *emitterCount,
+                              VkDeviceSize *offset)
+{
+    struct waterlily_particle_emitter *slice =
+        waterlily_allocateRing(WATERLILY_PARTICLE_EMITTER_SIZE, offset);
+    uint32_t spawnCount = 0;
+    *emitterCount = 0;
+
+    for (size_t i = 0; i < WATERLILY_MAX_EMITTERS; ++i)
+    {
+        auto source = &context.sources[i];
+        if (!source->used)
+            continue;
+
+        source->accumulator += source->info.rate * delta;
+        uint32_t spawns = (uint32_t)source->accumulator;
+        source->accumulator -= spawns;
+        if (spawnCount + spawns > WATERLILY_MAX_PARTICLES)
+            spawns = WATERLILY_MAX_PARTICLES - spawnCount;
+        if (spawns == 0)
+            continue;
+
+        auto info = &source->info;
+        slice[(*emitterCount)++] = (struct waterlily_particle_emitter){
+            .position = {info->position[0], info->position[1]},
+            .spread = {info->spread[0], info->spread[1]},
+            .velocity = {info->velocity[0], info->velocity[1]},
+            .jitter = {info->jitter[0], info->jitter[1]},
+            .gravity = {info->gravity[0], info->gravity[1]},
+            .size = {info->size[0], info->size[1]},
+            .uv = {info->uv[0], info->uv[1], info->uv[2], info->uv[3]},
+            .life = info->life,
+            .texture = info->texture,
+            .color = info->color,
+            .layer = info->layer,
+            .firstSpawn = spawnCount,
+            .spawnCount = spawns,
+        };
+        spawnCount += spawns;
+    }
+    return spawnCount;
+}
+
+static void computeBarrier(VkCommandBuffer buffer)
+{
+    VkMemoryBarrier2 barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+    VkDependencyInfo dependency = {0};
+    dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency.memoryBarrierCount = 1;
+    dependency.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(buffer, &dependency);
+}
+
+static void recordParticles(VkCommandBuffer buffer, void *)
+{
+    struct waterlily_particle_constants constants = {
+        .delta = getDelta(),
+        .parity = context.parity,
+        .seed = context.seed++,
+    };
+    VkDeviceSize offset;
+    constants.spawnCount =
+        writeEmitters(constants.delta, &constants.emitterCount, &offset);
+
+    uint32_t dynamicOffset = offset;
+    vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            context.pipelineLayout, 0, 1, &context.set, 1,
+                            &dynamicOffset);
+    vkCmdPushConstants(buffer, context.pipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                       &constants);
+
+    // Survivors are compacted into the other alive list and written out as
+    // sprite instances, then new particles are appended behind them. The
+    // CPU never learns how many particles there are, the last phase writes
+    // the draw and next frame's dispatch sizes itself.
+    vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      context.pipelines[WATERLILY_PARTICLE_SIMULATE]);
+    vkCmdDispatchIndirect(buffer, context.counters.handle,
+                          offsetof(struct waterlily_particle_counters,
+                                   dispatch));
+    computeBarrier(buffer);
+
+    if (constants.spawnCount != 0)
+    {
+        vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          context.pipelines[WATERLILY_PARTICLE_EMIT]);
+        vkCmdDispatch(buffer,
+                      (constants.spawnCount +
+                       WATERLILY_PARTICLE_WORKGROUP_SIZE - 1) /
+                          WATERLILY_PARTICLE_WORKGROUP_SIZE,
+                      1, 1);
+        computeBarrier(buffer);
+    }
+
+    vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      context.pipelines[WATERLILY_PARTICLE_FINALIZE]);
+    vkCmdDispatch(buffer, 1, 1, 1);
+    context.parity ^= 1;
+}
+
+bool waterlily_addParticleGraph(void)
+{
+    if (!context.enabled)
+        return false;
+
+    context.graph.counters = waterlily_importGraphBuffer(
+        "particle counters", context.counters.handle,
+        sizeof(struct waterlily_particle_counters));
+    context.graph.instances = waterlily_importGraphBuffer(
+        "particle instances", context.instances.handle,
+        sizeof(waterlily_sprite_t) * WATERLILY_MAX_PARTICLES);
+
+    uint32_t pass =
+        waterlily_addGraphPass("particles", WATERLILY_GRAPH_PASS_COMPUTE,
+                               recordParticles, nullptr);
+    waterlily_useGraphResource(pass, context.graph.counters,
+                               WATERLILY_GRAPH_USAGE_INDIRECT);
+    waterlily_useGraphResource(pass, context.graph.counters,
+                               WATERLILY_GRAPH_USAGE_STORAGE_WRITE);
+    waterlily_useGraphResource(pass, context.graph.instances,
+                               WATERLILY_GRAPH_USAGE_STORAGE_WRITE);
+    return true;
+}
+
+void waterlily_useParticleGraph(uint32_t pass)
+{
+    waterlily_useGraphResource(pass, context.graph.counters,
+                               WATERLILY_GRAPH_USAGE_INDIRECT);
+    waterlily_useGraphResource(pass, context.graph.instances,
+                               WATERLILY_GRAPH_USAGE_VERTEX);
+}
+
+void waterlily_drawParticles(VkCommandBuffer buffer)
+{
+    if (!context.enabled)
+        return;
+
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(buffer, 0, 1, &context.instances.handle, &offset);
+    vkCmdDrawIndirect(buffer, context.counters.handle,
+                      offsetof(struct waterlily_particle_counters, draw), 1,
+                      0);
+}
+
+struct waterlily_particle_context *
+waterlily_createParticleContext(VkDevice logical, waterlily_file_t *archive)
+{
+    context.logical = logical;
+    auto shader = waterlily_findArchiveShader(archive,
+                                              WATERLILY_PARTICLE_SHADER);
+    if (shader == nullptr || shader->type != WATERLILY_COMPUTE_SHADER)
+    {
+        waterlily_log(WARNING, "No particle shader, particles are disabled.");
+        return &context;
+    }
+
+    createDescriptorSet();
+    createPipelines(shader);
+    createBuffers();
+    clock_gettime(CLOCK_MONOTONIC, &context.last);
+    context.enabled = true;
+
+    waterlily_log(SUCCESS, "Created particle system of %d particles.",
+                  WATERLILY_MAX_PARTICLES);
+    return &context;
+}
+
+void waterlily_destroyParticleContext(void)
+{
+    if (!context.enabled)
+        return;
+
+    for (size_t i = 0; i < WATERLILY_PARTICLE_PHASES; ++i)
+        vkDestroyPipeline(context.logical, context.pipelines[i], nullptr);
+    vkDestroyPipelineLayout(context.logical, context.pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(context.logical, context.pool, nullptr);
+    vkDestroyDescriptorSetLayout(context.logical, context.layout, nullptr);
+
+    typeof(context.particles) *buffers[] = {
+        &context.particles,
+        &context.lists,
+        &context.counters,
+        &context.instances,
+    };
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); ++i)
+    {
+        vkDestroyBuffer(context.logical, buffers[i]->handle, nullptr);
+        vkFreeMemory(context.logical, buffers[i]->memory, nullptr);
+    }
+}
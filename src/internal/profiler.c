@@ -0,0 +1,168 @@
+#include <internal/clock.h>
+#include <internal/logging.h>
+#include <internal/profiler.h>
+#include <internal/recorder.h>
+#include <string.h>
+
+static struct waterlily_profiler_context context = {0};
+
+static uint32_t getBucket(uint64_t value)
+{
+    constexpr uint32_t sub = WATERLILY_HISTOGRAM_SUB_BUCKETS;
+    if (value < sub)
+        return value;
+
+    // The leading bit picks the power of two, and the three after it which
+    // of its eight buckets.
+    uint32_t top = 63 - __builtin_clzll(value);
+    uint32_t bucket =
+        sub + (top - 4) * (sub / 2) + ((value >> (top - 3)) & (sub / 2 - 1));
+    if (bucket >= WATERLILY_HISTOGRAM_BUCKETS)
+        return WATERLILY_HISTOGRAM_BUCKETS - 1;
+    return bucket;
+}
+
+static uint64_t getBucketValue(uint32_t bucket)
+{
+    constexpr uint32_t sub = WATERLILY_HISTOGRAM_SUB_BUCKETS;
+    if (bucket < sub)
+        return bucket;
+
+    // The highest value the bucket holds, so percentiles never undersell.
+    uint32_t top = (bucket - sub) / (sub / 2) + 4;
+    uint64_t mantissa = (sub / 2) + (bucket - sub) % (sub / 2);
+    return ((mantissa + 1) << (top - 3)) - 1;
+}
+
+void waterlily_recordHistogram(waterlily_histogram_t *histogram,
+                               uint64_t value)
+{
+    histogram->counts[getBucket(value)]++;
+    histogram->count++;
+    histogram->total += value;
+    if (value > histogram->max)
+        histogram->max = value;
+}
+
+uint64_t
+waterlily_getHistogramPercentile(const waterlily_histogram_t *histogram,
+                                 double percentile)
+{
+    if (histogram->count == 0)
+        return 0;
+
+    uint64_t rank = histogram->count * percentile / 100.0 + 0.5;
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < WATERLILY_HISTOGRAM_BUCKETS; ++i)
+    {
+        seen += histogram->counts[i];
+        if (seen < rank)
+            continue;
+
+        uint64_t value = getBucketValue(i);
+        return value < histogram->max ? value : histogram->max;
+    }
+    return histogram->max;
+}
+
+void waterlily_clearHistogram(waterlily_histogram_t *histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+static void logLatency(void)
+{
+    const waterlily_histogram_t *latency = &context.latency;
+    // Asked for outright, so these outlast release builds' log level.
+    waterlily_log(SUCCESS,
+                  "Input latency p50 %.2f ms, p99 %.2f ms, max %.2f ms over "
+                  "%zu frames.",
+                  waterlily_getHistogramPercentile(latency, 50) / 1e6,
+                  waterlily_getHistogramPercentile(latency, 99) / 1e6,
+                  latency->max / 1e6, (size_t)latency->count);
+}
+
+struct waterlily_profiler_context *waterlily_createProfilerContext(bool report)
+{
+    context.report = report;
+    context.lastReport = waterlily_getClockTime();
+    context.lastFrame = context.lastReport;
+    waterlily_log(SUCCESS, "Created profiler context.");
+    return &context;
+}
+
+void waterlily_destroyProfilerContext(void)
+{
+    if (context.latency.count != 0)
+        logLatency();
+    if (context.presentation.discarded != 0)
+        waterlily_log(INFO, "The compositor discarded %zu of %zu frames.",
+                      (size_t)context.presentation.discarded,
+                      (size_t)(context.presentation.discarded +
+                               context.presentation.presented));
+}
+
+void waterlily_markProfilerFrame(void)
+{
+    uint64_t now = waterlily_getClockTime();
+    waterlily_recordFlight(WATERLILY_FLIGHT_FRAME, nullptr, nullptr,
+                           now - context.lastFrame);
+    context.lastFrame = now;
+    context.frames++;
+    if (!context.report)
+        return;
+
+    // There's no overlay to draw this on, so --fps goes to the log.
+    uint64_t elapsed = now - context.lastReport;
+    if (elapsed < WATERLILY_PROFILER_REPORT_NS)
+        return;
+
+    waterlily_log(SUCCESS, "%.1f FPS, refresh every %.2f ms%s.",
+                  context.frames * 1e9 / elapsed,
+                  context.presentation.refresh / 1e6,
+                  context.presentation.flags & WATERLILY_PRESENTATION_VSYNC
+                      ? ", vsynced"
+                      : "");
+    if (context.latency.count != 0)
+        logLatency();
+    context.frames = 0;
+    context.lastReport = now;
+}
+
+void waterlily_recordPresentation(uint64_t input, uint64_t presented,
+                                  uint32_t refresh, uint32_t flags)
+{
+    context.presentation.presented++;
+    context.presentation.time = presented;
+    context.presentation.refresh = refresh;
+    context.presentation.flags = flags;
+    if (input == 0)
+        return;
+
+    // Input timestamps are milliseconds that wrap every 49 days, so only
+    // the distance back from the presentation is trusted.
+    uint64_t milliseconds = presented / 1000000;
+    uint32_t since = (uint32_t)milliseconds - (uint32_t)input;
+    // Anything this old is from some other clock, not a slow frame.
+    if (since > 1000)
+        return;
+    waterlily_recordHistogram(&context.latency,
+                              presented - (milliseconds - since) * 1000000);
+}
+
+void waterlily_discardPresentation(void)
+{
+    context.presentation.discarded++;
+}
+
+const waterlily_histogram_t *waterlily_getLatencyHistogram(void)
+{
+    return &context.latency;
+}
+
+uint32_t waterlily_getRefreshInterval(void)
+{
+    return context.presentation.refresh;
+}
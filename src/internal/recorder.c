@@ -0,0 +1,222 @@
+#include <fcntl.h>
+#include <internal/logging.h>
+#include <internal/recorder.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+// Static so there's something to dump no matter how early things go wrong.
+static struct waterlily_flight_context context = {0};
+static const int fatalSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+static struct sigaction previousActions[sizeof(fatalSignals) /
+                                        sizeof(fatalSignals[0])];
+static uint8_t signalStack[WATERLILY_FLIGHT_STACK_SIZE];
+
+static uint64_t getTime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Everything from here to the handler has to be safe inside a signal
+// handler, so no stdio and nothing that allocates.
+struct output
+{
+    int descriptor;
+    size_t length;
+    char buffer[4096];
+};
+
+static void flushOutput(struct output *output)
+{
+    size_t written = 0;
+    while (written < output->length)
+    {
+        ssize_t count = write(output->descriptor, output->buffer + written,
+                              output->length - written);
+        if (count <= 0)
+            break;
+        written += count;
+    }
+    output->length = 0;
+}
+
+static void putString(struct output *output, const char *string)
+{
+    if (string == nullptr)
+        string = "(null)";
+    for (; *string != 0; ++string)
+    {
+        if (output->length == sizeof(output->buffer))
+            flushOutput(output);
+        output->buffer[output->length++] = *string;
+    }
+}
+
+static void putNumber(struct output *output, uint64_t value)
+{
+    char digits[21];
+    size_t count = sizeof(digits);
+    digits[--count] = 0;
+    do
+        digits[--count] = '0' + value % 10;
+    while ((value /= 10) != 0);
+    putString(output, digits + count);
+}
+
+static void putEntry(struct output *output,
+                     const struct waterlily_flight_entry *entry, uint64_t now)
+{
+    static const char *const tags[] = {
+        [WATERLILY_FLIGHT_INFO] = "[INFO] ",
+        [WATERLILY_FLIGHT_SUCCESS] = "[ OK ] ",
+        [WATERLILY_FLIGHT_WARNING] = "[WARN] ",
+        [WATERLILY_FLIGHT_TRACE] = "[TIME] ",
+        [WATERLILY_FLIGHT_FRAME] = "[FRME] ",
+    };
+
+    // Microseconds back from the dump, which is what anyone reading it is
+    // counting from.
+    putString(output, "-");
+    putNumber(output, now > entry->time ? (now - entry->time) / 1000 : 0);
+    putString(output, " us ");
+    putString(output, tags[entry->kind]);
+    switch (entry->kind)
+    {
+        case WATERLILY_FLIGHT_INFO:
+        case WATERLILY_FLIGHT_SUCCESS:
+        case WATERLILY_FLIGHT_WARNING:
+            // Arguments aren't kept, the text log has them if it got out.
+            putString(output, entry->filename);
+            putString(output, " ln. ");
+            putNumber(output, entry->value);
+            putString(output, ": ");
+            putString(output, entry->name);
+            break;
+        case WATERLILY_FLIGHT_TRACE:
+            putString(output, entry->name);
+            putString(output, " took ");
+            putNumber(output, entry->value / 1000);
+            putString(output, " us");
+            break;
+        case WATERLILY_FLIGHT_FRAME:
+            putString(output, "frame took ");
+            putNumber(output, entry->value / 1000);
+            putString(output, " us");
+            break;
+    }
+    putString(output, "\n");
+}
+
+static void dumpOnSignal(int signal)
+{
+    static const char *const names[] = {
+        [SIGSEGV] = "SIGSEGV", [SIGBUS] = "SIGBUS", [SIGFPE] = "SIGFPE",
+        [SIGILL] = "SIGILL",   [SIGABRT] = "SIGABRT",
+    };
+    waterlily_dumpFlight(names[signal]);
+
+    // Hand the signal on to whoever had it before, which is the default
+    // action unless a sanitizer got there first. It's blocked until we
+    // return, so it lands right after.
+    for (size_t i = 0; i < sizeof(fatalSignals) / sizeof(fatalSignals[0]);
+         ++i)
+        if (fatalSignals[i] == signal)
+            (void)sigaction(signal, &previousActions[i], nullptr);
+    (void)raise(signal);
+}
+
+struct waterlily_flight_context *waterlily_createRecorderContext(void)
+{
+    // Stack overflows are exactly when we'd want a dump, and they leave no
+    // stack to run the handler on.
+    stack_t stack = {.ss_sp = signalStack, .ss_size = sizeof(signalStack)};
+    if (sigaltstack(&stack, nullptr) == -1)
+        waterlily_log(WARNING, "Failed to set signal stack, stack overflows "
+                               "won't dump the flight recorder.");
+
+    struct sigaction action = {.sa_handler = dumpOnSignal,
+                               .sa_flags = SA_ONSTACK};
+    (void)sigemptyset(&action.sa_mask);
+    for (size_t i = 0; i < sizeof(fatalSignals) / sizeof(fatalSignals[0]);
+         ++i)
+        if (sigaction(fatalSignals[i], &action, &previousActions[i]) == -1)
+            waterlily_log(WARNING, "Failed to catch signal %d.",
+                          fatalSignals[i]);
+
+    waterlily_log(INFO, "Created flight recorder context.");
+    return &context;
+}
+
+void waterlily_recordFlight(waterlily_flight_kind_t kind, const char *name,
+                            const char *filename, uint64_t value)
+{
+    uint64_t index =
+        atomic_fetch_add_explicit(&context.head, 1, memory_order_relaxed);
+    struct waterlily_flight_entry *entry =
+        &context.entries[index & (WATERLILY_FLIGHT_ENTRIES - 1)];
+
+    atomic_store_explicit(&entry->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    entry->time = getTime();
+    entry->value = value;
+    entry->name = name;
+    entry->filename = filename;
+    entry->kind = kind;
+    atomic_store_explicit(&entry->sequence, index + 1, memory_order_release);
+}
+
+void waterlily_dumpFlight(const char *reason)
+{
+    // A crash while dumping, or a second thread reporting, gets nothing.
+    if (atomic_exchange(&context.dumping, true))
+        return;
+
+    struct output output;
+    output.descriptor = open(WATERLILY_FLIGHT_FILE,
+                             O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (output.descriptor == -1)
+        return;
+    output.length = 0;
+
+    uint64_t now = getTime();
+    uint64_t head = atomic_load_explicit(&context.head, memory_order_acquire);
+    uint64_t first =
+        head > WATERLILY_FLIGHT_ENTRIES ? head - WATERLILY_FLIGHT_ENTRIES : 0;
+    putString(&output, "Flight recorder dumped on: ");
+    putString(&output, reason);
+    putString(&output, "\nUp to the last ");
+    putNumber(&output, head - first);
+    putString(&output, " events, oldest first.\n");
+
+    for (uint64_t i = first; i < head; ++i)
+    {
+        struct waterlily_flight_entry *entry =
+            &context.entries[i & (WATERLILY_FLIGHT_ENTRIES - 1)];
+        if (atomic_load_explicit(&entry->sequence, memory_order_acquire) !=
+            i + 1)
+            continue;
+        // Copied out and checked again, since a thread that's still going
+        // could lap us mid-read.
+        struct waterlily_flight_entry copy;
+        copy.time = entry->time;
+        copy.value = entry->value;
+        copy.name = entry->name;
+        copy.filename = entry->filename;
+        copy.kind = entry->kind;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&entry->sequence, memory_order_relaxed) !=
+                i + 1 ||
+            copy.kind > WATERLILY_FLIGHT_FRAME)
+            continue;
+        putEntry(&output, &copy, now);
+    }
+    flushOutput(&output);
+    close(output.descriptor);
+
+    putString(&output, "[FAIL] Wrote the flight recorder to '"
+                       WATERLILY_FLIGHT_FILE "'.\n");
+    output.descriptor = STDERR_FILENO;
+    flushOutput(&output);
+}
@@ -0,0 +1,70 @@
+#include <internal/logging.h>
+#include <internal/ring.h>
+
+static struct waterlily_ring_context context = {0};
+
+void waterlily_resetRing(uint32_t frame)
+{
+    // Only called once the frame's fence has signalled, so nothing the GPU
+    // still reads is ever handed out again.
+    context.base = (VkDeviceSize)WATERLILY_RING_FRAME_SIZE * frame;
+    context.head = 0;
+}
+
+void *waterlily_allocateRing(VkDeviceSize size, VkDeviceSize *offset)
+{
+    VkDeviceSize start =
+        (context.head + context.alignment - 1) & ~(context.alignment - 1);
+    if (start + size > WATERLILY_RING_FRAME_SIZE)
+        waterlily_report("Ran out of frame memory (%zu bytes requested).",
+                         (size_t)size);
+
+    context.head = start + size;
+    *offset = context.base + start;
+    return context.mapped + *offset;
+}
+
+VkBuffer waterlily_getRingBuffer(void)
+{
+    return context.handle;
+}
+
+struct waterlily_ring_context *
+waterlily_createRingContext(VkPhysicalDevice physical, VkDevice logical)
+{
+    context.logical = logical;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical, &properties);
+    context.alignment = properties.limits.minUniformBufferOffsetAlignment;
+    if (properties.limits.minStorageBufferOffsetAlignment > context.alignment)
+        context.alignment = properties.limits.minStorageBufferOffsetAlignment;
+
+    // One buffer, mapped once for good. Every frame in flight owns a slice
+    // and bump allocates out of it, so nothing is mapped or created per
+    // frame.
+    constexpr VkDeviceSize size =
+        (VkDeviceSize)WATERLILY_RING_FRAME_SIZE * WATERLILY_CONCURRENT_FRAMES;
+    waterlily_createVulkanBuffer(size,
+                                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 &context.handle, &context.memory);
+
+    VkResult result = vkMapMemory(logical, context.memory, 0, VK_WHOLE_SIZE,
+                                  0, (void **)&context.mapped);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to map frame ring, code %d.", result);
+
+    waterlily_log(SUCCESS, "Created frame ring of %d bytes per frame.",
+                  WATERLILY_RING_FRAME_SIZE);
+    return &context;
+}
+
+void waterlily_destroyRingContext(void)
+{
+    vkDestroyBuffer(context.logical, context.handle, nullptr);
+    vkFreeMemory(context.logical, context.memory, nullptr);
+}
@@ -0,0 +1,191 @@
+#include <internal/logging.h>
+#include <internal/ring.h>
+#include <internal/sprites.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct waterlily_sprite_context context = {0};
+
+static const VkVertexInputBindingDescription binding = {
+    .binding = 0,
+    .stride = sizeof(waterlily_sprite_t),
+    .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+};
+
+static const VkVertexInputAttributeDescription attributes[] = {
+    {0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(waterlily_sprite_t, position)},
+    {1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(waterlily_sprite_t, size)},
+    {2, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(waterlily_sprite_t, uv)},
+    {3, 0, VK_FORMAT_R32_UINT, offsetof(waterlily_sprite_t, texture)},
+    {4, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(waterlily_sprite_t, color)},
+    {5, 0, VK_FORMAT_R32_UINT, offsetof(waterlily_sprite_t, animation)},
+};
+
+const VkPipelineVertexInputStateCreateInfo *
+waterlily_getSpriteVertexInput(void)
+{
+    static const VkPipelineVertexInputStateCreateInfo input = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = 1,
+        .pVertexBindingDescriptions = &binding,
+        .vertexAttributeDescriptionCount =
+            sizeof(attributes) / sizeof(attributes[0]),
+        .pVertexAttributeDescriptions = attributes,
+    };
+    return &input;
+}
+
+static inline uint32_t getSortableFloat(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    // Negative floats order backwards, so they're flipped entirely.
+    return bits & 0x80000000 ? ~bits : bits | 0x80000000;
+}
+
+static uint64_t getSortKey(const waterlily_sprite_t *sprite, uint32_t index)
+{
+    // Layer, Y, then atlas, with the sprite's index riding along in the
+    // bits that are never sorted on. There's only the one scene pipeline,
+    // so it takes no bits.
+    uint64_t layer = sprite->layer > 0x7FFF ? 0x7FFF : sprite->layer;
+    uint64_t key = (layer << 49) | index;
+    if (sprite->layer >= WATERLILY_MAX_SORTED_LAYERS ||
+        !(context.sortedLayers[sprite->layer / 64] &
+          (1ull << (sprite->layer % 64))))
+        return key;
+
+    // Top-down sprites stand on their bottom edge. Dropping the lowest
+    // mantissa bits still leaves sub-pixel precision anywhere near the
+    // screen, and saves a pass.
+    uint32_t y = getSortableFloat(sprite->position[1] + sprite->size[1]);
+    key |= (uint64_t)(y >> 8) << 25;
+    return key | (uint64_t)(sprite->texture & 0xFF) << 17;
+}
+
+void waterlily_sortSpriteLayer(uint32_t layer, bool sorted)
+{
+    if (layer >= WATERLILY_MAX_SORTED_LAYERS)
+        waterlily_report("Layer %u can't be sorted (limit %d).", layer,
+                         WATERLILY_MAX_SORTED_LAYERS);
+
+    uint64_t bit = 1ull << (layer % 64);
+    if (sorted)
+        context.sortedLayers[layer / 64] |= bit;
+    else
+        context.sortedLayers[layer / 64] &= ~bit;
+}
+
+void waterlily_drawSprites(const waterlily_sprite_t *sprites, size_t count)
+{
+    if (context.count + count > WATERLILY_MAX_SPRITES)
+    {
+        waterlily_log(WARNING, "Sprite batch full, dropping %zu sprites.",
+                      count);
+        return;
+    }
+
+    memcpy(&context.instances[context.count], sprites,
+           sizeof(waterlily_sprite_t) * count);
+
+    // Keys and their histograms are built while the sprites are still in
+    // cache, so sorting only has to scatter.
+    uint64_t *keys = context.keys[0];
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t index = context.count + i;
+        keys[index] = getSortKey(&sprites[i], index);
+        context.differing |= keys[index] ^ keys[0];
+        uint64_t sorted = keys[index] >> WATERLILY_SPRITE_INDEX_BITS;
+        for (size_t digit = 0; digit < WATERLILY_SPRITE_KEY_DIGITS; ++digit)
+            context.counts[digit][(sorted >> (digit * 8)) & 0xFF]++;
+    }
+    context.count += count;
+}
+
+void waterlily_drawSprite(const waterlily_sprite_t *sprite)
+{
+    waterlily_drawSprites(sprite, 1);
+}
+
+static const uint64_t *sortSprites(void)
+{
+    uint64_t *keys = context.keys[0], *scratch = context.keys[1];
+    auto counts = context.counts;
+
+    // LSD radix sort, which is stable, so equal keys keep their draw order.
+    for (size_t digit = 0; digit < WATERLILY_SPRITE_KEY_DIGITS; ++digit)
+    {
+        size_t shift = WATERLILY_SPRITE_INDEX_BITS + digit * 8;
+        // A digit every key shares can't change the order, and in practice
+        // that's most of them.
+        if (((context.differing >> shift) & 0xFF) == 0)
+            continue;
+
+        uint32_t offset = 0;
+        for (size_t i = 0; i < 256; ++i)
+        {
+            uint32_t count = counts[digit][i];
+            counts[digit][i] = offset;
+            offset += count;
+        }
+
+        for (uint32_t i = 0; i < context.count; ++i)
+            scratch[counts[digit][(keys[i] >> shift) & 0xFF]++] = keys[i];
+
+        uint64_t *swap = keys;
+        keys = scratch;
+        scratch = swap;
+    }
+    return keys;
+}
+
+void waterlily_recordSprites(VkCommandBuffer buffer)
+{
+    if (context.count == 0)
+        return;
+
+    // Sorted sprites are gathered straight into this frame's slice of the
+    // ring, which only ever sees sequential writes.
+    VkDeviceSize offset;
+    waterlily_sprite_t *mapped = waterlily_allocateRing(
+        sizeof(waterlily_sprite_t) * context.count, &offset);
+    const uint64_t *keys = sortSprites();
+    constexpr uint64_t indexMask = (1ull << WATERLILY_SPRITE_INDEX_BITS) - 1;
+    for (uint32_t i = 0; i < context.count; ++i)
+        mapped[i] = context.instances[keys[i] & indexMask];
+    memset(context.counts, 0, sizeof(context.counts));
+    context.differing = 0;
+
+    // Every sprite names its texture by bindless index and there's only one
+    // pipeline, so after sorting every batch merges into one instanced draw.
+    VkBuffer ring = waterlily_getRingBuffer();
+    vkCmdBindVertexBuffers(buffer, 0, 1, &ring, &offset);
+    vkCmdDraw(buffer, 6, context.count, 0, 0);
+    context.count = 0;
+}
+
+struct waterlily_sprite_context *waterlily_createSpriteContext(void)
+{
+    context.instances = malloc(sizeof(waterlily_sprite_t) *
+                               WATERLILY_MAX_SPRITES);
+    if (context.instances == nullptr)
+        waterlily_report("Failed to allocate sprite batch.");
+    for (size_t i = 0; i < 2; ++i)
+    {
+        context.keys[i] = malloc(sizeof(uint64_t) * WATERLILY_MAX_SPRITES);
+        if (context.keys[i] == nullptr)
+            waterlily_report("Failed to allocate sprite sort keys.");
+    }
+
+    waterlily_log(SUCCESS, "Created sprite batch of %d sprites.",
+                  WATERLILY_MAX_SPRITES);
+    return &context;
+}
+
+void waterlily_destroySpriteContext(void)
+{
+    for (size_t i = 0; i < 2; ++i)
+        free(context.keys[i]);
+    free(context.instances);
+}
@@ -0,0 +1,118 @@
+#include <internal/clock.h>
+#include <internal/logging.h>
+#include <internal/profiler.h>
+#include <internal/stats.h>
+#include <string.h>
+
+static struct waterlily_stats_context context = {0};
+
+static const char *const names[] = {
+    [WATERLILY_FRAME_STAT_CPU] = "CPU",
+    [WATERLILY_FRAME_STAT_GPU] = "GPU",
+    [WATERLILY_FRAME_STAT_ACQUIRE] = "Acquire",
+    [WATERLILY_FRAME_STAT_PRESENT] = "Present",
+};
+
+static struct waterlily_frame_summary
+summarize(const struct waterlily_frame_record *record)
+{
+    const waterlily_histogram_t *histogram = &record->histogram;
+    return (struct waterlily_frame_summary){
+        .p50 = waterlily_getHistogramPercentile(histogram, 50),
+        .p90 = waterlily_getHistogramPercentile(histogram, 90),
+        .p99 = waterlily_getHistogramPercentile(histogram, 99),
+        .max = histogram->max,
+        .count = histogram->count,
+        .hitches = record->hitches,
+    };
+}
+
+static void logRecords(const struct waterlily_frame_record *records)
+{
+    for (size_t i = 0; i < WATERLILY_FRAME_STAT_COUNT; ++i)
+    {
+        if (records[i].histogram.count == 0)
+            continue;
+
+        struct waterlily_frame_summary summary = summarize(&records[i]);
+        waterlily_log(SUCCESS,
+                      "%-7s p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f "
+                      "ms, %zu of %zu over budget.",
+                      names[i], summary.p50 / 1e6, summary.p90 / 1e6,
+                      summary.p99 / 1e6, summary.max / 1e6,
+                      (size_t)summary.hitches, (size_t)summary.count);
+    }
+}
+
+struct waterlily_stats_context *waterlily_createStatsContext(uint32_t window)
+{
+    context.report = window != 0;
+    context.window = window != 0 ? window : WATERLILY_STATS_WINDOW;
+    waterlily_log(SUCCESS, "Created frame statistics context, %u frames a "
+                           "window.",
+                  context.window);
+    return &context;
+}
+
+void waterlily_destroyStatsContext(void)
+{
+    if (context.total[WATERLILY_FRAME_STAT_CPU].histogram.count == 0)
+        return;
+
+    waterlily_log(SUCCESS, "Frame times over the whole run:");
+    logRecords(context.total);
+}
+
+void waterlily_beginStatsFrame(void)
+{
+    context.frameStart = waterlily_getClockTime();
+    context.waits = 0;
+}
+
+void waterlily_endStatsFrame(void)
+{
+    uint64_t elapsed = waterlily_getClockTime() - context.frameStart;
+    waterlily_recordFrameStat(WATERLILY_FRAME_STAT_CPU,
+                              elapsed > context.waits ? elapsed - context.waits
+                                                      : 0);
+    if (++context.frames < context.window)
+        return;
+
+    if (context.report)
+    {
+        waterlily_log(SUCCESS, "Frame times over the last %u frames:",
+                      context.frames);
+        logRecords(context.current);
+    }
+    memcpy(context.last, context.current, sizeof(context.last));
+    memset(context.current, 0, sizeof(context.current));
+    context.frames = 0;
+}
+
+void waterlily_recordFrameStat(waterlily_frame_stat_t stat, uint64_t value)
+{
+    if (stat == WATERLILY_FRAME_STAT_ACQUIRE ||
+        stat == WATERLILY_FRAME_STAT_PRESENT)
+        context.waits += value;
+
+    // The compositor's refresh rate is the real budget once it's known.
+    uint64_t budget = waterlily_getRefreshInterval();
+    bool hitch = value > (budget != 0 ? budget : WATERLILY_STATS_BUDGET_NS);
+    waterlily_recordHistogram(&context.total[stat].histogram, value);
+    waterlily_recordHistogram(&context.current[stat].histogram, value);
+    context.total[stat].hitches += hitch;
+    context.current[stat].hitches += hitch;
+}
+
+struct waterlily_frame_summary
+waterlily_getFrameSummary(waterlily_frame_stat_t stat, bool window)
+{
+    return summarize(window ? &context.last[stat] : &context.total[stat]);
+}
+
+const waterlily_histogram_t *
+waterlily_getFrameHistogram(waterlily_frame_stat_t stat, bool window)
+{
+    return window ? &context.last[stat].histogram
+                  : &context.total[stat].histogram;
+}
@@ -0,0 +1,268 @@
+#include <internal/logging.h>
+#include <internal/text.h>
+#include <internal/textures.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct waterlily_text_context context = {0};
+
+static uint64_t hashText(const waterlily_font_t *font, const char *text,
+                         uint32_t color, uint32_t layer)
+{
+    // FNV-1a, seeded with everything but the origin so a moved string still
+    // hits its cached layout.
+    uint64_t hash = 0xCBF29CE484222325;
+    uint64_t seed[] = {(uintptr_t)font, color, layer};
+    const uint8_t *bytes = (const uint8_t *)seed;
+    for (size_t i = 0; i < sizeof(seed); ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001B3;
+    for (; *text != 0; ++text)
+        hash = (hash ^ (uint8_t)*text) * 0x100000001B3;
+    return hash;
+}
+
+static uint32_t decodeCharacter(const char **text)
+{
+    const uint8_t *bytes = (const uint8_t *)*text;
+    uint32_t codepoint = 0xFFFD;
+    size_t length = 1;
+
+    if (bytes[0] < 0x80)
+        codepoint = bytes[0];
+    else if ((bytes[0] & 0xE0) == 0xC0)
+        codepoint = bytes[0] & 0x1F, length = 2;
+    else if ((bytes[0] & 0xF0) == 0xE0)
+        codepoint = bytes[0] & 0x0F, length = 3;
+    else if ((bytes[0] & 0xF8) == 0xF0)
+        codepoint = bytes[0] & 0x07, length = 4;
+
+    for (size_t i = 1; i < length; ++i)
+    {
+        // A truncated sequence only swallows the bytes it actually had.
+        if ((bytes[i] & 0xC0) != 0x80)
+        {
+            *text += i;
+            return 0xFFFD;
+        }
+        codepoint = (codepoint << 6) | (bytes[i] & 0x3F);
+    }
+    *text += length;
+    return codepoint;
+}
+
+static const struct waterlily_archive_glyph *
+findGlyph(const waterlily_font_t *font, uint32_t codepoint)
+{
+    if (codepoint < WATERLILY_ASCII_GLYPHS)
+    {
+        int16_t index = font->ascii[codepoint];
+        return index < 0 ? nullptr : &font->info.glyphs[index];
+    }
+
+    size_t low = 0, high = font->info.glyphCount;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        uint32_t current = font->info.glyphs[middle].codepoint;
+        if (current == codepoint)
+            return &font->info.glyphs[middle];
+        if (current < codepoint)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return nullptr;
+}
+
+static int8_t findKerning(const waterlily_font_t *font, uint32_t first,
+                          uint32_t second)
+{
+    size_t low = 0, high = font->info.kerningCount;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        auto pair = &font->info.kernings[middle];
+        if (pair->first == first && pair->second == second)
+            return pair->amount;
+        if (pair->first < first ||
+            (pair->first == first && pair->second < second))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return 0;
+}
+
+static void layoutText(struct waterlily_text_layout *layout, float x, float y)
+{
+    const waterlily_font_t *font = layout->font;
+    // Every glyph takes at least one byte, so this is always enough.
+    layout->sprites =
+        malloc(sizeof(waterlily_sprite_t) * (strlen(layout->text) + 1));
+    if (layout->sprites == nullptr)
+        waterlily_report("Failed to allocate text layout.");
+    layout->count = 0;
+    layout->origin[0] = x;
+    layout->origin[1] = y;
+
+    float width = font->info.width, height = font->info.height;
+    float pen = x, baseline = y + font->info.ascent;
+    uint32_t previous = 0;
+    const char *text = layout->text;
+    while (*text != 0)
+    {
+        uint32_t codepoint = decodeCharacter(&text);
+        if (codepoint == '\n')
+        {
+            pen = x;
+            baseline += font->info.lineHeight;
+            previous = 0;
+            continue;
+        }
+
+        auto glyph = findGlyph(font, codepoint);
+        if (glyph == nullptr)
+            glyph = findGlyph(font, '?');
+        if (glyph == nullptr)
+            continue;
+
+        if (previous != 0 && font->info.kerningCount != 0)
+            pen += findKerning(font, previous, codepoint);
+        previous = codepoint;
+
+        if (glyph->width != 0 && glyph->height != 0)
+            layout->sprites[layout->count++] = (waterlily_sprite_t){
+                .position = {pen + glyph->xOffset,
+                             baseline - (glyph->height + glyph->yOffset)},
+                .size = {glyph->width, glyph->height},
+                .uv = {glyph->x / width, glyph->y / height,
+                       (glyph->x + glyph->width) / width,
+                       (glyph->y + glyph->height) / height},
+                .texture = font->texture,
+                .color = layout->color,
+                .layer = layout->layer,
+            };
+        pen += glyph->advance;
+    }
+}
+
+static void moveLayout(struct waterlily_text_layout *layout, float x, float y)
+{
+    float dx = x - layout->origin[0], dy = y - layout->origin[1];
+    for (size_t i = 0; i < layout->count; ++i)
+    {
+        layout->sprites[i].position[0] += dx;
+        layout->sprites[i].position[1] += dy;
+    }
+    layout->origin[0] = x;
+    layout->origin[1] = y;
+}
+
+static void evictLayout(struct waterlily_text_layout *layout)
+{
+    free(layout->text);
+    free(layout->sprites);
+    *layout = (struct waterlily_text_layout){0};
+}
+
+void waterlily_drawText(const waterlily_font_t *font, const char *text,
+                        float x, float y, uint32_t color, uint32_t layer)
+{
+    if (font == nullptr)
+        return;
+
+    // Static text is the common case, so an unchanged string costs one hash
+    // and one copy into the sprite batch. The cache is direct mapped, a
+    // collision just lays the newcomer out again.
+    uint64_t hash = hashText(font, text, color, layer);
+    auto layout = &context.cache[hash & (WATERLILY_TEXT_CACHE_SIZE - 1)];
+    if (layout->hash != hash || layout->font != font ||
+        layout->color != color || layout->layer != layer ||
+        layout->text == nullptr || strcmp(layout->text, text) != 0)
+    {
+        evictLayout(layout);
+        layout->hash = hash;
+        layout->font = font;
+        layout->color = color;
+        layout->layer = layer;
+        layout->text = strdup(text);
+        if (layout->text == nullptr)
+            waterlily_report("Failed to copy text.");
+        layoutText(layout, x, y);
+    }
+    else if (layout->origin[0] != x || layout->origin[1] != y)
+        moveLayout(layout, x, y);
+
+    waterlily_drawSprites(layout->sprites, layout->count);
+}
+
+const waterlily_font_t *waterlily_getFont(const char *name)
+{
+    for (size_t i = 0; i < context.fontCount; ++i)
+        if (strcmp(context.fonts[i].info.name, name) == 0)
+            return &context.fonts[i];
+    waterlily_log(WARNING, "Tried to get unknown font '%s'.", name);
+    return nullptr;
+}
+
+static void loadFont(struct waterlily_archive_font_section *section)
+{
+    if (context.fontCount == WATERLILY_MAX_FONTS)
+    {
+        waterlily_log(WARNING, "Skipping font '%s', too many fonts.",
+                      section->name);
+        return;
+    }
+
+    // The archive is closed once loading is done, so the font takes over
+    // its arrays and leaves the section with nothing to free.
+    waterlily_font_t *font = &context.fonts[context.fontCount++];
+    font->info = *section;
+    section->name = nullptr;
+    section->glyphs = nullptr;
+    section->kernings = nullptr;
+
+    font->texture = waterlily_createTexture(
+        font->info.width, font->info.height, VK_FORMAT_R8_UNORM,
+        font->info.pixels, (size_t)font->info.width * font->info.height);
+    font->info.pixels = nullptr;
+
+    for (size_t i = 0; i < WATERLILY_ASCII_GLYPHS; ++i)
+        font->ascii[i] = -1;
+    for (size_t i = 0; i < font->info.glyphCount; ++i)
+        if (font->info.glyphs[i].codepoint < WATERLILY_ASCII_GLYPHS)
+            font->ascii[font->info.glyphs[i].codepoint] = i;
+
+    waterlily_log(SUCCESS, "Loaded font '%s' into texture %u.",
+                  font->info.name, font->texture);
+}
+
+struct waterlily_text_context *
+waterlily_createTextContext(waterlily_file_t *archive)
+{
+    for (size_t i = 0; i < archive->archive.assets.sectionCount; ++i)
+    {
+        auto section = &archive->archive.assets.sections[i];
+        if (section->type == WATERLILY_FONT_SECTION)
+            loadFont(section->font);
+    }
+
+    waterlily_log(SUCCESS, "Created text context with %zu fonts.",
+                  context.fontCount);
+    return &context;
+}
+
+void waterlily_destroyTextContext(void)
+{
+    for (size_t i = 0; i < WATERLILY_TEXT_CACHE_SIZE; ++i)
+        evictLayout(&context.cache[i]);
+
+    // The atlas textures are owned by the texture context and go with it.
+    for (size_t i = 0; i < context.fontCount; ++i)
+    {
+        free(context.fonts[i].info.name);
+        free(context.fonts[i].info.glyphs);
+        free(context.fonts[i].info.kernings);
+    }
+    context.fontCount = 0;
+}
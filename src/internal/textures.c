@@ -0,0 +1,375 @@
+#include <internal/logging.h>
+#include <internal/textures.h>
+#include <internal/vulkan.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct waterlily_texture_context context = {0};
+
+static uint32_t getCapacity(VkPhysicalDevice physical)
+{
+    VkPhysicalDeviceVulkan12Properties indexing = {0};
+    indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties = {0};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &indexing;
+    vkGetPhysicalDeviceProperties2(physical, &properties);
+
+    uint32_t capacity = WATERLILY_MAX_TEXTURES;
+    if (indexing.maxDescriptorSetUpdateAfterBindSampledImages < capacity)
+        capacity = indexing.maxDescriptorSetUpdateAfterBindSampledImages;
+    if (indexing.maxPerStageDescriptorUpdateAfterBindSampledImages < capacity)
+        capacity = indexing.maxPerStageDescriptorUpdateAfterBindSampledImages;
+    return capacity;
+}
+
+static void createSampler(void)
+{
+    // Pixel art never wants filtering between texels.
+    VkSamplerCreateInfo samplerInfo = {0};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    VkResult result = vkCreateSampler(context.logical, &samplerInfo, nullptr,
+                                      &context.sampler);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create texture sampler, code %d.", result);
+}
+
+static void createDescriptorSet(void)
+{
+    VkDescriptorSetLayoutBinding binding = {0};
+    binding.binding = WATERLILY_TEXTURE_BINDING;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = context.capacity;
+    binding.stageFlags = VK_SHADER_STAGE_ALL;
+
+    VkDescriptorBindingFlags bindingFlags =
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+        VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {0};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &(VkDescriptorSetLayoutBindingFlagsCreateInfo){
+        .sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .bindingCount = 1,
+        .pBindingFlags = &bindingFlags,
+    };
+    layoutInfo.flags =
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+
+    VkResult result = vkCreateDescriptorSetLayout(context.logical, &layoutInfo,
+                                                  nullptr, &context.layout);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create texture set layout, code %d.",
+                         result);
+
+    VkDescriptorPoolCreateInfo poolInfo = {0};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &(VkDescriptorPoolSize){
+        .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .descriptorCount = context.capacity,
+    };
+
+    result = vkCreateDescriptorPool(context.logical, &poolInfo, nullptr,
+                                    &context.pool);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create texture pool, code %d.", result);
+
+    VkDescriptorSetAllocateInfo allocateInfo = {0};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = context.pool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &context.layout;
+
+    result =
+        vkAllocateDescriptorSets(context.logical, &allocateInfo, &context.set);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to allocate texture set, code %d.", result);
+}
+
+static uint32_t takeIndex(void)
+{
+    if (context.freeCount == 0)
+        waterlily_report("Ran out of texture slots (%u).", context.capacity);
+    return context.freeList[--context.freeCount];
+}
+
+void waterlily_updateTexture(uint32_t index, VkImageView view,
+                             VkImageLayout layout)
+{
+    context.textures[index].view = view;
+
+    VkWriteDescriptorSet write = {0};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = context.set;
+    write.dstBinding = WATERLILY_TEXTURE_BINDING;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &(VkDescriptorImageInfo){
+        .sampler = context.sampler,
+        .imageView = view,
+        .imageLayout = layout,
+    };
+    vkUpdateDescriptorSets(context.logical, 1, &write, 0, nullptr);
+}
+
+uint32_t waterlily_registerTexture(VkImageView view, VkImageLayout layout)
+{
+    uint32_t index = takeIndex();
+    context.textures[index] = (struct waterlily_texture){
+        .view = view,
+        .used = true,
+    };
+    waterlily_updateTexture(index, view, layout);
+    return index;
+}
+
+static void uploadImage(VkImage image, uint32_t width, uint32_t height,
+                        const void *pixels, size_t size)
+{
+    VkBuffer staging;
+    VkDeviceMemory stagingMemory;
+    waterlily_createVulkanBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 &staging, &stagingMemory);
+
+    void *mapped;
+    VkResult result =
+        vkMapMemory(context.logical, stagingMemory, 0, size, 0, &mapped);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to map texture staging memory, code %d.",
+                         result);
+    memcpy(mapped, pixels, size);
+    vkUnmapMemory(context.logical, stagingMemory);
+
+    VkImageMemoryBarrier2 barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+
+    VkDependencyInfo dependency = {0};
+    dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency.imageMemoryBarrierCount = 1;
+    dependency.pImageMemoryBarriers = &barrier;
+
+    VkCommandBuffer buffer = waterlily_beginVulkanCommands();
+    vkCmdPipelineBarrier2(buffer, &dependency);
+
+    VkBufferImageCopy region = {0};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = (VkExtent3D){width, height, 1};
+    vkCmdCopyBufferToImage(buffer, staging, image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier2(buffer, &dependency);
+
+    waterlily_submitVulkanCommands(buffer);
+
+    vkDestroyBuffer(context.logical, staging, nullptr);
+    vkFreeMemory(context.logical, stagingMemory, nullptr);
+}
+
+uint32_t waterlily_createTexture(uint32_t width, uint32_t height,
+                                 VkFormat format, const void *pixels,
+                                 size_t size)
+{
+    uint32_t index = takeIndex();
+    struct waterlily_texture *texture = &context.textures[index];
+    *texture = (struct waterlily_texture){
+        .extent = {width, height},
+        .owned = true,
+        .used = true,
+    };
+
+    VkImageCreateInfo imageInfo = {0};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = (VkExtent3D){width, height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage =
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkResult result =
+        vkCreateImage(context.logical, &imageInfo, nullptr, &texture->image);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create texture %u, code %d.", index,
+                         result);
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(context.logical, texture->image,
+                                 &requirements);
+    VkMemoryAllocateInfo allocateInfo = {0};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = waterlily_findVulkanMemoryType(
+        context.physical, requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    result = vkAllocateMemory(context.logical, &allocateInfo, nullptr,
+                              &texture->memory);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to allocate texture %u, code %d.", index,
+                         result);
+    vkBindImageMemory(context.logical, texture->image, texture->memory, 0);
+
+    uploadImage(texture->image, width, height, pixels, size);
+
+    VkImageViewCreateInfo viewInfo = {0};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = texture->image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+    // Single channel textures are coverage masks, like font atlases. They
+    // read as white with the coverage in alpha so the sprite color tints
+    // them.
+    if (format == VK_FORMAT_R8_UNORM)
+        viewInfo.components = (VkComponentMapping){
+            VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_ONE,
+            VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_R};
+
+    result = vkCreateImageView(context.logical, &viewInfo, nullptr,
+                               &texture->view);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create texture view %u, code %d.", index,
+                         result);
+
+    waterlily_updateTexture(index, texture->view,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    waterlily_log(SUCCESS, "Created %ux%u texture %u.", width, height, index);
+    return index;
+}
+
+static void destroyTexture(uint32_t index)
+{
+    struct waterlily_texture *texture = &context.textures[index];
+    if (texture->owned)
+    {
+        vkDestroyImageView(context.logical, texture->view, nullptr);
+        vkDestroyImage(context.logical, texture->image, nullptr);
+        vkFreeMemory(context.logical, texture->memory, nullptr);
+    }
+    *texture = (struct waterlily_texture){0};
+    context.freeList[context.freeCount++] = index;
+}
+
+void waterlily_releaseTexture(uint32_t index)
+{
+    // Either would put the slot on the free list twice, or put some other
+    // slot there, and it'd be handed out to two textures at once.
+    if (index >= context.capacity)
+        waterlily_report("Released texture %u, out of range (%u).", index,
+                         context.capacity);
+    struct waterlily_texture *texture = &context.textures[index];
+    if (!texture->used || texture->released)
+        waterlily_report("Released texture %u, which was already free.",
+                         index);
+
+    // Frames still in flight may sample the slot, so it's only recycled once
+    // every one of them has retired.
+    if (context.pendingCount == WATERLILY_MAX_PENDING_TEXTURE_RELEASES)
+        waterlily_report("Too many texture releases pending.");
+    context.pending[context.pendingCount++] = (typeof(context.pending[0])){
+        .index = index,
+        .frame = context.frame + WATERLILY_CONCURRENT_FRAMES,
+    };
+    texture->released = true;
+}
+
+void waterlily_collectTextures(void)
+{
+    context.frame++;
+    for (size_t i = 0; i < context.pendingCount;)
+    {
+        if (context.pending[i].frame > context.frame)
+        {
+            i++;
+            continue;
+        }
+        destroyTexture(context.pending[i].index);
+        context.pending[i] = context.pending[--context.pendingCount];
+    }
+}
+
+void waterlily_bindTextures(VkCommandBuffer buffer, VkPipelineBindPoint point,
+                            VkPipelineLayout layout)
+{
+    vkCmdBindDescriptorSets(buffer, point, layout, WATERLILY_TEXTURE_SET, 1,
+                            &context.set, 0, nullptr);
+}
+
+struct waterlily_texture_context *
+waterlily_createTextureContext(VkPhysicalDevice physical, VkDevice logical)
+{
+    context.physical = physical;
+    context.logical = logical;
+    context.capacity = getCapacity(physical);
+
+    context.textures =
+        calloc(context.capacity, sizeof(struct waterlily_texture));
+    context.freeList = malloc(sizeof(uint32_t) * context.capacity);
+    if (context.textures == nullptr || context.freeList == nullptr)
+        waterlily_report("Failed to allocate texture table.");
+
+    // Hand out low indices first; they're the ones most likely to be cached.
+    for (uint32_t i = 0; i < context.capacity; ++i)
+        context.freeList[i] = context.capacity - i - 1;
+    context.freeCount = context.capacity;
+
+    createSampler();
+    createDescriptorSet();
+    waterlily_log(SUCCESS, "Created bindless texture set with %u slots.",
+                  context.capacity);
+    return &context;
+}
+
+void waterlily_destroyTextureContext(void)
+{
+    for (uint32_t i = 0; i < context.capacity; ++i)
+        if (context.textures[i].used && context.textures[i].owned)
+            destroyTexture(i);
+
+    vkDestroyDescriptorPool(context.logical, context.pool, nullptr);
+    vkDestroyDescriptorSetLayout(context.logical, context.layout, nullptr);
+    vkDestroySampler(context.logical, context.sampler, nullptr);
+    free(context.textures);
+    free(context.freeList);
+}
@@ -0,0 +1,244 @@
+#include <internal/logging.h>
+#include <internal/tiles.h>
+#include <internal/vulkan.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct waterlily_tile_context context = {0};
+
+static void createDescriptorSet(void)
+{
+    VkDescriptorSetLayoutBinding bindings[2] = {0};
+    bindings[0].binding = WATERLILY_TILE_ANIMATION_BINDING;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    bindings[1] = bindings[0];
+    bindings[1].binding = WATERLILY_TILE_FRAME_BINDING;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {0};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 2;
+    layoutInfo.pBindings = bindings;
+
+    VkResult result = vkCreateDescriptorSetLayout(context.logical, &layoutInfo,
+                                                  nullptr, &context.layout);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create tile set layout, code %d.", result);
+
+    VkDescriptorPoolCreateInfo poolInfo = {0};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &(VkDescriptorPoolSize){
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 2,
+    };
+
+    result = vkCreateDescriptorPool(context.logical, &poolInfo, nullptr,
+                                    &context.pool);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create tile pool, code %d.", result);
+
+    VkDescriptorSetAllocateInfo allocateInfo = {0};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocateInfo.descriptorPool = context.pool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &context.layout;
+
+    result =
+        vkAllocateDescriptorSets(context.logical, &allocateInfo, &context.set);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to allocate tile set, code %d.", result);
+}
+
+static struct waterlily_archive_section *findSection(waterlily_file_t *archive)
+{
+    for (size_t i = 0; i < archive->archive.assets.sectionCount; ++i)
+        if (archive->archive.assets.sections[i].type ==
+            WATERLILY_TILE_ANIMATION_SECTION)
+            return &archive->archive.assets.sections[i];
+    return nullptr;
+}
+
+static void fillTable(struct waterlily_archive_section *section,
+                      struct waterlily_tile_animation *animations,
+                      struct waterlily_tile_frame *frames)
+{
+    uint32_t cursor = 0;
+    for (size_t i = 0; i < context.animationCount; ++i)
+    {
+        auto source = &section->animations[i];
+        // Index zero is left zeroed for tiles that don't animate.
+        auto animation = &animations[i + 1];
+        animation->firstFrame = cursor;
+        animation->frameCount = source->frameCount;
+
+        for (size_t j = 0; j < source->frameCount; ++j)
+        {
+            animation->period += source->frames[j].duration;
+            frames[cursor++] = (struct waterlily_tile_frame){
+                .offset = (uint16_t)source->frames[j].x |
+                          ((uint32_t)(uint16_t)source->frames[j].y << 16),
+                .end = animation->period,
+            };
+        }
+
+        // The names are all that's needed on the CPU, so they outlive the
+        // archive.
+        context.names[i] = source->name;
+        source->name = nullptr;
+    }
+}
+
+static void createTable(VkPhysicalDevice physical, waterlily_file_t *archive)
+{
+    auto section = findSection(archive);
+    size_t frameCount = 0;
+    if (section != nullptr)
+    {
+        context.animationCount = section->count;
+        for (size_t i = 0; i < section->count; ++i)
+            frameCount += section->animations[i].frameCount;
+    }
+
+    context.names = calloc(context.animationCount + 1, sizeof(char *));
+    if (context.names == nullptr)
+        waterlily_report("Failed to allocate tile animation names.");
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical, &properties);
+    VkDeviceSize alignment =
+        properties.limits.minStorageBufferOffsetAlignment;
+
+    // Both tables share one buffer, the frames just start at the next
+    // offset the device can bind.
+    VkDeviceSize animationSize =
+        sizeof(struct waterlily_tile_animation) * (context.animationCount + 1);
+    VkDeviceSize frameOffset =
+        (animationSize + alignment - 1) / alignment * alignment;
+    VkDeviceSize frameSize = sizeof(struct waterlily_tile_frame) *
+                             (frameCount == 0 ? 1 : frameCount);
+    VkDeviceSize size = frameOffset + frameSize;
+
+    uint8_t *table = calloc(size, 1);
+    if (table == nullptr)
+        waterlily_report("Failed to allocate tile animation table.");
+    fillTable(section, (struct waterlily_tile_animation *)table,
+              (struct waterlily_tile_frame *)(table + frameOffset));
+
+    waterlily_createVulkanBuffer(size,
+                                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                 &context.table.handle, &context.table.memory);
+    waterlily_uploadVulkanBuffer(context.table.handle, table, size);
+    free(table);
+
+    VkDescriptorBufferInfo infos[2] = {
+        {context.table.handle, 0, animationSize},
+        {context.table.handle, frameOffset, frameSize},
+    };
+    VkWriteDescriptorSet writes[2] = {0};
+    for (size_t i = 0; i < 2; ++i)
+    {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = context.set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &infos[i];
+    }
+    vkUpdateDescriptorSets(context.logical, 2, writes, 0, nullptr);
+
+    waterlily_log(SUCCESS, "Uploaded %zu tile animations with %zu frames.",
+                  context.animationCount, frameCount);
+}
+
+uint32_t waterlily_getTileAnimation(const char *name)
+{
+    for (size_t i = 0; i < context.animationCount; ++i)
+        if (strcmp(context.names[i], name) == 0)
+            return i + 1;
+    waterlily_log(WARNING, "Tried to get unknown tile animation '%s'.", name);
+    return 0;
+}
+
+uint32_t waterlily_createTileLayer(const waterlily_sprite_t *tiles,
+                                   size_t count)
+{
+    if (context.layerCount == WATERLILY_MAX_TILE_LAYERS)
+        waterlily_report("Ran out of tile layers (%d).",
+                         WATERLILY_MAX_TILE_LAYERS);
+
+    // Tiles never change after upload, so they live in device local memory
+    // and cost nothing per frame. Animation happens entirely in the shader.
+    auto layer = &context.layers[context.layerCount];
+    VkDeviceSize size = sizeof(waterlily_sprite_t) * count;
+    waterlily_createVulkanBuffer(size,
+                                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                     VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                 &layer->handle, &layer->memory);
+    waterlily_uploadVulkanBuffer(layer->handle, tiles, size);
+    layer->count = count;
+
+    waterlily_log(SUCCESS, "Created tile layer %zu with %zu tiles.",
+                  context.layerCount, count);
+    return context.layerCount++;
+}
+
+void waterlily_clearTileLayers(void)
+{
+    // Layers only change on map transitions, so waiting out the frames in
+    // flight is simpler than deferring the frees.
+    vkDeviceWaitIdle(context.logical);
+    for (size_t i = 0; i < context.layerCount; ++i)
+    {
+        vkDestroyBuffer(context.logical, context.layers[i].handle, nullptr);
+        vkFreeMemory(context.logical, context.layers[i].memory, nullptr);
+    }
+    context.layerCount = 0;
+}
+
+void waterlily_bindTileAnimations(VkCommandBuffer buffer,
+                                  VkPipelineLayout layout)
+{
+    vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout,
+                            WATERLILY_TILE_ANIMATION_SET, 1, &context.set, 0,
+                            nullptr);
+}
+
+void waterlily_recordTiles(VkCommandBuffer buffer)
+{
+    VkDeviceSize offset = 0;
+    for (size_t i = 0; i < context.layerCount; ++i)
+    {
+        vkCmdBindVertexBuffers(buffer, 0, 1, &context.layers[i].handle,
+                               &offset);
+        vkCmdDraw(buffer, 6, context.layers[i].count, 0, 0);
+    }
+}
+
+struct waterlily_tile_context *
+waterlily_createTileContext(VkPhysicalDevice physical, VkDevice logical,
+                            waterlily_file_t *archive)
+{
+    context.logical = logical;
+    createDescriptorSet();
+    createTable(physical, archive);
+    return &context;
+}
+
+void waterlily_destroyTileContext(void)
+{
+    waterlily_clearTileLayers();
+    vkDestroyBuffer(context.logical, context.table.handle, nullptr);
+    vkFreeMemory(context.logical, context.table.memory, nullptr);
+    vkDestroyDescriptorPool(context.logical, context.pool, nullptr);
+    vkDestroyDescriptorSetLayout(context.logical, context.layout, nullptr);
+
+    for (size_t i = 0; i < context.animationCount; ++i)
+        free(context.names[i]);
+    free(context.names);
+}
@@ -0,0 +1,159 @@
+#include <internal/logging.h>
+#include <internal/recorder.h>
+#include <internal/trace.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct waterlily_trace_context context = {0};
+// Claimed on a thread's first event, null afterwards if none were left.
+static thread_local struct waterlily_trace_buffer *threadBuffer = nullptr;
+static thread_local bool claimed = false;
+
+static uint64_t getTime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void requestTrace(int)
+{
+    atomic_store_explicit(&context.requested, true, memory_order_relaxed);
+}
+
+struct waterlily_trace_context *waterlily_createTraceContext(const char *path)
+{
+    if (path == nullptr)
+        return &context;
+
+    context.path = path;
+    context.start = getTime();
+    // Only a flag is set here, the file is written outside the handler.
+    struct sigaction action = {.sa_handler = requestTrace,
+                               .sa_flags = SA_RESTART};
+    (void)sigemptyset(&action.sa_mask);
+    if (sigaction(SIGUSR1, &action, nullptr) == -1)
+        waterlily_log(WARNING, "Failed to catch SIGUSR1, traces are only "
+                               "written at exit.");
+    atomic_store(&context.enabled, true);
+    waterlily_log(SUCCESS, "Tracing into '%s', send SIGUSR1 to write it.",
+                  path);
+    return &context;
+}
+
+void waterlily_destroyTraceContext(void)
+{
+    if (!atomic_exchange(&context.enabled, false))
+        return;
+
+    waterlily_writeTrace();
+    size_t dropped = atomic_load(&context.dropped);
+    if (dropped != 0)
+        waterlily_log(WARNING, "Ran out of trace buffers, dropped %zu events.",
+                      dropped);
+    // Other threads could still be tracing, so their buffers stay.
+}
+
+void waterlily_writeTrace(void)
+{
+    FILE *file = fopen(context.path, "w");
+    if (file == nullptr)
+    {
+        waterlily_log(WARNING, "Failed to open trace '%s'.", context.path);
+        return;
+    }
+
+    // Chrome's trace event format, which Perfetto reads too. Every event is
+    // a complete one, with times in microseconds, and threads go by the
+    // order they first traced in.
+    pid_t process = getpid();
+    bool first = true;
+    size_t total = 0;
+    (void)fputs("{\"traceEvents\":[", file);
+    uint32_t count = atomic_load(&context.bufferCount);
+    if (count > WATERLILY_TRACE_THREADS)
+        count = WATERLILY_TRACE_THREADS;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        struct waterlily_trace_buffer *buffer = &context.buffers[i];
+        if (buffer->events == nullptr)
+            continue;
+
+        size_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        size_t j = head > WATERLILY_TRACE_EVENTS ? head - WATERLILY_TRACE_EVENTS
+                                                 : 0;
+        for (; j < head; ++j)
+        {
+            struct waterlily_trace_event event =
+                buffer->events[j & (WATERLILY_TRACE_EVENTS - 1)];
+            // The thread keeps tracing meanwhile, and once it's a whole ring
+            // ahead the copy could be half of a newer event.
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&buffer->head, memory_order_relaxed) >=
+                j + WATERLILY_TRACE_EVENTS)
+                continue;
+
+            (void)fprintf(file,
+                          "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+                          "\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+                          first ? "" : ",", event.name,
+                          (event.start - context.start) / 1e3,
+                          event.duration / 1e3, process, i);
+            first = false;
+            total++;
+        }
+    }
+    (void)fputs("\n]}\n", file);
+    (void)fclose(file);
+    waterlily_log(SUCCESS, "Wrote %zu trace events to '%s'.", total,
+                  context.path);
+}
+
+waterlily_trace_t waterlily_beginTrace(const char *name)
+{
+    return (waterlily_trace_t){name, getTime()};
+}
+
+void waterlily_endTrace(waterlily_trace_t *trace)
+{
+    uint64_t now = getTime();
+    waterlily_recordFlight(WATERLILY_FLIGHT_TRACE, trace->name, nullptr,
+                           now - trace->start);
+    if (!atomic_load_explicit(&context.enabled, memory_order_relaxed))
+        return;
+
+    if (!claimed)
+    {
+        claimed = true;
+        uint32_t index = atomic_fetch_add(&context.bufferCount, 1);
+        if (index < WATERLILY_TRACE_THREADS)
+        {
+            struct waterlily_trace_buffer *buffer = &context.buffers[index];
+            buffer->events =
+                calloc(WATERLILY_TRACE_EVENTS, sizeof(buffer->events[0]));
+            if (buffer->events != nullptr)
+                threadBuffer = buffer;
+        }
+    }
+
+    if (threadBuffer == nullptr)
+        atomic_fetch_add_explicit(&context.dropped, 1, memory_order_relaxed);
+    else
+    {
+        // A full ring overwrites its oldest event.
+        size_t head =
+            atomic_load_explicit(&threadBuffer->head, memory_order_relaxed);
+        threadBuffer->events[head & (WATERLILY_TRACE_EVENTS - 1)] =
+            (struct waterlily_trace_event){trace->name, trace->start,
+                                           now - trace->start};
+        atomic_store_explicit(&threadBuffer->head, head + 1,
+                              memory_order_release);
+    }
+
+    if (atomic_load_explicit(&context.requested, memory_order_relaxed) &&
+        atomic_exchange(&context.requested, false))
+        waterlily_writeTrace();
+}
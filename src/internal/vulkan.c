@@ -1,11 +1,30 @@
+#include <errno.h>
+#include <internal/clock.h>
 #include <internal/files.h>
+#include <internal/graph.h>
+#include <internal/lights.h>
 #include <internal/logging.h>
+#include <internal/particles.h>
+#include <internal/ring.h>
+#include <internal/sprites.h>
+#include <internal/stats.h>
+#include <internal/text.h>
+#include <internal/textures.h>
+#include <internal/tiles.h>
+#include <internal/trace.h>
 #include <internal/vulkan.h>
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <vulkan/vulkan_wayland.h>
 
 static struct waterlily_vulkan_context context = {0};
+static struct waterlily_texture_context *textures = nullptr;
+static struct waterlily_tile_context *tiles = nullptr;
+static struct waterlily_light_context *lights = nullptr;
 
 static void createCommandBuffers(void)
 {
@@ -33,6 +52,61 @@ static void createCommandBuffers(void)
     waterlily_log(SUCCESS, "Created command buffers.");
 }
 
+static void createQueryPool(void)
+{
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(context.gpu.physical,
+                                             &queueFamilyCount, nullptr);
+    VkQueueFamilyProperties queueFamilies[queueFamilyCount];
+    vkGetPhysicalDeviceQueueFamilyProperties(context.gpu.physical,
+                                             &queueFamilyCount, queueFamilies);
+    uint32_t bits =
+        queueFamilies[context.gpu.graphicsQueue.index].timestampValidBits;
+    if (bits == 0)
+    {
+        waterlily_log(WARNING, "Graphics queue can't timestamp, GPU frame "
+                               "times won't be recorded.");
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context.gpu.physical, &properties);
+    context.timestamps.period = properties.limits.timestampPeriod;
+    context.timestamps.mask = bits == 64 ? UINT64_MAX : (1ULL << bits) - 1;
+
+    VkQueryPoolCreateInfo poolInfo = {0};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = 2 * WATERLILY_CONCURRENT_FRAMES;
+
+    VkResult result = vkCreateQueryPool(context.gpu.logical, &poolInfo,
+                                        nullptr, &context.timestamps.pool);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create timestamp query pool, code %d.",
+                         result);
+    waterlily_log(SUCCESS, "Created timestamp query pool.");
+}
+
+static void readTimestamps(void)
+{
+    uint32_t frame = context.currentFrame;
+    if (!context.timestamps.pending[frame])
+        return;
+    context.timestamps.pending[frame] = false;
+
+    // The frame's fence was just waited on, so there's no waiting here.
+    uint64_t stamps[2];
+    VkResult result = vkGetQueryPoolResults(
+        context.gpu.logical, context.timestamps.pool, frame * 2, 2,
+        sizeof(stamps), stamps, sizeof(stamps[0]), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS)
+        return;
+
+    uint64_t ticks = (stamps[1] - stamps[0]) & context.timestamps.mask;
+    waterlily_recordFrameStat(WATERLILY_FRAME_STAT_GPU,
+                              ticks * (double)context.timestamps.period);
+}
+
 static void createSyncDevices(void)
 {
     VkSemaphoreCreateInfo semaphoreInfo = {0};
@@ -70,117 +144,320 @@ static void createSyncDevices(void)
             waterlily_report("Failed to create fence %zu, code %d.", i, result);
     }
 }
-static uint32_t scoreDevice(const char *const *const extensions, size_t count)
+static bool hasExtensions(VkPhysicalDevice device,
+                          const char *const *const extensions, size_t count)
 {
-    VkPhysicalDeviceProperties properties;
-    VkPhysicalDeviceFeatures features;
-    vkGetPhysicalDeviceProperties(context.gpu.physical, &properties);
-    vkGetPhysicalDeviceFeatures(context.gpu.physical, &features);
-
-    uint32_t score = 0;
-    switch (properties.deviceType)
-    {
-        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
-            score += 4;
-            break;
-        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
-            score += 3;
-            break;
-        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
-            score += 2;
-            break;
-        default:
-            score += 1;
-            break;
-    }
-
     uint32_t extensionCount = 0;
-    vkEnumerateDeviceExtensionProperties(context.gpu.physical, nullptr,
-                                         &extensionCount, nullptr);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                         nullptr);
     VkExtensionProperties foundExtensions[extensionCount];
-    vkEnumerateDeviceExtensionProperties(context.gpu.physical, nullptr,
-                                         &extensionCount, foundExtensions);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                         foundExtensions);
 
-    size_t requiredCount = count;
     size_t foundCount = 0;
-    for (size_t i = 0; i < extensionCount; ++i)
-    {
-        if (foundCount == requiredCount)
-            break;
-
-        VkExtensionProperties extension = foundExtensions[i];
-        waterlily_log(INFO, "Found extension '%s'.", extension.extensionName);
-
-        for (size_t j = 0; j < requiredCount; ++j)
-            if (strcmp(extension.extensionName, extensions[j]) == 0)
+    for (size_t i = 0; i < extensionCount && foundCount != count; ++i)
+        for (size_t j = 0; j < count; ++j)
+            if (strcmp(foundExtensions[i].extensionName, extensions[j]) == 0)
             {
                 foundCount++;
-                waterlily_log(SUCCESS, "Found '%s' device extension.",
-                              extension.extensionName);
                 break;
             }
-    }
+    return foundCount == count;
+}
 
-    if (foundCount != requiredCount)
-        waterlily_report("Failed to find all required device extensions.");
+static bool hasFeatures(VkPhysicalDevice device)
+{
+    // Only valid to ask once the swapchain maintenance extension is known to
+    // be there.
+    VkPhysicalDeviceSwapchainMaintenance1FeaturesKHR maintenance = {0};
+    maintenance.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_KHR;
+    VkPhysicalDeviceVulkan13Features features13 = {0};
+    features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    features13.pNext = &maintenance;
+    VkPhysicalDeviceVulkan12Features features12 = {0};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.pNext = &features13;
+    VkPhysicalDeviceFeatures2 features = {0};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features12;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+
+    return maintenance.swapchainMaintenance1 && features13.synchronization2 &&
+           features13.dynamicRendering && features12.descriptorIndexing &&
+           features12.shaderSampledImageArrayNonUniformIndexing &&
+           features12.descriptorBindingSampledImageUpdateAfterBind &&
+           features12.descriptorBindingUpdateUnusedWhilePending &&
+           features12.descriptorBindingPartiallyBound &&
+           features12.runtimeDescriptorArray;
+}
 
+static bool findQueues(VkPhysicalDevice device, uint32_t *graphics,
+                       uint32_t *present)
+{
     uint32_t queueFamilyCount = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(context.gpu.physical,
-                                             &queueFamilyCount, nullptr);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
+                                             nullptr);
     VkQueueFamilyProperties queueFamilies[queueFamilyCount];
-    vkGetPhysicalDeviceQueueFamilyProperties(context.gpu.physical,
-                                             &queueFamilyCount, queueFamilies);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
+                                             queueFamilies);
 
     bool foundGraphicsQueue = false, foundPresentQueue = false;
     for (size_t i = 0; i < queueFamilyCount; i++)
     {
-        if (foundGraphicsQueue && foundPresentQueue)
-            break;
+        bool graphicsSupport =
+            queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT;
+        VkBool32 presentSupport = false;
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, context.surface.handle,
+                                             &presentSupport);
 
-        VkQueueFamilyProperties family = queueFamilies[i];
-        if (family.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        // A family that does both spares every frame a queue ownership
+        // transfer, so it wins outright.
+        if (graphicsSupport && presentSupport)
         {
-            context.gpu.graphicsQueue.index = i;
-            foundGraphicsQueue = true;
+            *graphics = *present = i;
+            return true;
         }
 
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(
-            context.gpu.physical, i, context.surface.handle, &presentSupport);
-        if (presentSupport)
+        if (graphicsSupport && !foundGraphicsQueue)
         {
-            context.gpu.presentQueue.index = i;
+            *graphics = i;
+            foundGraphicsQueue = true;
+        }
+        if (presentSupport && !foundPresentQueue)
+        {
+            *present = i;
             foundPresentQueue = true;
         }
     }
+    return foundGraphicsQueue && foundPresentQueue;
+}
+
+static uint64_t scoreDevice(VkPhysicalDevice device,
+                            const char *const *const extensions, size_t count,
+                            uint32_t *graphics, uint32_t *present)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+
+    if (!hasExtensions(device, extensions, count))
+    {
+        waterlily_log(INFO, "Device '%s' lacks required extensions.",
+                      properties.deviceName);
+        return 0;
+    }
+    if (!hasFeatures(device))
+    {
+        waterlily_log(INFO, "Device '%s' lacks required features.",
+                      properties.deviceName);
+        return 0;
+    }
+    if (!findQueues(device, graphics, present))
+    {
+        waterlily_log(INFO, "Device '%s' lacks required queues.",
+                      properties.deviceName);
+        return 0;
+    }
+
+    uint64_t type = 0;
+    switch (properties.deviceType)
+    {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            type = 4;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            type = 3;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            type = 2;
+            break;
+        default:
+            type = 1;
+            break;
+    }
+
+    VkPhysicalDeviceMemoryProperties memory;
+    vkGetPhysicalDeviceMemoryProperties(device, &memory);
+    uint64_t heap = 0;
+    for (size_t i = 0; i < memory.memoryHeapCount; ++i)
+        if (memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT &&
+            memory.memoryHeaps[i].size > heap)
+            heap = memory.memoryHeaps[i].size;
+
+    // Device type always dominates, then the biggest local heap in MiB, and
+    // a shared graphics/present family only breaks ties.
+    waterlily_log(INFO, "Device '%s' is suitable with %lu MiB of local memory.",
+                  properties.deviceName, (unsigned long)(heap >> 20));
+    return (type << 40) | ((heap >> 20) << 1) | (*graphics == *present);
+}
+
+static void getDeviceIdentity(VkPhysicalDevice device,
+                              struct waterlily_vulkan_device_cache *identity)
+{
+    VkPhysicalDeviceIDProperties ids = {0};
+    ids.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties = {0};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &ids;
+    vkGetPhysicalDeviceProperties2(device, &properties);
+
+    memcpy(identity->uuid, ids.deviceUUID, VK_UUID_SIZE);
+    identity->driverVersion = properties.properties.driverVersion;
+}
+
+static FILE *openDeviceCache(const char *mode)
+{
+    char directory[PATH_MAX];
+    const char *base = getenv("XDG_CACHE_HOME");
+    if (base != nullptr && *base != 0)
+        (void)snprintf(directory, sizeof(directory), "%s", base);
+    else if ((base = getenv("HOME")) != nullptr)
+        (void)snprintf(directory, sizeof(directory), "%s/.cache", base);
+    else
+        return nullptr;
+
+    // A fresh account might not have a cache directory yet.
+    if (*mode == 'w' && mkdir(directory, 0700) == -1 && errno != EEXIST)
+        return nullptr;
+
+    char path[PATH_MAX + sizeof(WATERLILY_DEVICE_CACHE)];
+    (void)snprintf(path, sizeof(path), "%s/" WATERLILY_DEVICE_CACHE,
+                   directory);
+    return fopen(path, mode);
+}
+
+static bool useCachedDevice(VkPhysicalDevice *devices, size_t deviceCount)
+{
+    FILE *file = openDeviceCache("rb");
+    if (file == nullptr)
+        return false;
+    struct waterlily_vulkan_device_cache cached;
+    size_t read = fread(&cached, sizeof(cached), 1, file);
+    (void)fclose(file);
+    if (read != 1)
+        return false;
+
+    for (size_t i = 0; i < deviceCount; ++i)
+    {
+        struct waterlily_vulkan_device_cache identity;
+        getDeviceIdentity(devices[i], &identity);
+        // A driver update might change what the device supports, so only an
+        // exact match skips the scan.
+        if (memcmp(identity.uuid, cached.uuid, VK_UUID_SIZE) != 0 ||
+            identity.driverVersion != cached.driverVersion)
+            continue;
+
+        // The surface is new every launch, so presenting is the one thing
+        // that still needs asking.
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &queueFamilyCount,
+                                                 nullptr);
+        VkBool32 presentSupport = false;
+        if (cached.graphicsQueue < queueFamilyCount &&
+            cached.presentQueue < queueFamilyCount)
+            vkGetPhysicalDeviceSurfaceSupportKHR(
+                devices[i], cached.presentQueue, context.surface.handle,
+                &presentSupport);
+        if (!presentSupport)
+            return false;
 
-    if (!foundGraphicsQueue || !foundPresentQueue)
-        waterlily_report("Failed to find required queue.");
-    return score;
+        context.gpu.physical = devices[i];
+        context.gpu.graphicsQueue.index = cached.graphicsQueue;
+        context.gpu.presentQueue.index = cached.presentQueue;
+        waterlily_log(SUCCESS, "Reused cached Vulkan device.");
+        return true;
+    }
+    return false;
 }
 
-static void getPhysicalGPU(const char *const *const extensions, size_t count)
+static void writeDeviceCache(void)
+{
+    struct waterlily_vulkan_device_cache identity;
+    getDeviceIdentity(context.gpu.physical, &identity);
+    identity.graphicsQueue = context.gpu.graphicsQueue.index;
+    identity.presentQueue = context.gpu.presentQueue.index;
+
+    FILE *file = openDeviceCache("wb");
+    if (file == nullptr ||
+        fwrite(&identity, sizeof(identity), 1, file) != 1)
+        waterlily_log(WARNING, "Failed to cache Vulkan device choice.");
+    if (file != nullptr)
+        (void)fclose(file);
+}
+
+static bool isSelected(VkPhysicalDevice device, size_t index,
+                       const char *selection)
+{
+    char *end = nullptr;
+    unsigned long wanted = strtoul(selection, &end, 10);
+    if (end != selection && *end == 0)
+        return wanted == index;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    return strstr(properties.deviceName, selection) != nullptr;
+}
+
+static bool pickDevice(VkPhysicalDevice *devices, size_t deviceCount,
+                       const char *const *const extensions, size_t count,
+                       const char *selection)
+{
+    uint64_t bestScore = 0;
+    for (size_t i = 0; i < deviceCount; i++)
+    {
+        if (selection != nullptr && !isSelected(devices[i], i, selection))
+            continue;
+
+        uint32_t graphics = 0, present = 0;
+        uint64_t score =
+            scoreDevice(devices[i], extensions, count, &graphics, &present);
+        if (score <= bestScore)
+            continue;
+
+        bestScore = score;
+        context.gpu.physical = devices[i];
+        context.gpu.graphicsQueue.index = graphics;
+        context.gpu.presentQueue.index = present;
+    }
+    return bestScore != 0;
+}
+
+static void getPhysicalGPU(const char *const *const extensions, size_t count,
+                           const char *selection)
 {
     uint32_t deviceCount = 0;
     vkEnumeratePhysicalDevices(context.instance, &deviceCount, nullptr);
     VkPhysicalDevice devices[deviceCount];
     vkEnumeratePhysicalDevices(context.instance, &deviceCount, devices);
 
-    uint32_t bestScore = 0;
-    for (size_t i = 0; i < deviceCount; i++)
+    // The environment beats the configuration file so a single launch can be
+    // pointed elsewhere without editing anything.
+    const char *environment = getenv("WATERLILY_DEVICE");
+    if (environment != nullptr && *environment != 0)
+        selection = environment;
+
+    if (selection != nullptr)
     {
-        context.gpu.physical = devices[i];
-        uint32_t score = scoreDevice(extensions, count);
-        if (score > bestScore)
-            bestScore = score;
+        if (pickDevice(devices, deviceCount, extensions, count, selection))
+        {
+            waterlily_log(SUCCESS, "Using selected Vulkan device '%s'.",
+                          selection);
+            return;
+        }
+        waterlily_log(WARNING,
+                      "Selected device '%s' is unsuitable, picking another.",
+                      selection);
     }
+    else if (useCachedDevice(devices, deviceCount))
+        return;
 
-    if (bestScore == 0)
+    if (!pickDevice(devices, deviceCount, extensions, count, nullptr))
         waterlily_report("Failed to find suitable Vulkan device.");
+    writeDeviceCache();
     waterlily_log(SUCCESS, "Found suitable Vulkan device.");
 }
 
-static void createLogicalGPU(void)
+static void createLogicalGPU(const char *selection)
 {
     float priority = 1.0f;
     VkDeviceQueueCreateInfo queueCreateInfos[2] = {{0}, {0}};
@@ -203,14 +480,34 @@ static void createLogicalGPU(void)
         context.gpu.graphicsQueue.index == context.gpu.presentQueue.index ? 1
                                                                           : 2;
     logicalDeviceCreateInfo.pEnabledFeatures = nullptr;
+
+    VkPhysicalDeviceSwapchainMaintenance1FeaturesKHR maintenanceFeatures = {0};
+    maintenanceFeatures.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_KHR;
+    maintenanceFeatures.swapchainMaintenance1 = true;
+
+    // Dynamic rendering and synchronization2 are what the frame graph records
+    // with.
+    VkPhysicalDeviceVulkan13Features features13 = {0};
+    features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    features13.pNext = &maintenanceFeatures;
+    features13.synchronization2 = true;
+    features13.dynamicRendering = true;
+
+    // Descriptor indexing backs the single bindless texture set.
+    VkPhysicalDeviceVulkan12Features features12 = {0};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.pNext = &features13;
+    features12.descriptorIndexing = true;
+    features12.shaderSampledImageArrayNonUniformIndexing = true;
+    features12.descriptorBindingSampledImageUpdateAfterBind = true;
+    features12.descriptorBindingUpdateUnusedWhilePending = true;
+    features12.descriptorBindingPartiallyBound = true;
+    features12.runtimeDescriptorArray = true;
+
     logicalDeviceCreateInfo.pNext = &(VkPhysicalDeviceFeatures2){
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
-        .pNext =
-            &(VkPhysicalDeviceSwapchainMaintenance1FeaturesKHR){
-                .sType =
-                    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_KHR,
-                .swapchainMaintenance1 = true,
-            },
+        .pNext = &features12,
     };
 
     const char *const extensions[] = {
@@ -222,7 +519,8 @@ static void createLogicalGPU(void)
         sizeof(extensions) / sizeof(char *);
     logicalDeviceCreateInfo.ppEnabledExtensionNames = extensions;
 
-    getPhysicalGPU(extensions, logicalDeviceCreateInfo.enabledExtensionCount);
+    getPhysicalGPU(extensions, logicalDeviceCreateInfo.enabledExtensionCount,
+                   selection);
 
     VkResult code =
         vkCreateDevice(context.gpu.physical, &logicalDeviceCreateInfo, nullptr,
@@ -242,6 +540,19 @@ static void createPipelineLayout(void)
 {
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    VkDescriptorSetLayout setLayouts[] = {
+        [WATERLILY_TEXTURE_SET] = textures->layout,
+        [WATERLILY_TILE_ANIMATION_SET] = tiles->layout,
+        [WATERLILY_LIGHTMAP_SET] = lights->sceneLayout,
+    };
+    pipelineLayoutInfo.setLayoutCount =
+        sizeof(setLayouts) / sizeof(setLayouts[0]);
+    pipelineLayoutInfo.pSetLayouts = setLayouts;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &(VkPushConstantRange){
+        .stageFlags = VK_SHADER_STAGE_ALL,
+        .size = sizeof(struct waterlily_push_constants),
+    };
 
     VkResult result =
         vkCreatePipelineLayout(context.gpu.logical, &pipelineLayoutInfo,
@@ -251,46 +562,6 @@ static void createPipelineLayout(void)
     waterlily_log(SUCCESS, "Created pipeline layout.");
 }
 
-static void createPipelineRenderpass(void)
-{
-    VkAttachmentReference colorAttachmentRef = {0};
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription description = {0};
-    description.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    description.colorAttachmentCount = 1;
-    description.pColorAttachments = &colorAttachmentRef;
-
-    VkSubpassDependency dependency = {0};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    VkAttachmentDescription colorAttachment = {0};
-    colorAttachment.format = context.surface.format.format;
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    VkRenderPassCreateInfo renderPassInfo = {0};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &description;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
-
-    VkResult result = vkCreateRenderPass(context.gpu.logical, &renderPassInfo,
-                                         nullptr, &context.pipeline.renderpass);
-    if (result != VK_SUCCESS)
-        waterlily_report("Failed to create renderpass. Code: %d.", result);
-    waterlily_log(SUCCESS, "Created renderpass.");
-}
-
 static void createShaderStages(VkPipelineShaderStageCreateInfo *storage)
 {
     waterlily_file_t shaderFile = {
@@ -331,6 +602,8 @@ static void createShaderStages(VkPipelineShaderStageCreateInfo *storage)
             waterlily_report("Failed to create shader module, code %d.",
                              result);
     }
+    // The modules hold their own copies of the code.
+    waterlily_closeFile(&shaderFile);
 }
 
 static void createPipeline(void)
@@ -348,16 +621,7 @@ static void createPipeline(void)
         .viewportCount = 1,
         .scissorCount = 1,
     };
-    pipelineInfo.pVertexInputState =
-        &(struct VkPipelineVertexInputStateCreateInfo){
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-            .pNext = nullptr,
-            .flags = 0,
-            .vertexBindingDescriptionCount = 0,
-            .pVertexBindingDescriptions = nullptr,
-            .vertexAttributeDescriptionCount = 0,
-            .pVertexAttributeDescriptions = nullptr,
-        };
+    pipelineInfo.pVertexInputState = waterlily_getSpriteVertexInput();
     pipelineInfo.pInputAssemblyState = &(
         struct VkPipelineInputAssemblyStateCreateInfo){
         .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
@@ -374,7 +638,7 @@ static void createPipeline(void)
             .depthClampEnable = false,
             .rasterizerDiscardEnable = false,
             .polygonMode = VK_POLYGON_MODE_FILL,
-            .cullMode = VK_CULL_MODE_BACK_BIT,
+            .cullMode = VK_CULL_MODE_NONE,
             .frontFace = VK_FRONT_FACE_CLOCKWISE,
             .depthBiasEnable = false,
             .depthBiasConstantFactor = 0.0f,
@@ -404,13 +668,15 @@ static void createPipeline(void)
             .attachmentCount = 1,
             .pAttachments =
                 &(struct VkPipelineColorBlendAttachmentState){
-                    .blendEnable = false,
-                    .srcColorBlendFactor = 0,
-                    .dstColorBlendFactor = 0,
-                    .colorBlendOp = 0,
-                    .srcAlphaBlendFactor = 0,
-                    .dstAlphaBlendFactor = 0,
-                    .alphaBlendOp = 0,
+                    .blendEnable = true,
+                    .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+                    .dstColorBlendFactor =
+                        VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+                    .colorBlendOp = VK_BLEND_OP_ADD,
+                    .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+                    .dstAlphaBlendFactor =
+                        VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+                    .alphaBlendOp = VK_BLEND_OP_ADD,
                     .colorWriteMask =
                         VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
                         VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
@@ -429,10 +695,16 @@ static void createPipeline(void)
             },
     };
 
+    // Attachments and their layout transitions belong to the frame graph, so
+    // the pipeline only needs to know the attachment format.
+    pipelineInfo.pNext = &(VkPipelineRenderingCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &context.surface.format.format,
+    };
+
     createPipelineLayout();
-    createPipelineRenderpass();
     pipelineInfo.layout = context.pipeline.layout;
-    pipelineInfo.renderPass = context.pipeline.renderpass;
 
     VkResult result = vkCreateGraphicsPipelines(context.gpu.logical, nullptr, 1,
                                                 &pipelineInfo, nullptr,
@@ -448,6 +720,23 @@ static void createPipeline(void)
 
 static void createSurface(struct waterlily_window_context *window)
 {
+    if (window->display == nullptr)
+    {
+        VkHeadlessSurfaceCreateInfoEXT headlessInfo = {0};
+        headlessInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+        auto createHeadless =
+            (PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(
+                context.instance, "vkCreateHeadlessSurfaceEXT");
+        VkResult result = createHeadless(context.instance, &headlessInfo,
+                                         nullptr, &context.surface.handle);
+        if (result != VK_SUCCESS)
+            waterlily_report("Failed to create headless surface. Code: %d.",
+                             result);
+
+        waterlily_log(SUCCESS, "Created headless surface.");
+        return;
+    }
+
     VkWaylandSurfaceCreateInfoKHR createInfo = {0};
     createInfo.sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR;
     createInfo.display = window->display;
@@ -511,38 +800,20 @@ static void createSwapchain(void)
         waterlily_report("Failed to create swapchain, code %d.", code);
 }
 
-static void createFramebuffers(void)
-{
-    VkFramebufferCreateInfo framebufferInfo = {0};
-    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    framebufferInfo.renderPass = context.pipeline.renderpass;
-    framebufferInfo.attachmentCount = 1;
-    framebufferInfo.width = context.surface.extent.width;
-    framebufferInfo.height = context.surface.extent.height;
-    framebufferInfo.layers = 1;
-
-    context.swapchain.framebuffers =
-        malloc(sizeof(VkFramebuffer) * context.swapchain.imageCount);
-
-    for (size_t i = 0; i < context.swapchain.imageCount; ++i)
-    {
-        framebufferInfo.pAttachments = &context.swapchain.images[i];
-        VkResult result =
-            vkCreateFramebuffer(context.gpu.logical, &framebufferInfo, nullptr,
-                                &context.swapchain.framebuffers[i]);
-        if (result != VK_SUCCESS)
-            waterlily_report("Failed to create framebuffer %zu, code %d.", i,
-                             result);
-        waterlily_log(SUCCESS, "Created framebuffer %zu.", i);
-    }
-}
-
 static void partitionSwapchain(void)
 {
-    VkImage rawImages[context.swapchain.imageCount];
     VkResult code =
         vkGetSwapchainImagesKHR(context.gpu.logical, context.swapchain.handle,
-                                &context.swapchain.imageCount, rawImages);
+                                &context.swapchain.imageCount, nullptr);
+    if (code != VK_SUCCESS)
+        waterlily_report("Failed to count swapchain images, code %d.", code);
+
+    context.swapchain.images =
+        malloc(sizeof(VkImage) * context.swapchain.imageCount);
+    code =
+        vkGetSwapchainImagesKHR(context.gpu.logical, context.swapchain.handle,
+                                &context.swapchain.imageCount,
+                                context.swapchain.images);
     if (code != VK_SUCCESS)
         waterlily_report("Failed to get swapchain images, code %d.", code);
 
@@ -554,14 +825,14 @@ static void partitionSwapchain(void)
     imageCreateInfo.subresourceRange.levelCount = 1;
     imageCreateInfo.subresourceRange.layerCount = 1;
 
-    context.swapchain.images =
+    context.swapchain.views =
         malloc(sizeof(VkImageView) * context.swapchain.imageCount);
     for (size_t i = 0; i < context.swapchain.imageCount; i++)
     {
-        imageCreateInfo.image = rawImages[i];
+        imageCreateInfo.image = context.swapchain.images[i];
         VkResult result =
             vkCreateImageView(context.gpu.logical, &imageCreateInfo, nullptr,
-                              &context.swapchain.images[i]);
+                              &context.swapchain.views[i]);
         if (result != VK_SUCCESS)
             waterlily_report("Failed to create image view %zu, code %d.", i,
                              result);
@@ -569,16 +840,8 @@ static void partitionSwapchain(void)
     }
 }
 
-static void recordCommandBuffer(uint32_t imageIndex)
+static void recordScene(VkCommandBuffer buffer, void *)
 {
-    VkCommandBufferBeginInfo beginInfo = {0};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-    VkResult result = vkBeginCommandBuffer(
-        context.commandBuffers.buffers[context.currentFrame], &beginInfo);
-    if (result != VK_SUCCESS)
-        waterlily_report("Failed to begin command buffer, code %d.", result);
-
     VkViewport viewport = {0};
     viewport.width = (float)context.surface.extent.width;
     viewport.height = (float)context.surface.extent.height;
@@ -588,31 +851,130 @@ static void recordCommandBuffer(uint32_t imageIndex)
     scissor.extent.width = context.surface.extent.width;
     scissor.extent.height = context.surface.extent.height;
 
-    vkCmdSetViewport(context.commandBuffers.buffers[context.currentFrame], 0, 1,
-                     &viewport);
-    vkCmdSetScissor(context.commandBuffers.buffers[context.currentFrame], 0, 1,
-                    &scissor);
-
-    VkRenderPassBeginInfo renderPassInfo = {0};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = context.pipeline.renderpass;
-    renderPassInfo.framebuffer = context.swapchain.framebuffers[imageIndex];
-    renderPassInfo.renderArea.offset = (VkOffset2D){0, 0};
-    renderPassInfo.renderArea.extent = context.surface.extent;
-
-    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
-
-    vkCmdBeginRenderPass(context.commandBuffers.buffers[context.currentFrame],
-                         &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(context.commandBuffers.buffers[context.currentFrame],
-                      VK_PIPELINE_BIND_POINT_GRAPHICS, context.pipeline.handle);
-    vkCmdDraw(context.commandBuffers.buffers[context.currentFrame], 3, 1, 0, 0);
-    vkCmdEndRenderPass(context.commandBuffers.buffers[context.currentFrame]);
-
-    result = vkEndCommandBuffer(
-        context.commandBuffers.buffers[context.currentFrame]);
+    vkCmdSetViewport(buffer, 0, 1, &viewport);
+    vkCmdSetScissor(buffer, 0, 1, &scissor);
+
+    vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      context.pipeline.handle);
+    waterlily_bindTextures(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                           context.pipeline.layout);
+
+    waterlily_bindTileAnimations(buffer, context.pipeline.layout);
+    waterlily_bindLights(buffer, context.pipeline.layout);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t elapsed = (now.tv_sec - context.start.tv_sec) * 1000 +
+                       (now.tv_nsec - context.start.tv_nsec) / 1000000;
+
+    // Animated tiles resolve their frame from the time alone, so this is the
+    // only thing that changes per frame for a static map.
+    struct waterlily_push_constants constants = {
+        .extent = {viewport.width, viewport.height},
+        .time = (uint32_t)elapsed,
+    };
+    vkCmdPushConstants(buffer, context.pipeline.layout, VK_SHADER_STAGE_ALL, 0,
+                       sizeof(constants), &constants);
+
+    waterlily_recordTiles(buffer);
+    waterlily_recordSprites(buffer);
+    waterlily_drawParticles(buffer);
+}
+
+static void loadAssets(void)
+{
+    waterlily_file_t archive = {
+        .name = "assets",
+        .type = WATERLILY_ARCHIVE_FILE,
+    };
+
+    // Everything in the archive is optional, so a missing one just leaves
+    // the modules empty.
+    if (access(WATERLILY_ASSET_DIRECTORY "assets.waterlily", R_OK) == 0)
+        waterlily_readFile(&archive);
+    else
+        waterlily_log(WARNING, "No asset archive found.");
+
+    waterlily_createTextContext(&archive);
+    tiles = waterlily_createTileContext(context.gpu.physical,
+                                        context.gpu.logical, &archive);
+    waterlily_createParticleContext(context.gpu.logical, &archive);
+    lights = waterlily_createLightContext(context.gpu.logical, &archive);
+    waterlily_closeFile(&archive);
+}
+
+static void createFrameGraph(void)
+{
+    waterlily_createGraph(context.gpu.physical, context.gpu.logical);
+
+    // The acquire semaphore is waited on at the color output stage, so the
+    // swapchain image is only ever available from there.
+    context.graph.swapchain = waterlily_importGraphImage(
+        "swapchain", context.surface.format.format,
+        (waterlily_graph_state_t){
+            .stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .layout = VK_IMAGE_LAYOUT_UNDEFINED,
+        },
+        (waterlily_graph_state_t){
+            .stages = VK_PIPELINE_STAGE_2_NONE,
+            .layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        });
+    waterlily_markGraphOutput(context.graph.swapchain);
+
+    // Light and particles are both computed before the scene that uses them.
+    waterlily_addLightGraph();
+    bool particles = waterlily_addParticleGraph();
+
+    context.graph.scene = waterlily_addGraphPass(
+        "scene", WATERLILY_GRAPH_PASS_GRAPHICS, recordScene, nullptr);
+    waterlily_useGraphResource(context.graph.scene, context.graph.swapchain,
+                               WATERLILY_GRAPH_USAGE_COLOR_ATTACHMENT);
+    waterlily_clearGraphAttachment(
+        context.graph.scene, (VkClearColorValue){{0.0f, 0.0f, 0.0f, 1.0f}});
+    if (particles)
+        waterlily_useParticleGraph(context.graph.scene);
+    waterlily_useLightGraph(context.graph.scene);
+
+    waterlily_compileGraph(context.surface.extent);
+    waterlily_bindLightmap();
+}
+
+static void recordCommandBuffer(uint32_t imageIndex)
+{
+    VkCommandBuffer buffer =
+        context.commandBuffers.buffers[context.currentFrame];
+
+    VkCommandBufferBeginInfo beginInfo = {0};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VkResult result = vkBeginCommandBuffer(buffer, &beginInfo);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to begin command buffer, code %d.", result);
+
+    VkQueryPool pool = context.timestamps.pool;
+    uint32_t query = context.currentFrame * 2;
+    if (pool != nullptr)
+    {
+        vkCmdResetQueryPool(buffer, pool, query, 2);
+        vkCmdWriteTimestamp2(buffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, pool,
+                             query);
+    }
+
+    waterlily_bindGraphImage(context.graph.swapchain,
+                             context.swapchain.images[imageIndex],
+                             context.swapchain.views[imageIndex],
+                             context.surface.extent);
+    waterlily_executeGraph(buffer);
+
+    if (pool != nullptr)
+    {
+        vkCmdWriteTimestamp2(buffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                             pool, query + 1);
+        context.timestamps.pending[context.currentFrame] = true;
+    }
+
+    result = vkEndCommandBuffer(buffer);
     if (result != VK_SUCCESS)
         waterlily_report("Failed to end command buffer, code %d.", result);
 }
@@ -632,6 +994,10 @@ static void getSurfaceExtent(void)
         return;
     }
 
+    // Wayland leaves the size up to us, which is whatever the window settled
+    // on after scaling.
+    context.surface.extent =
+        (VkExtent2D){context.window->width, context.window->height};
     context.surface.extent.width = clamp(
         context.surface.extent.width, context.surface.info.minImageExtent.width,
         context.surface.info.maxImageExtent.width);
@@ -705,7 +1071,7 @@ static void getSurfaceMode(void)
         }
     }
 
-    waterlily_report("Failed to find optimal present mode.");
+    waterlily_log(WARNING, "Failed to find optimal present mode.");
     context.surface.mode = VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -719,15 +1085,11 @@ static void syncGPU(void)
 static void destroySwapchain()
 {
     for (size_t i = 0; i < context.swapchain.imageCount; ++i)
-    {
-        vkDestroyFramebuffer(context.gpu.logical,
-                             context.swapchain.framebuffers[i], nullptr);
-        vkDestroyImageView(context.gpu.logical, context.swapchain.images[i],
+        vkDestroyImageView(context.gpu.logical, context.swapchain.views[i],
                            nullptr);
-    }
     vkDestroySwapchainKHR(context.gpu.logical, context.swapchain.handle,
                           nullptr);
-    free(context.swapchain.framebuffers);
+    free(context.swapchain.views);
     free(context.swapchain.images);
 }
 
@@ -736,33 +1098,225 @@ void recreateSwapchain(void)
     syncGPU();
     destroySwapchain();
 
+    getSurfaceCapabilities();
+    getSurfaceExtent();
     createSwapchain();
     partitionSwapchain();
-    createFramebuffers();
+    waterlily_compileGraph(context.surface.extent);
+    waterlily_bindLightmap();
     waterlily_log(SUCCESS, "Recreated swapchain.");
 }
 
-void waterlily_renderFrame(void)
+void waterlily_createVulkanBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                                  VkMemoryPropertyFlags properties,
+                                  VkBuffer *buffer, VkDeviceMemory *memory)
+{
+    VkBufferCreateInfo bufferInfo = {0};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkResult result =
+        vkCreateBuffer(context.gpu.logical, &bufferInfo, nullptr, buffer);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create buffer, code %d.", result);
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(context.gpu.logical, *buffer, &requirements);
+
+    VkMemoryAllocateInfo allocateInfo = {0};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = waterlily_findVulkanMemoryType(
+        context.gpu.physical, requirements.memoryTypeBits, properties);
+
+    result =
+        vkAllocateMemory(context.gpu.logical, &allocateInfo, nullptr, memory);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to allocate buffer memory, code %d.", result);
+
+    result = vkBindBufferMemory(context.gpu.logical, *buffer, *memory, 0);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to bind buffer memory, code %d.", result);
+}
+
+VkCommandBuffer waterlily_beginVulkanCommands(void)
+{
+    VkCommandBufferAllocateInfo allocInfo = {0};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = context.commandBuffers.pool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer buffer;
+    VkResult result =
+        vkAllocateCommandBuffers(context.gpu.logical, &allocInfo, &buffer);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to allocate one-shot commands, code %d.",
+                         result);
+
+    VkCommandBufferBeginInfo beginInfo = {0};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    result = vkBeginCommandBuffer(buffer, &beginInfo);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to begin one-shot commands, code %d.", result);
+    return buffer;
+}
+
+void waterlily_submitVulkanCommands(VkCommandBuffer buffer)
+{
+    VkResult result = vkEndCommandBuffer(buffer);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to end one-shot commands, code %d.", result);
+
+    VkSubmitInfo submitInfo = {0};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &buffer;
+
+    // These only ever happen during loading, so simply waiting is fine.
+    result = vkQueueSubmit(context.gpu.graphicsQueue.handle, 1, &submitInfo,
+                           nullptr);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to submit one-shot commands, code %d.",
+                         result);
+    vkQueueWaitIdle(context.gpu.graphicsQueue.handle);
+    vkFreeCommandBuffers(context.gpu.logical, context.commandBuffers.pool, 1,
+                         &buffer);
+}
+
+void waterlily_uploadVulkanBuffer(VkBuffer buffer, const void *data,
+                                  VkDeviceSize size)
 {
+    VkBuffer staging;
+    VkDeviceMemory stagingMemory;
+    waterlily_createVulkanBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 &staging, &stagingMemory);
+
+    void *mapped;
+    VkResult result =
+        vkMapMemory(context.gpu.logical, stagingMemory, 0, size, 0, &mapped);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to map buffer staging memory, code %d.",
+                         result);
+    memcpy(mapped, data, size);
+    vkUnmapMemory(context.gpu.logical, stagingMemory);
+
+    VkCommandBuffer commands = waterlily_beginVulkanCommands();
+    vkCmdCopyBuffer(commands, staging, buffer, 1,
+                    &(VkBufferCopy){.size = size});
+
+    VkBufferMemoryBarrier2 barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier2(commands,
+                          &(VkDependencyInfo){
+                              .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                              .bufferMemoryBarrierCount = 1,
+                              .pBufferMemoryBarriers = &barrier,
+                          });
+    waterlily_submitVulkanCommands(commands);
+
+    vkDestroyBuffer(context.gpu.logical, staging, nullptr);
+    vkFreeMemory(context.gpu.logical, stagingMemory, nullptr);
+}
+
+VkShaderModule waterlily_createVulkanShader(
+    const struct waterlily_archive_shader_section *shader)
+{
+    VkShaderModuleCreateInfo createInfo = {0};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = shader->size;
+    createInfo.pCode = shader->code;
+
+    VkShaderModule module;
+    VkResult result = vkCreateShaderModule(context.gpu.logical, &createInfo,
+                                           nullptr, &module);
+    if (result != VK_SUCCESS)
+        waterlily_report("Failed to create shader '%s', code %d.",
+                         shader->name, result);
+    return module;
+}
+
+uint32_t waterlily_findVulkanMemoryType(VkPhysicalDevice physical,
+                                        uint32_t typeBits,
+                                        VkMemoryPropertyFlags properties)
+{
+    VkPhysicalDeviceMemoryProperties memory;
+    vkGetPhysicalDeviceMemoryProperties(physical, &memory);
+
+    for (uint32_t i = 0; i < memory.memoryTypeCount; ++i)
+        if ((typeBits & (1u << i)) &&
+            (memory.memoryTypes[i].propertyFlags & properties) == properties)
+            return i;
+
+    waterlily_report("Failed to find memory type (bits %x, properties %x).",
+                     typeBits, properties);
+}
+
+bool waterlily_renderFrame(void)
+{
+    WATERLILY_TRACE_SCOPE("renderFrame");
     VkFence waitFences[] = {context.commandBuffers.fences[context.currentFrame],
                             context.commandBuffers.presentFence};
-    vkWaitForFences(context.gpu.logical, 2, waitFences, true, UINT64_MAX);
+    // Only the blocking calls count as acquire time, not the work between.
+    uint64_t waited = waterlily_getClockTime();
+    {
+        WATERLILY_TRACE_SCOPE("waitFences");
+        vkWaitForFences(context.gpu.logical, 2, waitFences, true, UINT64_MAX);
+    }
+    waited = waterlily_getClockTime() - waited;
+    readTimestamps();
+    if (context.window->resized)
+    {
+        context.window->resized = false;
+        recreateSwapchain();
+    }
 
     uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(
-        context.gpu.logical, context.swapchain.handle, UINT64_MAX,
-        context.commandBuffers.imageAvailableSemphores[context.currentFrame],
-        nullptr, &imageIndex);
+    VkResult result;
+    uint64_t acquireStart = waterlily_getClockTime();
+    {
+        WATERLILY_TRACE_SCOPE("acquireImage");
+        result = vkAcquireNextImageKHR(
+            context.gpu.logical, context.swapchain.handle, UINT64_MAX,
+            context.commandBuffers
+                .imageAvailableSemphores[context.currentFrame],
+            nullptr, &imageIndex);
+    }
+    waterlily_recordFrameStat(WATERLILY_FRAME_STAT_ACQUIRE,
+                              waited + waterlily_getClockTime() - acquireStart);
+    // There's no image to draw into, the fences are left signalled for the
+    // next try.
     if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    {
         recreateSwapchain();
+        return false;
+    }
     else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
         waterlily_report("Failed to acquire swapchain image, code %d.", result);
 
     vkResetFences(context.gpu.logical, 2, waitFences);
+    waterlily_collectTextures();
+    waterlily_resetRing(context.currentFrame);
 
-    vkResetCommandBuffer(context.commandBuffers.buffers[context.currentFrame],
-                         0);
-    recordCommandBuffer(imageIndex);
+    {
+        WATERLILY_TRACE_SCOPE("recordCommands");
+        vkResetCommandBuffer(
+            context.commandBuffers.buffers[context.currentFrame], 0);
+        recordCommandBuffer(imageIndex);
+    }
 
     VkSubmitInfo submitInfo = {0};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -780,8 +1334,12 @@ void waterlily_renderFrame(void)
     submitInfo.pSignalSemaphores =
         &context.commandBuffers.renderFinishedSemaphores[context.currentFrame];
 
-    result = vkQueueSubmit(context.gpu.graphicsQueue.handle, 1, &submitInfo,
-                           context.commandBuffers.fences[context.currentFrame]);
+    {
+        WATERLILY_TRACE_SCOPE("submit");
+        result =
+            vkQueueSubmit(context.gpu.graphicsQueue.handle, 1, &submitInfo,
+                          context.commandBuffers.fences[context.currentFrame]);
+    }
     if (result != VK_SUCCESS)
         waterlily_report("Failed to submit to the queue, code %d.", result);
 
@@ -801,7 +1359,14 @@ void waterlily_renderFrame(void)
     presentFence.pFences = &context.commandBuffers.presentFence;
     presentInfo.pNext = &presentFence;
 
-    result = vkQueuePresentKHR(context.gpu.graphicsQueue.handle, &presentInfo);
+    uint64_t presentStart = waterlily_getClockTime();
+    {
+        WATERLILY_TRACE_SCOPE("present");
+        result =
+            vkQueuePresentKHR(context.gpu.graphicsQueue.handle, &presentInfo);
+    }
+    waterlily_recordFrameStat(WATERLILY_FRAME_STAT_PRESENT,
+                              waterlily_getClockTime() - presentStart);
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
         recreateSwapchain();
     else if (result != VK_SUCCESS)
@@ -809,6 +1374,8 @@ void waterlily_renderFrame(void)
 
     context.currentFrame =
         (context.currentFrame + 1) % WATERLILY_CONCURRENT_FRAMES;
+    // A suboptimal image is still shown, an out of date one never is.
+    return result != VK_ERROR_OUT_OF_DATE_KHR;
 }
 
 #if BUILD_TYPE == 0
@@ -822,8 +1389,12 @@ debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT,
 #endif
 
 struct waterlily_vulkan_context *
-waterlily_createVulkanContext(struct waterlily_window_context *window)
+waterlily_createVulkanContext(struct waterlily_window_context *window,
+                              struct waterlily_configuration *config)
 {
+    WATERLILY_TRACE_SCOPE("createVulkanContext");
+    context.window = window;
+
     VkApplicationInfo applicationInfo = {0};
     applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     applicationInfo.pApplicationName = nullptr;
@@ -838,7 +1409,8 @@ waterlily_createVulkanContext(struct waterlily_window_context *window)
 
     const char *extensions[] = {
         "VK_KHR_surface",
-        "VK_KHR_wayland_surface",
+        config->arguments.headless ? "VK_EXT_headless_surface"
+                                   : "VK_KHR_wayland_surface",
         "VK_KHR_get_surface_capabilities2",
         "VK_EXT_surface_maintenance1",
         "VK_EXT_debug_utils",
@@ -920,21 +1492,32 @@ waterlily_createVulkanContext(struct waterlily_window_context *window)
 #endif
 
     createSurface(window);
-    createLogicalGPU();
+    createLogicalGPU(config->device);
+    createCommandBuffers();
+    createQueryPool();
+    textures = waterlily_createTextureContext(context.gpu.physical,
+                                              context.gpu.logical);
+    waterlily_createRingContext(context.gpu.physical, context.gpu.logical);
+    waterlily_createSpriteContext();
+    loadAssets();
     getSurfaceFormat();
     getSurfaceMode();
     getSurfaceCapabilities();
     getSurfaceExtent();
     createPipeline();
     createSwapchain();
-    createCommandBuffers();
+    partitionSwapchain();
+    createFrameGraph();
     createSyncDevices();
+    clock_gettime(CLOCK_MONOTONIC, &context.start);
 
     return &context;
 }
 
-void waterlily_vulkan_destroy(void)
+void waterlily_destroyVulkanContext(void)
 {
+    syncGPU();
+
 #if BUILD_TYPE == 0
     auto debugDestroy =
         (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
@@ -944,6 +1527,7 @@ void waterlily_vulkan_destroy(void)
 
     vkDestroyCommandPool(context.gpu.logical, context.commandBuffers.pool,
                          nullptr);
+    vkDestroyQueryPool(context.gpu.logical, context.timestamps.pool, nullptr);
 
     vkDestroyFence(context.gpu.logical, context.commandBuffers.presentFence,
                    nullptr);
@@ -959,15 +1543,20 @@ void waterlily_vulkan_destroy(void)
                        nullptr);
     }
 
-    vkDestroyRenderPass(context.gpu.logical, context.pipeline.renderpass,
-                        nullptr);
+    waterlily_destroyGraph();
+    waterlily_destroyLightContext();
+    waterlily_destroyParticleContext();
+    waterlily_destroyTileContext();
+    waterlily_destroyTextContext();
+    waterlily_destroySpriteContext();
+    waterlily_destroyRingContext();
+    waterlily_destroyTextureContext();
     vkDestroyPipelineLayout(context.gpu.logical, context.pipeline.layout,
                             nullptr);
     vkDestroyPipeline(context.gpu.logical, context.pipeline.handle, nullptr);
 
     destroySwapchain();
 
-    syncGPU();
     vkDestroyDevice(context.gpu.logical, nullptr);
     vkDestroySurfaceKHR(context.instance, context.surface.handle, nullptr);
     vkDestroyInstance(context.instance, nullptr);
@@ -30,11 +30,15 @@
  * <https://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <internal/events.h>
 #include <internal/input.h>
 #include <internal/logging.h>
+#include <internal/profiler.h>
 #include <internal/window.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 static struct waterlily_window_context context = {0};
@@ -142,6 +146,166 @@ static const struct wl_interface pXDGShellInterface = {
     .events = (struct wl_message[]){{"ping", "u", nullptr}},
 };
 
+/**
+ * @brief The viewport interface, which lets a surface's buffer be a different
+ * size than the surface itself. This is the version one interface.
+ * @since v0.0.1
+ *
+ * @remark Source rectangles are never used, so that definition is missing.
+ */
+static const struct wl_interface pViewportInterface = {
+    .name = "wp_viewport",
+    .version = 1,
+    .method_count = 3,
+    .methods =
+        (struct wl_message[]){
+            {"destroy", "", nullptr},
+            {0},
+            {"set_destination", "ii", nullptr},
+        },
+    .event_count = 0,
+    .events = nullptr,
+};
+
+/**
+ * @brief The viewporter global, which hands out viewports for surfaces. This
+ * is the version one interface.
+ * @since v0.0.1
+ */
+static const struct wl_interface pViewporterInterface = {
+    .name = "wp_viewporter",
+    .version = 1,
+    .method_count = 2,
+    .methods =
+        (struct wl_message[]){
+            {"destroy", "", nullptr},
+            {"get_viewport", "no",
+             (const struct wl_interface *[]){&pViewportInterface,
+                                             &wl_surface_interface}},
+        },
+    .event_count = 0,
+    .events = nullptr,
+};
+
+/**
+ * @brief The per-surface fractional scale object, which tells us the scale
+ * the compositor would like us to render at. This is the version one
+ * interface.
+ * @since v0.0.1
+ */
+static const struct wl_interface pFractionalScaleInterface = {
+    .name = "wp_fractional_scale_v1",
+    .version = 1,
+    .method_count = 1,
+    .methods = (struct wl_message[]){{"destroy", "", nullptr}},
+    .event_count = 1,
+    .events = (struct wl_message[]){{"preferred_scale", "u", nullptr}},
+};
+
+/**
+ * @brief The fractional scale global, which hands out fractional scale
+ * objects for surfaces. This is the version one interface.
+ * @since v0.0.1
+ */
+static const struct wl_interface pFractionalScaleManagerInterface = {
+    .name = "wp_fractional_scale_manager_v1",
+    .version = 1,
+    .method_count = 2,
+    .methods =
+        (struct wl_message[]){
+            {"destroy", "", nullptr},
+            {"get_fractional_scale", "no",
+             (const struct wl_interface *[]){&pFractionalScaleInterface,
+                                             &wl_surface_interface}},
+        },
+    .event_count = 0,
+    .events = nullptr,
+};
+
+/**
+ * @brief The feedback for a single surface commit, which tells us when and
+ * how its content reached the screen. This is the version one interface.
+ * @since v0.0.1
+ */
+static const struct wl_interface pPresentationFeedbackInterface = {
+    .name = "wp_presentation_feedback",
+    .version = 1,
+    .method_count = 0,
+    .methods = nullptr,
+    .event_count = 3,
+    .events =
+        (struct wl_message[]){
+            {"sync_output", "o",
+             (const struct wl_interface *[]){&wl_output_interface}},
+            {"presented", "uuuuuuu", nullptr},
+            {"discarded", "", nullptr},
+        },
+};
+
+/**
+ * @brief The presentation global, which hands out feedback objects for
+ * surface commits. This is the version one interface.
+ * @since v0.0.1
+ */
+static const struct wl_interface pPresentationInterface = {
+    .name = "wp_presentation",
+    .version = 1,
+    .method_count = 2,
+    .methods =
+        (struct wl_message[]){
+            {"destroy", "", nullptr},
+            {"feedback", "on",
+             (const struct wl_interface *[]){&wl_surface_interface,
+                                             &pPresentationFeedbackInterface}},
+        },
+    .event_count = 1,
+    .events = (struct wl_message[]){{"clock_id", "u", nullptr}},
+};
+
+/**
+ * @brief Work out how big our buffer should be from the surface's size, the
+ * scale the compositor wants, and how far below that the game asked to
+ * render. With a viewport the compositor stretches whatever we give it back
+ * over the surface, otherwise we're stuck with whole number scales.
+ * @since v0.0.1
+ */
+static void resize(void)
+{
+    uint32_t width;
+    uint32_t height;
+    if (context.viewport != nullptr)
+    {
+        // Fractional scales come in 120ths.
+        float scale = context.preferredScale != 0
+                          ? context.preferredScale / 120.0f
+                          : (float)context.scale;
+        scale *= context.renderScale;
+        width = context.surfaceWidth * scale + 0.5f;
+        height = context.surfaceHeight * scale + 0.5f;
+        // wp_viewport_set_destination
+        (void)wl_proxy_marshal_flags(
+            (struct wl_proxy *)context.viewport, 2, nullptr,
+            wl_proxy_get_version((struct wl_proxy *)context.viewport), 0,
+            context.surfaceWidth, context.surfaceHeight);
+    }
+    else
+    {
+        width = context.surfaceWidth * context.scale;
+        height = context.surfaceHeight * context.scale;
+        wl_surface_set_buffer_scale(context.surface, context.scale);
+    }
+
+    if (width == 0 || height == 0 ||
+        (context.width == width && context.height == height))
+        return;
+
+    context.resized = true;
+    context.width = width;
+    context.height = height;
+    waterlily_log(INFO, "Window dimensions adjusted: %dx%d.", context.width,
+                  context.height);
+}
+
 /**
  * @copydoc xdg_wm_base_listener::ping
  */
@@ -229,17 +393,16 @@ static void topConfigure(void *, void *, int32_t w, int32_t h,
                          struct wl_array *s)
 {
     waterlily_log(INFO, "Configure request recieved.");
+    context.suspended = false;
+    context.activated = false;
 
-    uint32_t width = w * context.scale;
-    uint32_t height = h * context.scale;
-    if (context.width != width && context.height != height)
+    // Zero means it's up to us, so we just keep whatever we had.
+    if (w > 0 && h > 0)
     {
-        context.resized = true;
-        context.width = width;
-        context.height = height;
-        waterlily_log(INFO, "Window dimensions adjusted: %dx%d.", context.width,
-                      context.height);
+        context.surfaceWidth = w;
+        context.surfaceHeight = h;
     }
+    resize();
 
     int32_t *i;
     wl_array_for_each(i, s)
@@ -250,13 +413,17 @@ static void topConfigure(void *, void *, int32_t w, int32_t h,
                 waterlily_log(INFO, "The window is now fullscreened.");
                 break;
             case 4:
+                context.activated = true;
                 waterlily_log(INFO, "The window is now activated.");
                 break;
             case 9:
+                context.suspended = true;
                 waterlily_log(INFO, "The window is now suspended.");
                 break;
+            // Maximized, resizing, tiled and whatever newer versions add
+            // don't change how we draw.
             default:
-                waterlily_report("Got unknown state value '%d'.", *i);
+                waterlily_log(INFO, "Ignored window state %d.", *i);
                 break;
         }
     }
@@ -395,6 +562,8 @@ static void scale(void *, struct wl_output *, int32_t s)
 {
     context.scale = s;
     waterlily_log(INFO, "Monitor scale %d.", context.scale);
+    if (context.surface != nullptr)
+        resize();
 }
 
 static void name(void *, struct wl_output *, const char *) {}
@@ -429,12 +598,19 @@ static void enter(void *, struct wl_keyboard *, uint32_t, struct wl_surface *,
 
 static void leave(void *, struct wl_keyboard *, uint32_t, struct wl_surface *)
 {
+    // We won't hear about the key being let go anymore.
+    waterlily_stopKeyRepeat();
 }
 
 void key(void *, struct wl_keyboard *, uint32_t, uint32_t t, uint32_t k,
          uint32_t s)
 {
-    waterlily_updateKeysDown(k + 8, t, s);
+    // Wayland sends 0 for released, 1 for pressed and 2 for repeated.
+    static const waterlily_key_state_t states[] = {
+        WATERLILY_KEY_STATE_UP, WATERLILY_KEY_STATE_DOWN,
+        WATERLILY_KEY_STATE_REPEAT};
+    if (s < sizeof(states) / sizeof(states[0]))
+        waterlily_updateKeysDown(k + 8, t, states[s]);
 }
 
 void modifiers(void *, struct wl_keyboard *, uint32_t, uint32_t p, uint32_t a,
@@ -443,7 +619,10 @@ void modifiers(void *, struct wl_keyboard *, uint32_t, uint32_t p, uint32_t a,
     waterlily_updateModifiersDown(p, a, l, g);
 }
 
-void repeatInfo(void *, struct wl_keyboard *, int32_t, int32_t) {}
+void repeatInfo(void *, struct wl_keyboard *, int32_t r, int32_t d)
+{
+    waterlily_setKeyRepeat(r, d);
+}
 
 static void capabilitiesChange(void *, struct wl_seat *, uint32_t) {}
 
@@ -452,11 +631,42 @@ static void seatName(void *, struct wl_seat *, const char *name)
     waterlily_log(INFO, "Seat named '%s'.", name);
 
     context.keyboard = wl_seat_get_keyboard(context.seat);
-    struct wl_keyboard_listener keyboardListener = {
+    static const struct wl_keyboard_listener keyboardListener = {
         keymap, enter, leave, key, modifiers, repeatInfo};
     wl_keyboard_add_listener(context.keyboard, &keyboardListener, nullptr);
 }
 
+/**
+ * @copydoc wp_presentation_listener::clockId
+ */
+static void clockId(void *, void *, uint32_t clock)
+{
+    context.presentationClock = clock;
+    if (clock != CLOCK_MONOTONIC)
+        waterlily_log(WARNING,
+                      "Presentation clock %u isn't monotonic, input latency "
+                      "won't be measured.",
+                      clock);
+}
+
+/**
+ * @brief An interface for handling events for the @c wp_presentation global.
+ * @since v0.0.1
+ */
+struct wp_presentation_listener
+{
+    /**
+     * @brief Which clock every presentation timestamp is given in. This is
+     * sent once, right after binding.
+     * @since v0.0.1
+     *
+     * @param[in] data Any data sent alongside the presentation object.
+     * @param[in] presentation The presentation object this event was sent for.
+     * @param[in] clock A clock ID as taken by @c clock_gettime.
+     */
+    void (*clockId)(void *data, void *presentation, uint32_t clock);
+};
+
 static void global(void *, struct wl_registry *registry, uint32_t interfaceName,
                    const char *interface, uint32_t version)
 {
@@ -471,7 +681,7 @@ static void global(void *, struct wl_registry *registry, uint32_t interfaceName,
     {
         context.shell = wl_registry_bind(registry, interfaceName,
                                          &pXDGShellInterface, version);
-        struct xdg_wm_base_listener shellListener = {&ping};
+        static const struct xdg_wm_base_listener shellListener = {&ping};
         // xdg_wm_base_add_listener
         (void)wl_proxy_add_listener((struct wl_proxy *)context.shell,
                                     (void (**)(void))&shellListener, nullptr);
@@ -482,7 +692,7 @@ static void global(void *, struct wl_registry *registry, uint32_t interfaceName,
     {
         context.output = wl_registry_bind(registry, interfaceName,
                                           &wl_output_interface, version);
-        struct wl_output_listener outputListener = {
+        static const struct wl_output_listener outputListener = {
             &geometry, &mode, &finish, &scale, &name, &description};
         (void)wl_output_add_listener(context.output, &outputListener, nullptr);
         waterlily_log(SUCCESS, "Connected to output device v%d.", version);
@@ -492,37 +702,233 @@ static void global(void *, struct wl_registry *registry, uint32_t interfaceName,
     {
         context.seat = wl_registry_bind(registry, interfaceName,
                                         &wl_seat_interface, version);
-        struct wl_seat_listener seatListener = {&capabilitiesChange, &seatName};
+        static const struct wl_seat_listener seatListener = {
+            &capabilitiesChange, &seatName};
         (void)wl_seat_add_listener(context.seat, &seatListener, nullptr);
         waterlily_log(SUCCESS, "Connected to seat device v%d.", version);
         return;
     }
 
+    else if (strcmp(interface, pViewporterInterface.name) == 0)
+    {
+        context.viewporter = wl_registry_bind(registry, interfaceName,
+                                              &pViewporterInterface, 1);
+        waterlily_log(SUCCESS, "Connected to viewporter v%d.", version);
+        return;
+    }
+    else if (strcmp(interface, pFractionalScaleManagerInterface.name) == 0)
+    {
+        context.fractionalScaler = wl_registry_bind(
+            registry, interfaceName, &pFractionalScaleManagerInterface, 1);
+        waterlily_log(SUCCESS, "Connected to fractional scaler v%d.", version);
+        return;
+    }
+    else if (strcmp(interface, pPresentationInterface.name) == 0)
+    {
+        context.presentation = wl_registry_bind(registry, interfaceName,
+                                                &pPresentationInterface, 1);
+        static const struct wp_presentation_listener presentationListener = {
+            &clockId};
+        // wp_presentation_add_listener
+        (void)wl_proxy_add_listener((struct wl_proxy *)context.presentation,
+                                    (void (**)(void))&presentationListener,
+                                    nullptr);
+        waterlily_log(SUCCESS, "Connected to presentation timing v%d.",
+                      version);
+        return;
+    }
+
     waterlily_log(INFO, "Found unknown interface '%s'.", interface);
 }
 
 static void globalRemove(void *, struct wl_registry *, uint32_t) {}
 
+/**
+ * @copydoc wp_fractional_scale_v1_listener::preferredScale
+ */
+static void preferredScale(void *, void *, uint32_t s)
+{
+    context.preferredScale = s;
+    waterlily_log(INFO, "Preferred scale %.3f.", s / 120.0);
+    resize();
+}
+
+/**
+ * @brief An interface for handling events for the @c wp_fractional_scale_v1
+ * object of our surface.
+ * @since v0.0.1
+ */
+struct wp_fractional_scale_v1_listener
+{
+    /**
+     * @brief Notification of a new preferred scale for this surface that the
+     * compositor suggests that the client should use.
+     * @since v0.0.1
+     *
+     * @param[in] data Any data sent alongside the scale object.
+     * @param[in] fractionalScale The scale object this event was sent for.
+     * @param[in] scale The numerator of a fraction with a denominator of 120.
+     */
+    void (*preferredScale)(void *data, void *fractionalScale, uint32_t scale);
+};
+
+/**
+ * @copydoc wp_presentation_feedback_listener::syncOutput
+ */
+static void syncOutput(void *, void *, struct wl_output *) {}
+
+/**
+ * @copydoc wp_presentation_feedback_listener::presented
+ */
+static void presented(void *data, void *feedback, uint32_t secondsHigh,
+                      uint32_t secondsLow, uint32_t nanoseconds,
+                      uint32_t refresh, uint32_t, uint32_t, uint32_t flags)
+{
+    struct waterlily_window_feedback *slot = data;
+    uint64_t seconds = ((uint64_t)secondsHigh << 32) | secondsLow;
+    // Without a monotonic clock the input timestamps mean nothing here.
+    uint64_t input =
+        context.presentationClock == CLOCK_MONOTONIC ? slot->input : 0;
+    waterlily_recordPresentation(input, seconds * 1000000000 + nanoseconds,
+                                 refresh, flags);
+    wl_proxy_destroy(feedback);
+    slot->handle = nullptr;
+}
+
+/**
+ * @copydoc wp_presentation_feedback_listener::discarded
+ */
+static void discarded(void *data, void *feedback)
+{
+    struct waterlily_window_feedback *slot = data;
+    waterlily_discardPresentation();
+    wl_proxy_destroy(feedback);
+    slot->handle = nullptr;
+}
+
+/**
+ * @brief An interface for handling events for a @c wp_presentation_feedback
+ * object. Exactly one of presented or discarded is sent, after which the
+ * object is dead.
+ * @since v0.0.1
+ */
+struct wp_presentation_feedback_listener
+{
+    /**
+     * @brief An output the content was shown on, sent before presented.
+     * @since v0.0.1
+     *
+     * @param[in] data The feedback slot the object was requested for.
+     * @param[in] feedback The feedback object this event was sent for.
+     * @param[in] output The output the content was synchronized to.
+     */
+    void (*syncOutput)(void *data, void *feedback, struct wl_output *output);
+    /**
+     * @brief The content was shown. The timestamp is when it turned to light,
+     * as near as the compositor can tell.
+     * @since v0.0.1
+     *
+     * @param[in] data The feedback slot the object was requested for.
+     * @param[in] feedback The feedback object this event was sent for.
+     * @param[in] secondsHigh The high half of the timestamp's seconds.
+     * @param[in] secondsLow The low half of the timestamp's seconds.
+     * @param[in] nanoseconds The timestamp's nanoseconds.
+     * @param[in] refresh The output's refresh interval in nanoseconds, or
+     * zero if it doesn't have a fixed one.
+     * @param[in] sequenceHigh The high half of the output's vblank counter.
+     * @param[in] sequenceLow The low half of the output's vblank counter.
+     * @param[in] flags Any of @c waterlily_presentation_flag_t.
+     */
+    void (*presented)(void *data, void *feedback, uint32_t secondsHigh,
+                      uint32_t secondsLow, uint32_t nanoseconds,
+                      uint32_t refresh, uint32_t sequenceHigh,
+                      uint32_t sequenceLow, uint32_t flags);
+    /**
+     * @brief The content was never shown, most likely because a later commit
+     * replaced it first.
+     * @since v0.0.1
+     *
+     * @param[in] data The feedback slot the object was requested for.
+     * @param[in] feedback The feedback object this event was sent for.
+     */
+    void (*discarded)(void *data, void *feedback);
+};
+
+static void frameDone(void *, struct wl_callback *callback, uint32_t)
+{
+    wl_callback_destroy(callback);
+    context.frame = nullptr;
+    context.frameReady = true;
+}
+
+static void readDisplay(uint64_t, void *)
+{
+    context.reading = false;
+    if (wl_display_read_events(context.display) == -1)
+        waterlily_report("Failed to read display events, code %d.", errno);
+}
+
 struct waterlily_window_context *
 waterlily_createWindowContext(struct waterlily_configuration *config)
 {
+    context.scale = 1;
+    context.renderScale = config->scale;
+    context.surfaceWidth = WATERLILY_DEFAULT_WIDTH;
+    context.surfaceHeight = WATERLILY_DEFAULT_HEIGHT;
+
+    if (config->arguments.headless)
+    {
+        // Without a compositor nothing ever holds a frame back.
+        context.activated = true;
+        context.frameReady = true;
+        context.width = WATERLILY_HEADLESS_WIDTH;
+        context.height = WATERLILY_HEADLESS_HEIGHT;
+        waterlily_log(INFO, "Running headless, no window created.");
+        return &context;
+    }
+
     context.display = wl_display_connect(nullptr);
     if (__builtin_expect(context.display == nullptr, false))
         waterlily_report("Failed to connect to display server.");
 
     context.registry = wl_display_get_registry(context.display);
-    struct wl_registry_listener registryListener = {&global, &globalRemove};
+    static const struct wl_registry_listener registryListener = {
+        &global, &globalRemove};
     (void)wl_registry_add_listener(context.registry, &registryListener,
                                    nullptr);
     (void)wl_display_roundtrip(context.display);
 
     context.surface = wl_compositor_create_surface(context.compositor);
+    if (context.viewporter != nullptr)
+        // wp_viewporter_get_viewport
+        context.viewport = wl_proxy_marshal_flags(
+            (struct wl_proxy *)context.viewporter, 1, &pViewportInterface,
+            wl_proxy_get_version((struct wl_proxy *)context.viewporter), 0,
+            nullptr, context.surface);
+    else if (context.renderScale != 1.0f)
+        waterlily_log(WARNING, "No viewporter, rendering at full scale.");
+    if (context.fractionalScaler != nullptr)
+    {
+        // wp_fractional_scale_manager_v1_get_fractional_scale
+        context.fractionalScale = wl_proxy_marshal_flags(
+            (struct wl_proxy *)context.fractionalScaler, 1,
+            &pFractionalScaleInterface,
+            wl_proxy_get_version((struct wl_proxy *)context.fractionalScaler),
+            0, nullptr, context.surface);
+        static const struct wp_fractional_scale_v1_listener scaleListener = {
+            &preferredScale};
+        // wp_fractional_scale_v1_add_listener
+        (void)wl_proxy_add_listener((struct wl_proxy *)context.fractionalScale,
+                                    (void (**)(void))&scaleListener, nullptr);
+    }
+    resize();
     // xdg_wm_base_get_xdg_surface
     context.shellSurface = (struct xdg_surface *)wl_proxy_marshal_flags(
         (struct wl_proxy *)context.shell, 2, &pXDGSurfaceInterface,
         wl_proxy_get_version((struct wl_proxy *)context.shell), 0, nullptr,
         context.surface);
-    struct xdg_surface_listener shellSurfaceListener = {&configure};
+    static const struct xdg_surface_listener shellSurfaceListener = {
+        &configure};
     // xdg_surface_add_listener
     (void)wl_proxy_add_listener((struct wl_proxy *)context.shellSurface,
                                 (void (**)(void))&shellSurfaceListener,
@@ -532,7 +938,7 @@ waterlily_createWindowContext(struct waterlily_configuration *config)
         (struct wl_proxy *)context.shellSurface, 1, &pXDGToplevelInterface,
         wl_proxy_get_version((struct wl_proxy *)context.shellSurface), 0,
         nullptr);
-    struct xdg_toplevel_listener toplevelListener = {
+    static const struct xdg_toplevel_listener toplevelListener = {
         &topConfigure, &closeToplevel, &bounds, &capabilities};
     // xdg_toplevel_add_listener
     (void)wl_proxy_add_listener((struct wl_proxy *)context.toplevel,
@@ -553,6 +959,9 @@ waterlily_createWindowContext(struct waterlily_configuration *config)
         (struct wl_proxy *)context.toplevel, 11, nullptr,
         wl_proxy_get_version((struct wl_proxy *)context.toplevel), 0,
         context.output);
+    waterlily_watchEvents(wl_display_get_fd(context.display), readDisplay,
+                          nullptr);
+    context.frameReady = true;
     waterlily_log(INFO, "Setup window properly.");
 
     return &context;
@@ -560,6 +969,12 @@ waterlily_createWindowContext(struct waterlily_configuration *config)
 
 void waterlily_destroyWindowContext(void)
 {
+    if (context.display == nullptr)
+    {
+        waterlily_destroyInputContext();
+        return;
+    }
+
     // xdg_toplevel_destroy
     (void)wl_proxy_marshal_flags(
         (struct wl_proxy *)context.toplevel, 0, nullptr,
@@ -576,6 +991,21 @@ void waterlily_destroyWindowContext(void)
         wl_proxy_get_version((struct wl_proxy *)context.shell),
         WL_MARSHAL_FLAG_DESTROY);
 
+    if (context.frame != nullptr)
+        wl_callback_destroy(context.frame);
+    for (size_t i = 0; i < WATERLILY_MAX_FEEDBACK; ++i)
+        if (context.feedback[i].handle != nullptr)
+            wl_proxy_destroy(context.feedback[i].handle);
+    // Every one of these has destroy as its first request.
+    void *scalers[] = {context.fractionalScale, context.fractionalScaler,
+                       context.viewport,        context.viewporter,
+                       context.presentation};
+    for (size_t i = 0; i < sizeof(scalers) / sizeof(scalers[0]); ++i)
+        if (scalers[i] != nullptr)
+            (void)wl_proxy_marshal_flags(
+                (struct wl_proxy *)scalers[i], 0, nullptr,
+                wl_proxy_get_version((struct wl_proxy *)scalers[i]),
+                WL_MARSHAL_FLAG_DESTROY);
     wl_surface_destroy(context.surface);
     wl_compositor_destroy(context.compositor);
 
@@ -588,8 +1018,88 @@ void waterlily_destroyWindowContext(void)
     wl_display_disconnect(context.display);
 }
 
-bool waterlily_processWindowEvents()
+bool waterlily_processWindowEvents(int timeout)
 {
+    // Headless runs go as fast as they can, there's no one to wait on.
+    if (context.display == nullptr)
+    {
+        waterlily_waitEvents(0);
+        return true;
+    }
+
+    // Nothing else may be queued once we announce a read, so drain whatever
+    // is already waiting first.
+    while (wl_display_prepare_read(context.display) != 0)
+        if (wl_display_dispatch_pending(context.display) == -1)
+            return false;
+    // A full socket just means the rest goes out on the next flush.
+    if (wl_display_flush(context.display) == -1 && errno != EAGAIN)
+    {
+        wl_display_cancel_read(context.display);
+        return false;
+    }
+
+    context.reading = true;
+    waterlily_waitEvents(timeout);
+    if (context.reading)
+        wl_display_cancel_read(context.display);
+
     return wl_display_dispatch_pending(context.display) != -1;
 }
 
+
+void waterlily_requestWindowFrame(void)
+{
+    // This has to go out before presenting, since the present commits the
+    // surface the callback is attached to.
+    static const struct wl_callback_listener frameListener = {&frameDone};
+    if (context.display == nullptr)
+        return;
+
+    context.frame = wl_surface_frame(context.surface);
+    (void)wl_callback_add_listener(context.frame, &frameListener, nullptr);
+
+    // Taken even without feedback to put it in, so a frame never claims
+    // input an earlier one already showed.
+    uint64_t input = waterlily_takeInputTimestamp();
+    if (context.presentation == nullptr)
+        return;
+
+    struct waterlily_window_feedback *slot = nullptr;
+    for (size_t i = 0; i < WATERLILY_MAX_FEEDBACK && slot == nullptr; ++i)
+        if (context.feedback[i].handle == nullptr)
+            slot = &context.feedback[i];
+    // The compositor is sitting on a lot of frames, this one goes unmeasured.
+    if (slot == nullptr)
+        return;
+
+    static const struct wp_presentation_feedback_listener feedbackListener = {
+        &syncOutput, &presented, &discarded};
+    slot->input = input;
+    // wp_presentation_feedback
+    slot->handle = wl_proxy_marshal_flags(
+        (struct wl_proxy *)context.presentation, 1,
+        &pPresentationFeedbackInterface,
+        wl_proxy_get_version((struct wl_proxy *)context.presentation), 0,
+        context.surface, nullptr);
+    // wp_presentation_feedback_add_listener
+    (void)wl_proxy_add_listener((struct wl_proxy *)slot->handle,
+                                (void (**)(void))&feedbackListener, slot);
+}
+
+void waterlily_finishWindowFrame(bool presented)
+{
+    if (context.frame == nullptr)
+        return;
+
+    if (presented)
+    {
+        context.frameReady = false;
+        return;
+    }
+
+    // Nothing was committed, so the callback would never fire. Leaving the
+    // frame ready has the next wake try again.
+    wl_callback_destroy(context.frame);
+    context.frame = nullptr;
+}
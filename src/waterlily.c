@@ -1,5 +1,13 @@
+#include <internal/clock.h>
+#include <internal/events.h>
+#include <internal/gamepad.h>
 #include <internal/input.h>
 #include <internal/logging.h>
+#include <internal/particles.h>
+#include <internal/profiler.h>
+#include <internal/recorder.h>
+#include <internal/stats.h>
+#include <internal/trace.h>
 #include <internal/vulkan.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -8,28 +16,95 @@
 void cleanup()
 {
     waterlily_destroyVulkanContext();
+    waterlily_destroyGamepadContext();
     waterlily_destroyWindowContext();
+    waterlily_destroyEventContext();
+    waterlily_destroyStatsContext();
+    waterlily_destroyProfilerContext();
+    waterlily_destroyTraceContext();
+    waterlily_destroyLogContext();
 }
 
 int main(int argc, const char *const *const argv)
 {
     if (atexit(cleanup) != 0)
         waterlily_report("Failed to set exit function.");
+    waterlily_createLogContext();
+    waterlily_createRecorderContext();
 
     struct waterlily_configuration *config =
         waterlily_initializeConfiguration(argc, argv);
+    waterlily_createTraceContext(config->arguments.trace);
+    waterlily_createProfilerContext(config->arguments.displayFPS);
+    waterlily_createStatsContext(config->arguments.stats);
+    waterlily_createEventContext();
     struct waterlily_window_context *window =
         waterlily_createWindowContext(config);
-    waterlily_createVulkanContext(window);
+    waterlily_createGamepadContext();
+    waterlily_createVulkanContext(window, config);
+
+    if (config->arguments.record != nullptr)
+        waterlily_recordInput(config->arguments.record);
+    if (config->arguments.replay != nullptr)
+        waterlily_replayInput(config->arguments.replay);
 
     extern bool waterlily_application();
     if (!waterlily_application())
         return -1;
 
-    while (waterlily_processWindowEvents())
+    // Games without anything to simulate don't have to define this.
+    [[gnu::weak]] extern void waterlily_updateApplication(float delta);
+
+    // Frames left to benchmark, the run ends when this reaches zero.
+    uint32_t benchmark = 0;
+    if (config->arguments.particles != 0)
+    {
+        waterlily_startParticleBenchmark(config->arguments.particles,
+                                         window->width, window->height);
+        benchmark = WATERLILY_PARTICLE_BENCHMARK_FRAMES;
+    }
+
+    waterlily_createClockContext();
+    uint64_t lastFrame = 0;
+    // Always block, the compositor's frame callbacks and the tick timer are
+    // what wake us. Nothing is ever drawn that the compositor didn't ask for.
+    // A headless run is over once its replay or benchmark is.
+    while (waterlily_processWindowEvents(-1) &&
+           (!config->arguments.headless || waterlily_isReplayingInput() ||
+            benchmark != 0))
     {
-        waterlily_handleKeys();
-        waterlily_renderFrame();
+        waterlily_beginStatsFrame();
+        // The simulation runs at a fixed rate no matter how fast frames are
+        // drawn, and the renderer interpolates with the clock's alpha. Input
+        // is taken per tick, so a press is seen by exactly one of them.
+        uint32_t ticks = waterlily_advanceClock();
+        for (uint32_t i = 0; i < ticks; ++i)
+        {
+            WATERLILY_TRACE_SCOPE("tick");
+            waterlily_handleKeys();
+            if (waterlily_updateApplication != nullptr)
+                waterlily_updateApplication(1.0f / WATERLILY_TICK_RATE);
+        }
+
+        bool background = config->throttle && !window->activated;
+        waterlily_throttleClock(background);
+
+        uint64_t now = waterlily_getClockTime();
+        if (window->suspended || !window->frameReady ||
+            (background && now - lastFrame < WATERLILY_BACKGROUND_NS))
+            continue;
+
+        waterlily_requestWindowFrame();
+        bool presented = waterlily_renderFrame();
+        waterlily_finishWindowFrame(presented);
+        if (!presented)
+            continue;
+
+        waterlily_endStatsFrame();
+        waterlily_markProfilerFrame();
+        lastFrame = now;
+        if (benchmark != 0 && --benchmark == 0)
+            break;
     }
 
     extern void waterlily_cleanupApplication();